@@ -85,6 +85,8 @@ function TabPanel(props: TabPanelProps) {
 const BASE_LOCKOUT_TIME = 5; // seconds
 
 const App = () => {
+  const FIREBASE_FUNCTIONS_BASE_URL = "YOUR FUNCTIONS BASE URL";
+
   // Authentication and user state
   const [username, setUsername] = useState<string>("");
   const [password, setPassword] = useState<string>("");
@@ -110,6 +112,8 @@ const App = () => {
   // QR Code dialog state
   const [qrData, setQrData] = useState<string>("");
   const [isQrDialogOpen, setIsQrDialogOpen] = useState<boolean>(false);
+  const [qrUserKey, setQrUserKey] = useState<string>("");
+  const [qrPassword, setQrPassword] = useState<string>("");
   // Ref for the QR code canvas element
   const qrCanvasRef = useRef<HTMLCanvasElement | null>(null);
 
@@ -265,7 +269,9 @@ const App = () => {
     }
   }, [isLockoutOpen, lockoutTime]);
 
-  // Generate QR code with hex-encoded user key
+  // Generate QR code holding the hex-encoded user key. A signed token, which
+  // door scanners verify on their own, is issued in its place once the user
+  // confirms their password (see issueSignedQRCode).
   const generateQRCode = () => {
     if (userData) {
       const loginsRef = ref(database, "logins");
@@ -277,8 +283,8 @@ const App = () => {
             (key) => allLogins[key].name === userData.name
           );
           if (userKey) {
-            const userKeyHex = stringToHex(userKey);
-            setQrData(userKeyHex);
+            setQrUserKey(userKey);
+            setQrData(stringToHex(userKey));
             setIsQrDialogOpen(true);
           }
         },
@@ -287,6 +293,33 @@ const App = () => {
     }
   };
 
+  // Swap the QR code for a signed token. The function checks the password
+  // against the stored hash, so it is asked for here rather than kept.
+  const issueSignedQRCode = async () => {
+    if (!qrPassword) {
+      alert("Please enter your password");
+      return;
+    }
+    try {
+      const response = await fetch(`${FIREBASE_FUNCTIONS_BASE_URL}/issueQrToken`, {
+        method: "POST",
+        headers: { "Content-Type": "application/json" },
+        body: JSON.stringify({ userId: qrUserKey, password: qrPassword }),
+      });
+      const data = await response.json();
+      if (response.ok) {
+        setQrData(data.token);
+      } else {
+        console.error("Error issuing QR token:", data.error);
+        alert(response.status === 403 ? "Incorrect password" : "Could not issue a signed QR code");
+      }
+    } catch (error) {
+      console.error("Error issuing QR token:", error);
+      alert("Could not issue a signed QR code");
+    }
+    setQrPassword("");
+  };
+
   // Download the QR code as a PNG image
   const downloadQR = () => {
     if (qrCanvasRef.current) {
@@ -654,6 +687,31 @@ const App = () => {
   />
 </div>
     )}
+    {qrData === stringToHex(qrUserKey) && (
+      <div style={{ marginTop: "10px" }}>
+        <input
+          type="password"
+          placeholder="Password for a signed QR code"
+          value={qrPassword}
+          onChange={(e) => setQrPassword(e.target.value)}
+          style={{
+            width: "100%",
+            padding: "10px",
+            margin: "10px 0",
+            borderRadius: "5px",
+            border: "1px solid #ccc",
+            color: "#333",
+          }}
+        />
+        <Button
+          variant="contained"
+          onClick={issueSignedQRCode}
+          style={{ backgroundColor: "#333" }}
+        >
+          Get Signed QR Code
+        </Button>
+      </div>
+    )}
     <Button
       variant="contained"
       onClick={downloadQR}
@@ -2,6 +2,7 @@ const functions = require("firebase-functions");
 const admin = require("firebase-admin");
 const sgMail = require("@sendgrid/mail");
 const bcrypt = require("bcrypt");
+const crypto = require("crypto");
 const cors = require("cors")({ origin: true }); // Import and configure CORS
 
 // Initialize Firebase Admin
@@ -536,3 +537,192 @@ exports.resetAttendance = functions.pubsub
 
     return null;
   });
+
+// ---------- Class Roster Sync Functions ----------
+// Mirror every enrollment into classRosters/{classId}/{userId} = name so a
+// door scanner can download one class's roster in a single small request
+// instead of checking logins/{userId}/enrolledClasses on every scan.
+// Every enrollment carries an attendance flag from the moment it is made
+// until it is removed, so its creation and deletion mark the enrollment's;
+// flipping it and writing attendance logs do not run these at all.
+exports.addToClassRoster = functions.database
+  .ref("logins/{userId}/enrolledClasses/{classId}/attendance")
+  .onCreate(async (snapshot, context) => {
+    const { userId, classId } = context.params;
+    try {
+      const nameSnapshot = await admin
+        .database()
+        .ref(`logins/${userId}/name`)
+        .once("value");
+      await admin
+        .database()
+        .ref(`classRosters/${classId}/${userId}`)
+        .set(nameSnapshot.val() || userId);
+    } catch (error) {
+      console.error("Error adding to class roster:", error);
+    }
+    return null;
+  });
+
+exports.removeFromClassRoster = functions.database
+  .ref("logins/{userId}/enrolledClasses/{classId}/attendance")
+  .onDelete(async (snapshot, context) => {
+    const { userId, classId } = context.params;
+    try {
+      await admin
+        .database()
+        .ref(`classRosters/${classId}/${userId}`)
+        .remove();
+    } catch (error) {
+      console.error("Error removing from class roster:", error);
+    }
+    return null;
+  });
+
+// Keeps the name scanners show in step with the user's, in every class
+// they are enrolled in.
+exports.renameInClassRosters = functions.database
+  .ref("logins/{userId}/name")
+  .onWrite(async (change, context) => {
+    const { userId } = context.params;
+    try {
+      const enrolledSnapshot = await admin
+        .database()
+        .ref(`logins/${userId}/enrolledClasses`)
+        .once("value");
+      const updates = {};
+      for (const classId of Object.keys(enrolledSnapshot.val() || {})) {
+        updates[`classRosters/${classId}/${userId}`] = change.after.val() || userId;
+      }
+      if (Object.keys(updates).length > 0) {
+        await admin.database().ref().update(updates);
+      }
+    } catch (error) {
+      console.error("Error renaming in class rosters:", error);
+    }
+    return null;
+  });
+
+// One-off backfill: rebuilds classRosters from every user's enrollments,
+// for enrollments made before the functions above were deployed and to
+// drop entries they missed. Safe to call again; it only derives data.
+// Rewrites every roster, so it takes an admin's username and password,
+// checked the same way the admin page's login checks them.
+exports.backfillClassRosters = functions.https.onRequest((req, res) => {
+  return cors(req, res, async () => {
+    if (req.method !== "POST") {
+      return res.status(405).send("Method Not Allowed");
+    }
+    try {
+      const { username, password } = req.body || {};
+      if (!username || !password) {
+        return res.status(400).json({ error: "Missing required fields" });
+      }
+      const adminSnapshot = await admin.database().ref(`logins/${username}`).once("value");
+      const adminUser = adminSnapshot.val();
+      if (
+        !adminUser ||
+        adminUser.role !== "admin" ||
+        !adminUser.password ||
+        !(await bcrypt.compare(password, adminUser.password))
+      ) {
+        return res.status(403).json({ error: "Not allowed" });
+      }
+
+      const loginsSnapshot = await admin.database().ref("logins").once("value");
+      const rosters = {};
+      let entries = 0;
+      loginsSnapshot.forEach((userSnapshot) => {
+        const user = userSnapshot.val() || {};
+        for (const classId of Object.keys(user.enrolledClasses || {})) {
+          rosters[classId] = rosters[classId] || {};
+          rosters[classId][userSnapshot.key] = user.name || userSnapshot.key;
+          entries++;
+        }
+      });
+      await admin.database().ref("classRosters").set(rosters);
+      return res.status(200).json({ classes: Object.keys(rosters).length, entries });
+    } catch (error) {
+      console.error("Error backfilling class rosters:", error);
+      return res.status(500).json({ error: "Error backfilling class rosters", details: error.message });
+    }
+  });
+});
+
+// ---------- Classes Version Function ----------
+// Bumps classesMeta/version on every class change. Door scanners poll this
+// tiny node and only download and recompile classes.json when it moves.
+exports.bumpClassesVersion = functions.database
+  .ref("classes/{classId}")
+  .onWrite(async (change, context) => {
+    try {
+      await admin
+        .database()
+        .ref("classesMeta/version")
+        .set(admin.database.ServerValue.TIMESTAMP);
+    } catch (error) {
+      console.error("Error bumping classes version:", error);
+    }
+    return null;
+  });
+
+// ---------- Issue QR Token Function ----------
+// Signs the QR code a door scanner checks on its own, without a database
+// round trip:
+//
+//   IA1.<userId>.<notBefore>.<notAfter>.<classes>.<mac>
+//
+// classes lists the user's enrolled class IDs at issue time. mac is the
+// first 16 bytes of HMAC-SHA256 over the rest, base64url-encoded. The key
+// is shared with the scanners' QR_TOKEN_KEY build flag:
+// firebase functions:config:set qrtoken.key="<64 hex chars>"
+// A token outlives unenrollment and password changes until it expires, so
+// it lasts a day; the user asks for a new one with their password.
+const QR_TOKEN_LIFETIME_SECONDS = 24 * 3600;
+
+function signQrToken(keyHex, userId, classIds, notBefore, notAfter) {
+  const body = `IA1.${userId}.${notBefore}.${notAfter}.${classIds.join(",")}`;
+  const mac = crypto
+    .createHmac("sha256", Buffer.from(keyHex, "hex"))
+    .update(body)
+    .digest()
+    .subarray(0, 16)
+    .toString("base64url");
+  return `${body}.${mac}`;
+}
+
+exports.issueQrToken = functions.https.onRequest((req, res) => {
+  return cors(req, res, async () => {
+    if (req.method !== "POST") {
+      return res.status(405).send("Method Not Allowed");
+    }
+    try {
+      // password is the user's plaintext password, checked against the
+      // stored hash; the hash itself is readable by clients and never accepted
+      const { userId, password } = req.body;
+      if (!userId || !password) {
+        return res.status(400).json({ error: "Missing required fields" });
+      }
+
+      const snapshot = await admin.database().ref(`logins/${userId}`).once("value");
+      const user = snapshot.val();
+      if (!user || !user.password || !(await bcrypt.compare(password, user.password))) {
+        return res.status(403).json({ error: "Not allowed" });
+      }
+
+      const classIds = Object.keys(user.enrolledClasses || {});
+      const notBefore = Math.floor(Date.now() / 1000);
+      const token = signQrToken(
+        functions.config().qrtoken.key,
+        userId,
+        classIds,
+        notBefore,
+        notBefore + QR_TOKEN_LIFETIME_SECONDS
+      );
+      return res.status(200).json({ token, expires: notBefore + QR_TOKEN_LIFETIME_SECONDS });
+    } catch (error) {
+      console.error("Error issuing QR token:", error);
+      return res.status(500).json({ error: "Error issuing QR token", details: error.message });
+    }
+  });
+});
@@ -0,0 +1,599 @@
+// Scan-to-unlock benchmark for the native build. Boots the firmware against
+// the mock HAL, replays a scan script in front of the simulated camera and
+// reports how long each scan took to reach the relay, how many backend
+// requests and bytes on the wire the replay cost and how many heap
+// allocations the scan path made.
+// Throughput is people per minute over the time spent in scan commands,
+// i.e. how fast a queue of students gets through the door.
+//
+//   node tools/mock-firebase.js --data bench/seed.json --latency 80 &
+//   pio run -e native && .pio/build/native/program bench/scripts/roster.txt
+//
+// To go through the edge gateway instead, also start
+// "node tools/edge-gateway.js --key 62656e63682d6b6579" (the native-gateway
+// GATEWAY_KEY) and build with "pio run -e native-gateway".
+//
+// Script commands, one per line ('#' starts a comment):
+//
+//   scan <userId> [holdMs]  show the user's code until the door opens or
+//                           holdMs (default 3000) passes; expects an unlock.
+//                           A user ID is shown hex-encoded, like the web app
+//                           prints it; a signed token (IA1....) as it is
+//   deny <userId> [holdMs]  same, but expects the door to stay shut
+//   show <userId> <ms>      keep the user's code in view for ms, whatever
+//                           the door does, then take it away
+//   door open|closed        check the door is in that state right now; the
+//                           run fails if not
+//   wait <ms>               leave the camera empty
+//   class <classId> <time>  set the class's time on the mock backend, e.g.
+//                           "08:00 - 09:00"; "now" starts it this minute
+//                           (until 23:59), which puts the firmware in burst
+//                           entry. While the door is held open a scan counts
+//                           once the burst chirp plays, and the next code is
+//                           shown right after; use a different user each time.
+//   offline / online        drop or restore the WiFi link
+//   journal <userId> <classId>
+//                           journal a time-in as an admitted scan would,
+//                           bypassing the door decision; for IDs the
+//                           backend refuses
+//   uploaded <userId> <classId> [n]
+//                           check that the user has an attendance log in
+//                           the class on the backend, or exactly n of them;
+//                           the run fails if not
+//   unenrolled <userId> <classId>
+//                           check that the user is still not enrolled in the
+//                           class, i.e. no upload brought the enrollment
+//                           back; the run fails if it did
+//   repeat <n> ... end      run the enclosed lines n times
+
+#include <Arduino.h>
+#include "MockHal.h"
+#include "ScanJournal.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+void setup();
+void loop();
+bool recordScan(const char *userId, const char *classId, ScanDirection direction, const char *logKey);
+
+#define RELAY_PIN 13
+#define RELAY_OPEN LOW
+#define BURST_CHIRP 2500 // Hz, the firmware's burstChirpFrequency
+
+const uint32_t bootSettle = 2000;   // after setup(): lets the schedule stream connect
+const uint32_t defaultHold = 3000;  // ms a code stays in view
+const uint32_t relaySettle = 4000;  // longest wait for the door to close again
+const uint32_t codeRemovalGap = 2100; // just over the firmware's codeRemovalThreshold
+const uint32_t nextPersonGap = 500;   // door held open: the next student steps up
+
+struct Command
+{
+  std::string name;
+  std::string argument;
+  std::string time; // class
+  std::string classId; // journal, uploaded, unenrolled
+  std::string state;   // door
+  uint32_t value = 0;
+  size_t blockEnd = 0; // repeat: index of its matching end
+};
+
+struct Results
+{
+  std::vector<double> latencies; // ms, scans that opened the door
+  uint32_t scans = 0;
+  uint32_t expectedUnlocks = 0;
+  uint32_t missed = 0;
+  uint32_t falseUnlocks = 0;
+  uint32_t failedChecks = 0; // uploaded, unenrolled, door
+  double scanTime = 0; // ms spent in scan commands
+};
+
+static std::atomic<int64_t> shownAt{-1};   // us, while a scan waits for the relay
+static std::atomic<int64_t> unlockedAt{-1};
+static std::atomic<bool> relayOpen{false};
+
+// --- onPinWrite ---
+// Runs on whichever firmware thread drives the relay.
+static void onPinWrite(uint8_t pin, uint8_t value)
+{
+  if (pin != RELAY_PIN)
+  {
+    return;
+  }
+  relayOpen = value == RELAY_OPEN;
+  if (value == RELAY_OPEN && shownAt >= 0 && unlockedAt < 0)
+  {
+    unlockedAt = (int64_t)micros();
+  }
+}
+
+// While the door is held open the burst chirp is the scan's answer
+static void onTone(uint32_t frequency)
+{
+  if (frequency == BURST_CHIRP && shownAt >= 0 && unlockedAt < 0)
+  {
+    unlockedAt = (int64_t)micros();
+  }
+}
+
+static std::string toHex(const std::string &text)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (unsigned char c : text)
+  {
+    hex += digits[c >> 4];
+    hex += digits[c & 0x0F];
+  }
+  return hex;
+}
+
+static void waitFor(uint32_t timeout, bool (*done)())
+{
+  unsigned long start = millis();
+  while (!done() && millis() - start < timeout)
+  {
+    delay(1);
+  }
+}
+
+// --- runScan ---
+// Shows one code, waits for the relay or the hold time, then takes it away
+// and lets the door close so the next scan starts from a shut door.
+static void runScan(const Command &command, bool expectUnlock, Results &results)
+{
+  bool doorHeld = relayOpen;
+  std::string payload = command.argument.rfind("IA1.", 0) == 0 ? command.argument : toHex(command.argument);
+  unlockedAt = -1;
+  shownAt = (int64_t)micros();
+  mockShowCode(payload.c_str());
+
+  waitFor(command.value, []() { return unlockedAt >= 0; });
+  mockShowCode(nullptr);
+  int64_t unlocked = unlockedAt;
+  int64_t shown = shownAt;
+  shownAt = -1;
+
+  results.scans++;
+  bool opened = unlocked >= 0;
+  if (expectUnlock)
+  {
+    results.expectedUnlocks++;
+  }
+  if (opened)
+  {
+    double latency = (unlocked - shown) / 1000.0;
+    results.latencies.push_back(latency);
+    printf("bench: %-5s %-20s %s after %.1f ms%s\n", command.name.c_str(), command.argument.c_str(),
+           doorHeld ? "acknowledged" : "unlocked", latency, expectUnlock ? "" : " (UNEXPECTED)");
+    if (!expectUnlock)
+    {
+      results.falseUnlocks++;
+    }
+  }
+  else
+  {
+    printf("bench: %-5s %-20s no unlock%s\n", command.name.c_str(), command.argument.c_str(),
+           expectUnlock ? " (MISSED)" : "");
+    if (expectUnlock)
+    {
+      results.missed++;
+    }
+  }
+
+  if (doorHeld)
+  {
+    delay(nextPersonGap);
+  }
+  else
+  {
+    waitFor(relaySettle, []() { return !relayOpen; });
+    delay(codeRemovalGap);
+  }
+  results.scanTime += (micros() - shown) / 1000.0;
+}
+
+// --- backendRequest ---
+// Sends one request to the backend the firmware talks to, behind its back.
+// Returns false unless it answers 200; response gets the whole answer.
+static bool backendRequest(const std::string &method, const std::string &path, const std::string &body,
+                           std::string &response)
+{
+  char host[64];
+  int port = 80;
+  if (sscanf(BACKEND_URL, "http://%63[^:/]:%d", host, &port) < 1)
+  {
+    return false;
+  }
+  std::string request = method + " /" + path + " HTTP/1.1\r\nHost: " + host +
+                        "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                        "\r\nConnection: close\r\n\r\n" + body;
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t)port);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+      connect(fd, (sockaddr *)&address, sizeof(address)) != 0 ||
+      send(fd, request.data(), request.size(), 0) != (ssize_t)request.size())
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+  response.clear();
+  char buffer[1024];
+  ssize_t received;
+  while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+  {
+    response.append(buffer, (size_t)received);
+  }
+  close(fd);
+  return response.compare(0, 12, "HTTP/1.1 200") == 0;
+}
+
+// --- setClassTime ---
+// PATCHes classes/<classId>/time on the backend.
+static bool setClassTime(const std::string &classId, std::string time)
+{
+  if (time == "now")
+  {
+    struct tm now;
+    getLocalTime(&now);
+    char start[16];
+    snprintf(start, sizeof(start), "%02d:%02d", now.tm_hour, now.tm_min);
+    time = std::string(start) + " - 23:59";
+  }
+  std::string response;
+  if (!backendRequest("PATCH", "classes/" + classId + ".json", "{\"time\":\"" + time + "\"}", response))
+  {
+    return false;
+  }
+  printf("bench: class %s at %s\n", classId.c_str(), time.c_str());
+  return true;
+}
+
+// --- checkUploaded ---
+// Whether the backend holds an attendance log of the user in the class, or
+// as many as the command expects.
+static void checkUploaded(const Command &command, Results &results)
+{
+  std::string response;
+  uint32_t logs = 0;
+  if (backendRequest("GET",
+                     "logins/" + command.argument + "/enrolledClasses/" + command.classId + "/attendanceLogs.json",
+                     "", response))
+  {
+    size_t at = 0;
+    while ((at = response.find("\"time_in\"", at)) != std::string::npos)
+    {
+      logs++;
+      at++;
+    }
+  }
+  bool found = command.value > 0 ? logs == command.value : logs > 0;
+  printf("bench: %-8s %-20s has %u attendance log(s)%s\n", command.name.c_str(), command.argument.c_str(),
+         (unsigned)logs, found ? "" : " (FAILED)");
+  if (!found)
+  {
+    results.failedChecks++;
+  }
+}
+
+// --- checkUnenrolled ---
+// Whether the backend still has no enrollment of the user in the class.
+static void checkUnenrolled(const Command &command, Results &results)
+{
+  std::string response;
+  bool absent =
+      backendRequest("GET", "logins/" + command.argument + "/enrolledClasses/" + command.classId + ".json", "",
+                     response) &&
+      response.size() >= 8 && response.compare(response.size() - 8, 8, "\r\n\r\nnull") == 0;
+  printf("bench: %-8s %-20s %s%s\n", command.name.c_str(), command.argument.c_str(),
+         absent ? "is not enrolled" : "is enrolled", absent ? "" : " (FAILED)");
+  if (!absent)
+  {
+    results.failedChecks++;
+  }
+}
+
+static bool parseScript(const char *path, std::vector<Command> &commands)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    fprintf(stderr, "bench: cannot open %s\n", path);
+    return false;
+  }
+  std::string line;
+  int lineNumber = 0;
+  std::vector<size_t> openRepeats;
+  while (std::getline(file, line))
+  {
+    lineNumber++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    Command command;
+    if (!(words >> command.name))
+    {
+      continue;
+    }
+    if (command.name == "class")
+    {
+      if (!(words >> command.argument) || !std::getline(words >> std::ws, command.time) || command.time.empty())
+      {
+        fprintf(stderr, "bench: %s:%d: class needs a class id and a time\n", path, lineNumber);
+        return false;
+      }
+    }
+    else if (command.name == "journal" || command.name == "uploaded" || command.name == "unenrolled")
+    {
+      if (!(words >> command.argument >> command.classId))
+      {
+        fprintf(stderr, "bench: %s:%d: %s needs a user id and a class id\n", path, lineNumber,
+                command.name.c_str());
+        return false;
+      }
+      if (command.name == "uploaded")
+      {
+        words >> command.value;
+      }
+    }
+    else if (command.name == "scan" || command.name == "deny")
+    {
+      command.value = defaultHold;
+      if (!(words >> command.argument))
+      {
+        fprintf(stderr, "bench: %s:%d: %s needs a user id\n", path, lineNumber, command.name.c_str());
+        return false;
+      }
+      words >> command.value;
+    }
+    else if (command.name == "show")
+    {
+      if (!(words >> command.argument >> command.value))
+      {
+        fprintf(stderr, "bench: %s:%d: show needs a user id and a time\n", path, lineNumber);
+        return false;
+      }
+    }
+    else if (command.name == "door")
+    {
+      if (!(words >> command.state) || (command.state != "open" && command.state != "closed"))
+      {
+        fprintf(stderr, "bench: %s:%d: door needs open or closed\n", path, lineNumber);
+        return false;
+      }
+    }
+    else if (command.name == "wait" || command.name == "repeat")
+    {
+      if (!(words >> command.value))
+      {
+        fprintf(stderr, "bench: %s:%d: %s needs a number\n", path, lineNumber, command.name.c_str());
+        return false;
+      }
+    }
+    else if (command.name != "offline" && command.name != "online" && command.name != "end")
+    {
+      fprintf(stderr, "bench: %s:%d: unknown command '%s'\n", path, lineNumber, command.name.c_str());
+      return false;
+    }
+    if (command.name == "repeat")
+    {
+      openRepeats.push_back(commands.size());
+    }
+    else if (command.name == "end")
+    {
+      if (openRepeats.empty())
+      {
+        fprintf(stderr, "bench: %s:%d: end without repeat\n", path, lineNumber);
+        return false;
+      }
+      commands[openRepeats.back()].blockEnd = commands.size();
+      openRepeats.pop_back();
+    }
+    commands.push_back(command);
+  }
+  if (!openRepeats.empty())
+  {
+    fprintf(stderr, "bench: %s: repeat without end\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Runs commands[first, last), expanding repeat blocks.
+static void runCommands(const std::vector<Command> &commands, size_t first, size_t last, Results &results)
+{
+  size_t i = first;
+  while (i < last)
+  {
+    const Command &command = commands[i];
+    if (command.name == "repeat")
+    {
+      for (uint32_t round = 0; round < command.value; round++)
+      {
+        runCommands(commands, i + 1, command.blockEnd, results);
+      }
+      i = command.blockEnd + 1;
+      continue;
+    }
+    if (command.name == "scan" || command.name == "deny")
+    {
+      runScan(command, command.name == "scan", results);
+    }
+    else if (command.name == "show")
+    {
+      std::string payload = command.argument.rfind("IA1.", 0) == 0 ? command.argument : toHex(command.argument);
+      mockShowCode(payload.c_str());
+      delay(command.value);
+      mockShowCode(nullptr);
+      printf("bench: show  %-20s for %u ms\n", command.argument.c_str(), (unsigned)command.value);
+    }
+    else if (command.name == "door")
+    {
+      bool open = relayOpen;
+      bool expected = command.state == "open";
+      printf("bench: door  %s%s\n", open ? "open" : "closed", open == expected ? "" : " (FAILED)");
+      if (open != expected)
+      {
+        results.failedChecks++;
+      }
+    }
+    else if (command.name == "wait")
+    {
+      delay(command.value);
+    }
+    else if (command.name == "class")
+    {
+      if (!setClassTime(command.argument, command.time))
+      {
+        fprintf(stderr, "bench: could not set the time of %s\n", command.argument.c_str());
+      }
+    }
+    else if (command.name == "offline" || command.name == "online")
+    {
+      mockHal().wifiUp = command.name == "online";
+      printf("bench: WiFi %s\n", command.name == "online" ? "up" : "down");
+    }
+    else if (command.name == "journal")
+    {
+      bool journaled = recordScan(command.argument.c_str(), command.classId.c_str(), SCAN_TIME_IN, "");
+      printf("bench: journal  %-20s %s\n", command.argument.c_str(), journaled ? "journaled" : "refused");
+    }
+    else if (command.name == "uploaded")
+    {
+      checkUploaded(command, results);
+    }
+    else if (command.name == "unenrolled")
+    {
+      checkUnenrolled(command, results);
+    }
+    i++;
+  }
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+  if (sorted.empty())
+  {
+    return 0;
+  }
+  size_t rank = (size_t)(fraction * sorted.size() + 0.999999);
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+int main(int argc, char **argv)
+{
+  const char *scriptPath = nullptr;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--verbose") == 0)
+    {
+      verbose = true;
+    }
+    else
+    {
+      scriptPath = argv[i];
+    }
+  }
+  if (scriptPath == nullptr)
+  {
+    fprintf(stderr, "usage: %s [--verbose] <script>\n", argv[0]);
+    return 2;
+  }
+  std::vector<Command> commands;
+  if (!parseScript(scriptPath, commands))
+  {
+    return 2;
+  }
+
+  // Firmware logging goes to the console only when asked for
+  mockHal().echoSerial = verbose;
+  mockHal().pinWriteHook = onPinWrite;
+  mockHal().toneHook = onTone;
+
+  printf("bench: booting firmware\n");
+  // Like the Arduino core, setup() and loop() share a task, which loop()
+  // sleeps on between wakes
+  static std::atomic<bool> setupDone(false);
+  static std::atomic<uint32_t> setupTime(0);
+  xTaskCreate(
+      [](void *) {
+        unsigned long start = millis();
+        setup();
+        setupTime = millis() - start;
+        setupDone = true;
+        while (true)
+        {
+          loop();
+        }
+      },
+      "loopTask", 8 * 1024, nullptr, 1, nullptr);
+  while (!setupDone)
+  {
+    delay(10);
+  }
+  printf("bench: ready to scan %u ms after boot\n", (unsigned)setupTime);
+  delay(bootSettle);
+
+  // Stages that must not touch the heap once running
+  static const char *const scanTasks[] = {"decode", "decision"};
+  uint32_t allocationsBefore[2];
+  for (size_t i = 0; i < 2; i++)
+  {
+    allocationsBefore[i] = mockTaskAllocations(scanTasks[i]);
+  }
+
+  Results results;
+  uint32_t requestsBefore = mockHal().httpRequests;
+  uint32_t connectionsBefore = mockHal().connections;
+  uint64_t sentBefore = mockHal().bytesSent;
+  uint64_t receivedBefore = mockHal().bytesReceived;
+  runCommands(commands, 0, commands.size(), results);
+  uint32_t requests = mockHal().httpRequests - requestsBefore;
+  uint32_t connections = mockHal().connections - connectionsBefore;
+  uint64_t sent = mockHal().bytesSent - sentBefore;
+  uint64_t received = mockHal().bytesReceived - receivedBefore;
+
+  std::sort(results.latencies.begin(), results.latencies.end());
+  printf("\nScans: %u (%u expected to unlock)\n", results.scans, results.expectedUnlocks);
+  printf("Unlocked: %u, missed: %u, false unlocks: %u\n", (unsigned)results.latencies.size(), results.missed,
+         results.falseUnlocks);
+  if (results.failedChecks > 0)
+  {
+    printf("Failed checks: %u\n", results.failedChecks);
+  }
+  if (!results.latencies.empty())
+  {
+    printf("Scan-to-relay latency (ms): p50 %.1f  p99 %.1f  max %.1f\n", percentile(results.latencies, 0.50),
+           percentile(results.latencies, 0.99), results.latencies.back());
+    printf("Throughput: %.1f people/min (%.1f s in scans)\n",
+           results.latencies.size() * 60000.0 / results.scanTime, results.scanTime / 1000.0);
+  }
+  printf("Backend requests: %u (%.2f per scan), %u new connection(s)\n", requests,
+         results.scans > 0 ? (double)requests / results.scans : 0.0, connections);
+  printf("Network traffic: %llu bytes sent, %llu received (%.0f per scan)\n", (unsigned long long)sent,
+         (unsigned long long)received, results.scans > 0 ? (double)(sent + received) / results.scans : 0.0);
+  for (size_t i = 0; i < 2; i++)
+  {
+    uint32_t allocations = mockTaskAllocations(scanTasks[i]) - allocationsBefore[i];
+    printf("Heap allocations in %s task: %u (%.2f per scan)\n", scanTasks[i], allocations,
+           results.scans > 0 ? (double)allocations / results.scans : 0.0);
+  }
+  fflush(stdout);
+
+  // The firmware's tasks never return; leave without running destructors
+  // under them.
+  _exit(results.missed > 0 || results.falseUnlocks > 0 || results.failedChecks > 0 ? 1 : 0);
+}
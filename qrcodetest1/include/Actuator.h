@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#define MAX_TONE_STEPS 16
+
+// One step of a buzzer sequence. A frequency of 0 is a rest.
+struct ToneStep
+{
+  uint16_t frequency;
+  uint16_t duration; // ms
+};
+
+// Drives the buzzer and the door relay from esp_timer callbacks, so a
+// caller only queues feedback and never sleeps through it. Tones play one
+// after another from a small ring; a relay pulse that arrives while the
+// relay is already open extends it instead of cutting it short.
+class Actuator
+{
+public:
+  bool begin(uint8_t buzzerPin, uint8_t buzzerChannel, uint8_t relayPin, uint8_t relayActiveLevel);
+
+  // Queue tones behind whatever is playing. Returns false if the ring is full.
+  bool playTone(uint16_t frequency, uint16_t duration);
+  bool playSequence(const ToneStep *steps, size_t count);
+  void rest(uint16_t duration) { playTone(0, duration); }
+
+  // Opens the relay for duration ms, or longer if already opened for longer.
+  void pulseRelay(uint32_t duration);
+  // Keeps the relay open until releaseRelay().
+  void holdRelay();
+  // Closes the relay after delay ms (at once for 0).
+  void releaseRelay(uint32_t delay = 0);
+  bool relayOpen() const { return relayIsOpen; }
+
+private:
+  static void onToneTimer(void *arg);
+  static void onRelayTimer(void *arg);
+  void nextTone();
+  void writeRelay(bool open);
+  void armRelay(uint32_t duration);
+
+  uint8_t buzzerPin = 0;
+  uint8_t buzzerChannel = 0;
+  uint8_t relayPin = 0;
+  uint8_t relayActiveLevel = LOW;
+  esp_timer_handle_t toneTimer = nullptr;
+  esp_timer_handle_t relayTimer = nullptr;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+  ToneStep steps[MAX_TONE_STEPS];
+  size_t head = 0;
+  size_t count = 0;
+  bool playing = false;
+
+  volatile bool relayIsOpen = false;
+  bool relayHeld = false;
+  int64_t relayCloseAt = 0; // esp_timer time, us
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+class BodyStream;
+
+// Single owner of the HTTPS connection to the Firebase REST root.
+// Every backend helper goes through here so the TLS handshake is paid once
+// and later requests ride the same socket with HTTP/1.1 keep-alive.
+// Requests from different tasks are serialized on an internal mutex.
+// Paths and bodies are plain C strings so callers can build them in stack
+// buffers; the String overloads are for code off the scan path.
+class BackendClient
+{
+public:
+  void begin(const char *baseUrl);
+
+  // Whole response as a String. Off the scan path only; prefer getJson().
+  int get(const char *path, String &response);
+  // GET parsed straight off the socket into doc, optionally through an
+  // ArduinoJson filter, so the response never exists as a whole String.
+  int getJson(const char *path, JsonDocument &doc, const JsonDocument *filter = nullptr,
+              DeserializationError *error = nullptr);
+  // getJson() using Firebase ETags. Sends If-None-Match when etag is set,
+  // then stores the response's ETag back into it. Returns
+  // HTTP_CODE_NOT_MODIFIED (doc untouched) when the data has not changed.
+  int getJsonIfChanged(const char *path, String &etag, JsonDocument &doc, const JsonDocument *filter = nullptr,
+                       DeserializationError *error = nullptr);
+  // Writes. Without a response String the reply is skipped as it arrives
+  // rather than buffered.
+  int put(const char *path, const char *body, String *response = nullptr);
+  int post(const char *path, const char *body, String *response = nullptr);
+  int patch(const char *path, const char *body, String *response = nullptr);
+
+  int get(const String &path, String &response) { return get(path.c_str(), response); }
+  int getJson(const String &path, JsonDocument &doc, const JsonDocument *filter = nullptr,
+              DeserializationError *error = nullptr)
+  {
+    return getJson(path.c_str(), doc, filter, error);
+  }
+  int getJsonIfChanged(const String &path, String &etag, JsonDocument &doc, const JsonDocument *filter = nullptr,
+                       DeserializationError *error = nullptr)
+  {
+    return getJsonIfChanged(path.c_str(), etag, doc, filter, error);
+  }
+  int put(const String &path, const String &body, String *response = nullptr)
+  {
+    return put(path.c_str(), body.c_str(), response);
+  }
+  int post(const String &path, const String &body, String *response = nullptr)
+  {
+    return post(path.c_str(), body.c_str(), response);
+  }
+  int patch(const String &path, const String &body, String *response = nullptr)
+  {
+    return patch(path.c_str(), body.c_str(), response);
+  }
+
+  // Drop the connection (e.g. after WiFi loss); the next request reconnects.
+  void disconnect();
+
+private:
+  // Where a response body goes: a String, or a JSON document parsed from
+  // the stream. The ETag is captured when etag is set.
+  struct Response
+  {
+    String *text = nullptr;
+    String *etag = nullptr;
+    JsonDocument *json = nullptr;
+    const JsonDocument *filter = nullptr;
+    const String *skipIfEtag = nullptr; // leave doc alone if the ETag matches
+    DeserializationError jsonError;
+  };
+
+  int request(const char *method, const char *path, const char *body, Response &response);
+  int send(const char *method, const char *body, Response &response);
+  void readJson(Response &response);
+  BodyStream bodyStream();
+
+  const char *baseUrl = "";
+  String url; // of the request in flight; keeps its capacity between requests
+  WiFiClientSecure secureClient;
+  WiFiClient plainClient; // for http:// test servers such as tools/mock-firebase.js
+  WiFiClient *client = &secureClient;
+  HTTPClient http;
+  SemaphoreHandle_t lock = nullptr;
+  unsigned long lastUsed = 0;
+  uint32_t handshakes = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <Preferences.h>
+#include "ClassSchedule.h"
+#include "EnrollmentRoster.h"
+
+// How the last boot joined WiFi, so the next one can go straight to the AP
+// without scanning. Addresses are the DHCP lease, in network order.
+struct WiFiCache
+{
+  uint8_t ap; // index into the firmware's list of known APs
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// What a boot needs before the network is back: the WiFi AP, the last
+// known time and the self-test request in NVS, and copies of the compiled
+// schedule and the active class's roster in flash. Each copy is written
+// only when it changed and carries a CRC, so a torn write is ignored.
+class BootCache
+{
+public:
+  bool begin();
+
+  bool loadWiFi(WiFiCache &wifi);
+  void saveWiFi(const WiFiCache &wifi);
+
+  // Epoch seconds last saved, or 0
+  uint32_t lastTime();
+  void saveTime(uint32_t now);
+
+  // Self-tests run on the boot after requestSelfTest(); reading the request clears it
+  void requestSelfTest();
+  bool takeSelfTestRequest();
+
+  bool loadSchedule(fs::FS &fs, RoomClassList &classes, String &version);
+  void saveSchedule(fs::FS &fs, const RoomClassList &classes, const String &version);
+  bool loadRoster(fs::FS &fs, EnrollmentRoster &roster);
+  void saveRoster(fs::FS &fs, const EnrollmentRoster &roster);
+
+private:
+  Preferences prefs;
+  bool ready = false;
+  uint32_t scheduleCrc = 0; // of the copy in flash, to skip rewriting it
+  uint32_t rosterCrc = 0;
+};
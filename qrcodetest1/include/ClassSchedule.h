@@ -0,0 +1,293 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_ROOM_CLASSES 32
+#define MAX_DAY_SLOTS 24
+
+// This room's timetable compiled into one sorted interval list per weekday,
+// in minutes since midnight. Finding the active class is a binary search
+// over a handful of entries instead of a walk over the whole classes node.
+// Fixed-size storage: compiling never touches the heap.
+class ClassSchedule
+{
+public:
+  void clear()
+  {
+    classCount = 0;
+    memset(slotCount, 0, sizeof(slotCount));
+  }
+
+  // Returns the index to use with addSlot(), or -1 if the table is full or
+  // classId does not fit (a cut-off ID could match another class).
+  int addClass(const char *classId, const char *name)
+  {
+    if (classCount >= MAX_ROOM_CLASSES || classId == nullptr || strlen(classId) >= sizeof(classes[0].id))
+    {
+      return -1;
+    }
+    ClassInfo &info = classes[classCount];
+    copyString(info.id, classId, sizeof(info.id));
+    copyString(info.name, name, sizeof(info.name));
+    return classCount++;
+  }
+
+  // weekday follows tm_wday (0 = Sunday). Slots are kept sorted by start.
+  bool addSlot(int weekday, uint16_t start, uint16_t end, int classIndex)
+  {
+    if (weekday < 0 || weekday > 6 || classIndex < 0 || slotCount[weekday] >= MAX_DAY_SLOTS)
+    {
+      return false;
+    }
+    Slot *day = slots[weekday];
+    int i = slotCount[weekday]++;
+    while (i > 0 && day[i - 1].start > start)
+    {
+      day[i] = day[i - 1];
+      i--;
+    }
+    day[i].start = start;
+    day[i].end = end;
+    day[i].classIndex = (uint8_t)classIndex;
+    return true;
+  }
+
+  // Class index active at the given minute (start and end inclusive), or -1.
+  // If start is given it receives the minute the active slot began.
+  int findActive(int weekday, int minute, uint16_t *start = nullptr) const
+  {
+    if (weekday < 0 || weekday > 6)
+    {
+      return -1;
+    }
+    const Slot *day = slots[weekday];
+    int lo = 0;
+    int hi = slotCount[weekday] - 1;
+    int candidate = -1;
+    while (lo <= hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (day[mid].start <= minute)
+      {
+        candidate = mid;
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid - 1;
+      }
+    }
+    // Classes in a room do not overlap, but tolerate a short one nested in a
+    // longer one by also checking the slots just before the candidate.
+    for (int i = candidate; i >= 0; i--)
+    {
+      if (minute <= day[i].end)
+      {
+        if (start != nullptr)
+        {
+          *start = day[i].start;
+        }
+        return day[i].classIndex;
+      }
+    }
+    return -1;
+  }
+
+  // Minutes from the given minute until the next class starts, looking up
+  // to a week ahead, or -1 if the schedule is empty.
+  int minutesUntilStart(int weekday, int minute) const
+  {
+    if (weekday < 0 || weekday > 6)
+    {
+      return -1;
+    }
+    for (int ahead = 0; ahead <= 7; ahead++)
+    {
+      const Slot *day = slots[(weekday + ahead) % 7];
+      for (int i = 0; i < slotCount[(weekday + ahead) % 7]; i++)
+      {
+        int start = ahead * 24 * 60 + day[i].start;
+        if (start > minute)
+        {
+          return start - minute;
+        }
+      }
+    }
+    return -1;
+  }
+
+  // Minutes from the given minute until findActive() can next give another
+  // answer: the next slot start, or the minute after a slot ends. Looks up
+  // to a week ahead; -1 if the schedule is empty.
+  int minutesUntilChange(int weekday, int minute) const
+  {
+    if (weekday < 0 || weekday > 6)
+    {
+      return -1;
+    }
+    int nearest = -1;
+    for (int ahead = 0; ahead <= 7 && nearest < 0; ahead++)
+    {
+      const Slot *day = slots[(weekday + ahead) % 7];
+      for (int i = 0; i < slotCount[(weekday + ahead) % 7]; i++)
+      {
+        int dayStart = ahead * 24 * 60;
+        int boundaries[2] = {dayStart + day[i].start, dayStart + day[i].end + 1};
+        for (int boundary : boundaries)
+        {
+          if (boundary > minute && (nearest < 0 || boundary - minute < nearest))
+          {
+            nearest = boundary - minute;
+          }
+        }
+      }
+    }
+    return nearest;
+  }
+
+  const char *classId(int index) const { return classes[index].id; }
+  const char *className(int index) const { return classes[index].name; }
+  int size() const { return classCount; }
+
+  static int weekdayFromName(const char *day)
+  {
+    static const char *names[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
+    for (int i = 0; i < 7; i++)
+    {
+      if (strcmp(day, names[i]) == 0)
+      {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Parses the "HH:MM - HH:MM" format used by the admin page.
+  static bool parseTimeRange(const char *text, uint16_t &start, uint16_t &end)
+  {
+    int startHour, startMinute, endHour, endMinute;
+    if (text == nullptr || sscanf(text, "%d:%d - %d:%d", &startHour, &startMinute, &endHour, &endMinute) != 4)
+    {
+      return false;
+    }
+    start = (uint16_t)(startHour * 60 + startMinute);
+    end = (uint16_t)(endHour * 60 + endMinute);
+    return true;
+  }
+
+private:
+  struct ClassInfo
+  {
+    char id[32];
+    char name[48];
+  };
+  struct Slot
+  {
+    uint16_t start;
+    uint16_t end;
+    uint8_t classIndex;
+  };
+
+  static void copyString(char *dst, const char *src, size_t size)
+  {
+    strncpy(dst, src ? src : "", size - 1);
+    dst[size - 1] = '\0';
+  }
+
+  ClassInfo classes[MAX_ROOM_CLASSES];
+  Slot slots[7][MAX_DAY_SLOTS];
+  int classCount = 0;
+  int slotCount[7] = {0};
+};
+
+// Source record of one class in this room, as far as the schedule needs it.
+struct ClassRecord
+{
+  char id[32];
+  char name[48];
+  uint16_t start;
+  uint16_t end;
+  uint8_t days; // bit n set = meets on tm_wday n
+};
+
+// This room's classes by ID. Kept next to the compiled schedule so an edit
+// to a single class (e.g. from the event stream) can be applied and the
+// table recompiled without downloading classes.json again.
+class RoomClassList
+{
+public:
+  void clear() { count = 0; }
+
+  ClassRecord *find(const char *classId)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      if (strcmp(records[i].id, classId) == 0)
+      {
+        return &records[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Class IDs longer than ClassRecord::id holds are refused, not cut off:
+  // two long IDs sharing a prefix would otherwise become the same class.
+  static bool fits(const char *classId) { return strlen(classId) < sizeof(ClassRecord::id); }
+
+  // Returns the existing record for classId, or a fresh zeroed one.
+  // nullptr if the list is full or classId does not fit.
+  ClassRecord *upsert(const char *classId)
+  {
+    if (!fits(classId))
+    {
+      return nullptr;
+    }
+    ClassRecord *record = find(classId);
+    if (record != nullptr)
+    {
+      return record;
+    }
+    if (count >= MAX_ROOM_CLASSES)
+    {
+      return nullptr;
+    }
+    record = &records[count++];
+    memset(record, 0, sizeof(*record));
+    memcpy(record->id, classId, strlen(classId) + 1);
+    return record;
+  }
+
+  void remove(const char *classId)
+  {
+    ClassRecord *record = find(classId);
+    if (record != nullptr)
+    {
+      *record = records[--count];
+    }
+  }
+
+  void compile(ClassSchedule &out) const
+  {
+    out.clear();
+    for (int i = 0; i < count; i++)
+    {
+      int index = out.addClass(records[i].id, records[i].name);
+      for (int day = 0; day < 7; day++)
+      {
+        if (records[i].days & (1 << day))
+        {
+          out.addSlot(day, records[i].start, records[i].end, index);
+        }
+      }
+    }
+  }
+
+  int size() const { return count; }
+  const ClassRecord &record(int index) const { return records[index]; }
+
+private:
+  ClassRecord records[MAX_ROOM_CLASSES];
+  int count = 0;
+};
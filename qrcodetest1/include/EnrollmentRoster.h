@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// In-RAM set of the user IDs enrolled in one class.
+// IDs are stored as 64-bit FNV-1a hashes in an open-addressing table with
+// linear probing, so a 40-student roster costs about 1 KB and a lookup is
+// a hash plus one or two probes. Not thread-safe: build a fresh roster off
+// to the side and swap() it in under the caller's lock.
+class EnrollmentRoster
+{
+public:
+  EnrollmentRoster() {}
+  ~EnrollmentRoster() { free(slots); }
+
+  EnrollmentRoster(const EnrollmentRoster &) = delete;
+  EnrollmentRoster &operator=(const EnrollmentRoster &) = delete;
+
+  // Size the table for the expected number of IDs and mark it as the
+  // roster of classId. Returns false if the allocation fails.
+  bool reset(const char *forClassId, size_t expected)
+  {
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+    {
+      capacity <<= 1;
+    }
+    uint64_t *table = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (table == nullptr)
+    {
+      return false;
+    }
+    free(slots);
+    slots = table;
+    mask = capacity - 1;
+    count = 0;
+    strncpy(classId, forClassId, sizeof(classId) - 1);
+    classId[sizeof(classId) - 1] = '\0';
+    return true;
+  }
+
+  void add(const char *userId) { addHash(hashId(userId)); }
+
+  // Adds an ID by its hashId(), e.g. one read back from hashAt().
+  void addHash(uint64_t h)
+  {
+    if (slots == nullptr || count >= mask || h == 0)
+    {
+      return;
+    }
+    size_t i = h & mask;
+    while (slots[i] != 0)
+    {
+      if (slots[i] == h)
+      {
+        return;
+      }
+      i = (i + 1) & mask;
+    }
+    slots[i] = h;
+    count++;
+  }
+
+  bool contains(const char *userId) const
+  {
+    if (slots == nullptr)
+    {
+      return false;
+    }
+    uint64_t h = hashId(userId);
+    size_t i = h & mask;
+    while (slots[i] != 0)
+    {
+      if (slots[i] == h)
+      {
+        return true;
+      }
+      i = (i + 1) & mask;
+    }
+    return false;
+  }
+
+  bool isLoadedFor(const char *otherClassId) const
+  {
+    return slots != nullptr && strcmp(classId, otherClassId) == 0;
+  }
+
+  void clear()
+  {
+    free(slots);
+    slots = nullptr;
+    mask = 0;
+    count = 0;
+    classId[0] = '\0';
+  }
+
+  void swap(EnrollmentRoster &other)
+  {
+    uint64_t *s = slots;
+    slots = other.slots;
+    other.slots = s;
+    size_t m = mask;
+    mask = other.mask;
+    other.mask = m;
+    size_t c = count;
+    count = other.count;
+    other.count = c;
+    char id[sizeof(classId)];
+    memcpy(id, classId, sizeof(id));
+    memcpy(classId, other.classId, sizeof(classId));
+    memcpy(other.classId, id, sizeof(id));
+  }
+
+  size_t size() const { return count; }
+  const char *loadedClassId() const { return classId; }
+
+  // The raw table, for saving a copy: hashAt(i) for i < capacity() is an
+  // ID's hash, or 0 for an empty slot.
+  size_t capacity() const { return slots == nullptr ? 0 : mask + 1; }
+  uint64_t hashAt(size_t i) const { return slots[i]; }
+
+  static uint64_t hashId(const char *s)
+  {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s)
+    {
+      h ^= (uint8_t)*s++;
+      h *= 1099511628211ULL;
+    }
+    return h == 0 ? 1 : h; // 0 marks an empty slot
+  }
+
+private:
+  uint64_t *slots = nullptr;
+  size_t mask = 0;
+  size_t count = 0;
+  char classId[40] = "";
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include <mbedtls/md.h>
+#include "MemoryArena.h"
+
+#define GATEWAY_MAX_MESSAGE 256     // bytes of MessagePack per message sent
+#define GATEWAY_MAX_FRAME 32768     // longest message accepted from the gateway
+#define GATEWAY_MAC_BYTES 16        // truncated HMAC-SHA256 after each message
+
+// Messages on the gateway link. Each is a MessagePack map whose "t" field
+// is one of these; single-letter keys keep an event to a few dozen bytes.
+//
+// Both ends hold the same provisioned key. In the upgrade response the
+// gateway sends X-Gateway-Nonce, 16 random bytes in base64, and
+// X-Gateway-Proof, the hex HMAC-SHA256 of "gateway " + Sec-WebSocket-Key +
+// " " + nonce. Every binary frame is then the message followed by the first
+// GATEWAY_MAC_BYTES of the HMAC-SHA256 of: the sender ('s' scanner, 'g'
+// gateway), the Sec-WebSocket-Key, the nonce, the sender's count of
+// messages sent before this one (8 bytes, big-endian) and the message. A
+// message that fails the check, including a replayed one, drops the link.
+//
+//   GW_HELLO     scanner: r room, i/o scanner IDs for time-in/time-out,
+//                z UTC offset in seconds (log times are local)
+//   GW_EVENT     scanner: q journal sequence number, u user, c class,
+//                s epoch seconds, d ScanDirection, k log key (see ScanEvent::logKey),
+//                v 1 if s is from a clock NTP never confirmed
+//   GW_ACK       gateway: every event up to q is in Firebase
+//   GW_SCHEDULE  gateway: v classesMeta/version, c the room's classes as
+//                in classes.json; after GW_HELLO and whenever they change
+//   GW_WATCH     scanner: c class whose roster to follow
+//   GW_ROSTER    gateway: c class, m its classRosters entry (null if none);
+//                after GW_WATCH and whenever it changes
+enum GatewayMessageType : uint8_t
+{
+  GW_HELLO = 1,
+  GW_EVENT = 2,
+  GW_ACK = 3,
+  GW_SCHEDULE = 4,
+  GW_WATCH = 5,
+  GW_ROSTER = 6,
+};
+
+// Persistent WebSocket session to an on-prem edge gateway that syncs with
+// Firebase for every scanner in the building (tools/edge-gateway.js stands
+// in for one). Messages travel as MessagePack in binary frames, so an event
+// costs a few dozen bytes on a socket that is already open instead of a
+// pair of HTTPS requests. Driven from loop() like ScheduleStream: loop()
+// handles whatever frames have arrived without blocking, pings the gateway
+// while the session is quiet, and reconnects on its own when it drops.
+// Not thread-safe: use from the loop task only.
+class GatewayLink
+{
+public:
+  typedef void (*MessageHandler)(JsonDocument &message);
+
+  // keyHex is the key shared with the gateway, in hex. Incoming frames and
+  // their documents borrow blocks of arena. Returns false, and never
+  // connects, without a usable key.
+  bool begin(const char *host, uint16_t port, const char *keyHex, MessageHandler handler, MemoryArena &arena);
+  void loop();
+  bool connected() const { return open; }
+  // True once after each successful connect, so the caller can say hello.
+  bool takeConnected();
+  // Sends message as one frame. Returns false if the session is down or
+  // the message does not fit in GATEWAY_MAX_MESSAGE.
+  bool send(const JsonDocument &message);
+  void stop();
+
+private:
+  bool connect();
+  bool readFrame();
+  bool sendFrame(uint8_t opcode, size_t length);
+  void sign(char sender, uint64_t count, const uint8_t *message, size_t length, uint8_t *mac);
+
+  const char *host = "";
+  uint16_t port = 0;
+  MessageHandler handler = nullptr;
+  MemoryArena *arena = nullptr;
+  WiFiClient client;
+  bool open = false;
+  bool justConnected = false;
+  unsigned long lastActivity = 0; // last frame from the gateway
+  unsigned long lastPing = 0;
+  unsigned long lastAttempt = 0;
+  bool attempted = false;
+  mbedtls_md_context_t hmac;
+  bool keyed = false;
+  char wsKey[25];     // this session's Sec-WebSocket-Key
+  char nonce[25];     // and the gateway's nonce
+  uint64_t sent = 0;  // messages sent this session
+  uint64_t heard = 0; // and received
+  // Outgoing frame: room for the longest client frame header, then the
+  // payload and its MAC
+  uint8_t frame[8 + GATEWAY_MAX_MESSAGE + GATEWAY_MAC_BYTES];
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+// Memory headroom over the uptime, for the trace dump. The SDK keeps the
+// lowest free heap since boot, but not how small the largest free block
+// got, which is what decides whether a TLS handshake or a document still
+// fits; sample() tracks that, and should be called where memory is
+// tightest, e.g. after network work. Warns once each time the largest
+// block drops below the warning level. Safe from any task.
+class HeapMonitor
+{
+public:
+  // warnBelow: largest free block (bytes) under which to warn
+  void begin(uint32_t warnBelow);
+  void sample();
+
+  // Writes the heap and PSRAM watermarks as plain text.
+  void dump(Print &out);
+
+private:
+  uint32_t warnBelow = 0;
+  uint32_t lowestLargestBlock = UINT32_MAX;
+  bool low = false;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Serial logging with the verbosity fixed at build time. A call above
+// LOG_LEVEL compiles to nothing, message building included, so a quiet
+// build spends no time on String concatenation or on the 115200 baud line.
+// Pick the level with a build flag, e.g. -D LOG_LEVEL=LOG_LEVEL_WARN.
+//
+//   LOG_INFO("Roster loaded for " + classId);   // println()
+//   LOG_WARNF("HTTP error %d\n", httpCode);     // printf()
+//
+// The scan path logs with the F forms only: they format on the stack,
+// where String concatenation and Print::printf() past 64 bytes go to the
+// heap.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1 // something failed and was given up on
+#define LOG_LEVEL_WARN 2  // something failed and will be retried or worked around
+#define LOG_LEVEL_INFO 3  // what a scan or a sync did
+#define LOG_LEVEL_DEBUG 4 // step-by-step detail
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, call) \
+  do                        \
+  {                         \
+    if (LOG_LEVEL >= (level)) \
+    {                       \
+      call;                 \
+    }                       \
+  } while (0)
+
+#define LOG_ERROR(message) LOG_AT(LOG_LEVEL_ERROR, Serial.println(message))
+#define LOG_WARN(message) LOG_AT(LOG_LEVEL_WARN, Serial.println(message))
+#define LOG_INFO(message) LOG_AT(LOG_LEVEL_INFO, Serial.println(message))
+#define LOG_DEBUG(message) LOG_AT(LOG_LEVEL_DEBUG, Serial.println(message))
+
+#define LOG_ERRORF(...) LOG_AT(LOG_LEVEL_ERROR, logPrintf(__VA_ARGS__))
+#define LOG_WARNF(...) LOG_AT(LOG_LEVEL_WARN, logPrintf(__VA_ARGS__))
+#define LOG_INFOF(...) LOG_AT(LOG_LEVEL_INFO, logPrintf(__VA_ARGS__))
+#define LOG_DEBUGF(...) LOG_AT(LOG_LEVEL_DEBUG, logPrintf(__VA_ARGS__))
+
+#define LOG_LINE_MAX 160 // longer lines are cut short
+
+inline void logPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+inline void logPrintf(const char *format, ...)
+{
+  char line[LOG_LINE_MAX];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0)
+  {
+    return;
+  }
+  if ((size_t)length >= sizeof(line))
+  {
+    length = sizeof(line) - 1;
+    line[length - 1] = '\n';
+  }
+  Serial.write((const uint8_t *)line, length);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+
+#define MEMORY_ARENA_MAX_BLOCKS 32
+
+// A pool of equal blocks taken once at boot, from PSRAM when the board has
+// it, that large short-lived buffers borrow instead of going to the heap on
+// every use, so the heap does not fragment around the buffers mbedTLS holds
+// over a long uptime. A request larger than a block, or made while every
+// block is lent out, falls back to malloc and is counted; together with the
+// most bytes a borrower used, that says in dump() whether the blocks are
+// sized right. Safe from any task.
+class MemoryArena
+{
+public:
+  explicit MemoryArena(const char *name) : name(name) {}
+
+  // Takes blocks blocks of blockSize bytes from PSRAM, or from internal RAM
+  // when there is none and internalFallback is set. Returns false if the
+  // arena stays empty, leaving allocate() to plain malloc.
+  bool begin(size_t blockSize, size_t blocks, bool internalFallback);
+
+  void *allocate(size_t size);
+  void deallocate(void *pointer);
+  void *reallocate(void *pointer, size_t size);
+
+  // What to ask for to get size bytes: a whole block when size fits in one,
+  // so the borrower may grow into all of it.
+  size_t capacityFor(size_t size) const;
+  // Records how many bytes a borrower ended up using.
+  void recordUse(size_t bytes);
+
+  // Writes one line for the "# arenas" section of the trace dump:
+  // name location block_bytes blocks in_use most_in_use peak_bytes fallbacks
+  void dump(Print &out);
+
+private:
+  bool owns(const void *pointer) const;
+
+  const char *name;
+  uint8_t *base = nullptr;
+  size_t blockSize = 0;
+  size_t blocks = 0;
+  bool inPsram = false;
+  uint32_t lent = 0; // bit i set while block i is out
+  uint32_t mostInUse = 0;
+  size_t peakBytes = 0;
+  uint32_t fallbacks = 0;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// ArduinoJson allocator that draws from a MemoryArena
+struct ArenaAllocator
+{
+  explicit ArenaAllocator(MemoryArena *arena = nullptr) : arena(arena) {}
+
+  void *allocate(size_t size) { return arena != nullptr ? arena->allocate(size) : malloc(size); }
+  void deallocate(void *pointer)
+  {
+    if (arena != nullptr)
+    {
+      arena->deallocate(pointer);
+    }
+    else
+    {
+      free(pointer);
+    }
+  }
+  void *reallocate(void *pointer, size_t size)
+  {
+    return arena != nullptr ? arena->reallocate(pointer, size) : realloc(pointer, size);
+  }
+
+  MemoryArena *arena;
+};
+
+// Drop-in for DynamicJsonDocument that borrows a block of arena. A document
+// that fits in a block gets all of it, so one that outgrows its estimate
+// still parses; its memory usage is recorded when it goes out of scope.
+class PooledJsonDocument : public BasicJsonDocument<ArenaAllocator>
+{
+public:
+  PooledJsonDocument(MemoryArena &arena, size_t capacity)
+      : BasicJsonDocument<ArenaAllocator>(arena.capacityFor(capacity), ArenaAllocator(&arena)), arena(arena)
+  {
+  }
+  ~PooledJsonDocument() { arena.recordUse(memoryUsage()); }
+
+private:
+  MemoryArena &arena;
+};
+
+// Has mbedTLS take every buffer of at least minimum bytes (its record
+// buffers) from arena. Call before the first TLS connection. Returns false
+// when this build's mbedTLS allocator cannot be replaced at run time.
+bool serveTlsBuffers(MemoryArena &arena, size_t minimum);
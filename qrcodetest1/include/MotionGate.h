@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Plain C++ (no Arduino types) so tools/motion-gate-eval.cpp can run it on
+// recorded frames on the host.
+
+#define MOTION_GRID_MAX_CELLS 1200 // 40 x 30 cells: QVGA at 8 px per cell
+
+struct MotionGateConfig
+{
+  uint8_t cellSize = 8;         // px per side of one downscaled cell
+  uint8_t cellThreshold = 12;   // luma change that marks a cell as changed
+  uint16_t minChangedCells = 6; // changed cells that count as motion
+  uint32_t holdOff = 3000;      // ms the gate stays open after the last motion or decode
+};
+
+// Decides whether a grayscale camera frame is worth a full QR decode.
+// Each frame is averaged down to a coarse grid and compared with the grid
+// of the previous frame. The mean brightness change is subtracted first, so
+// auto-exposure drifting over the whole picture is not mistaken for
+// someone stepping up to the scanner. The gate opens on motion and stays
+// open for holdOff afterwards; a successful decode also keeps it open, so a
+// student holding still with a pass in view is not cut off.
+class MotionGate
+{
+public:
+  void configure(const MotionGateConfig &config)
+  {
+    settings = config;
+    reset();
+  }
+
+  void reset()
+  {
+    haveReference = false;
+    active = false;
+    changedCells = 0;
+  }
+
+  // Feeds one frame; returns true if it should be decoded.
+  bool update(const uint8_t *frame, uint16_t width, uint16_t height, uint32_t now)
+  {
+    uint16_t columns = width / settings.cellSize;
+    uint16_t rows = height / settings.cellSize;
+    while ((uint32_t)columns * rows > MOTION_GRID_MAX_CELLS)
+    {
+      columns /= 2;
+      rows /= 2;
+    }
+    if (columns == 0 || rows == 0)
+    {
+      return true;
+    }
+    uint16_t cellWidth = width / columns;
+    uint16_t cellHeight = height / rows;
+
+    memset(sums, 0, sizeof(uint32_t) * columns * rows);
+    for (uint16_t y = 0; y < rows * cellHeight; y++)
+    {
+      const uint8_t *row = frame + (uint32_t)y * width;
+      uint32_t *cellRow = sums + (uint32_t)(y / cellHeight) * columns;
+      for (uint16_t column = 0; column < columns; column++)
+      {
+        uint32_t sum = 0;
+        for (uint16_t x = 0; x < cellWidth; x++)
+        {
+          sum += *row++;
+        }
+        cellRow[column] += sum;
+      }
+    }
+
+    const uint32_t cellCount = (uint32_t)columns * rows;
+    const uint32_t pixelsPerCell = (uint32_t)cellWidth * cellHeight;
+    int32_t currentTotal = 0;
+    int32_t referenceTotal = 0;
+    for (uint32_t i = 0; i < cellCount; i++)
+    {
+      current[i] = (uint8_t)(sums[i] / pixelsPerCell);
+      currentTotal += current[i];
+      referenceTotal += reference[i];
+    }
+
+    bool sameGrid = haveReference && columns == gridColumns && rows == gridRows;
+    changedCells = 0;
+    if (sameGrid)
+    {
+      int32_t drift = (currentTotal - referenceTotal) / (int32_t)cellCount;
+      for (uint32_t i = 0; i < cellCount; i++)
+      {
+        int32_t delta = (int32_t)current[i] - reference[i] - drift;
+        if (delta > settings.cellThreshold || -delta > settings.cellThreshold)
+        {
+          changedCells++;
+        }
+      }
+    }
+
+    memcpy(reference, current, cellCount);
+    gridColumns = columns;
+    gridRows = rows;
+
+    // No usable reference yet: decode rather than risk missing a scan
+    if (!sameGrid || changedCells >= settings.minChangedCells)
+    {
+      markActivity(now);
+    }
+    haveReference = true;
+    return isOpen(now);
+  }
+
+  // A code was decoded from the last frame; keep decoding while it is in view.
+  void notifyDecoded(uint32_t now) { markActivity(now); }
+
+  bool isOpen(uint32_t now) const { return active && now - lastActivity <= settings.holdOff; }
+  uint16_t lastChangedCells() const { return changedCells; }
+  const MotionGateConfig &config() const { return settings; }
+
+private:
+  void markActivity(uint32_t now)
+  {
+    active = true;
+    lastActivity = now;
+  }
+
+  MotionGateConfig settings;
+  uint32_t sums[MOTION_GRID_MAX_CELLS]; // kept off the task stack
+  uint8_t current[MOTION_GRID_MAX_CELLS];
+  uint8_t reference[MOTION_GRID_MAX_CELLS];
+  uint16_t gridColumns = 0;
+  uint16_t gridRows = 0;
+  uint16_t changedCells = 0;
+  bool haveReference = false;
+  bool active = false;
+  uint32_t lastActivity = 0;
+};
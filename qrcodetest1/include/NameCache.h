@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define NAME_CACHE_ENTRIES 48 // a full roster and then some
+#define NAME_CACHE_NAME_SIZE 48
+
+// Display names of recently seen users, filled from the class roster (its
+// values are names) and from logins/<user>/name lookups. Bounded: once
+// full, the least recently used name makes room. A name older than the
+// TTL counts as missing, so a renamed user shows the new name within it.
+// IDs are kept as 64-bit FNV-1a hashes; a collision only shows the wrong
+// name in a log line. Lookups scan every entry, which at this size costs
+// less than hashing twice. Not thread-safe: guard with the caller's lock.
+class NameCache
+{
+public:
+  explicit NameCache(uint32_t ttl) : ttl(ttl) { clear(); }
+
+  // Copies the name of userId into name if it is cached and fresh.
+  bool get(const char *userId, uint32_t now, char *name, size_t nameSize)
+  {
+    Entry *entry = find(hashId(userId));
+    if (entry == nullptr || now - entry->storedAt >= ttl)
+    {
+      return false;
+    }
+    entry->lastUsed = ++useClock;
+    strncpy(name, entry->name, nameSize - 1);
+    name[nameSize - 1] = '\0';
+    return true;
+  }
+
+  void put(const char *userId, const char *name, uint32_t now)
+  {
+    uint64_t h = hashId(userId);
+    Entry *entry = find(h);
+    if (entry == nullptr)
+    {
+      entry = &entries[0];
+      for (Entry &candidate : entries)
+      {
+        if (candidate.idHash == 0)
+        {
+          entry = &candidate;
+          break;
+        }
+        if (candidate.lastUsed < entry->lastUsed)
+        {
+          entry = &candidate;
+        }
+      }
+      entry->idHash = h;
+    }
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    entry->name[sizeof(entry->name) - 1] = '\0';
+    entry->storedAt = now;
+    entry->lastUsed = ++useClock;
+  }
+
+  void clear()
+  {
+    memset(entries, 0, sizeof(entries));
+    useClock = 0;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t idHash; // 0 while unused
+    uint32_t storedAt;
+    uint32_t lastUsed;
+    char name[NAME_CACHE_NAME_SIZE];
+  };
+
+  Entry *find(uint64_t h)
+  {
+    for (Entry &entry : entries)
+    {
+      if (entry.idHash == h)
+      {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  static uint64_t hashId(const char *s)
+  {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s)
+    {
+      h ^= (uint8_t)*s++;
+      h *= 1099511628211ULL;
+    }
+    return h == 0 ? 1 : h; // 0 marks an unused entry
+  }
+
+  Entry entries[NAME_CACHE_ENTRIES];
+  uint32_t ttl; // ms
+  uint32_t useClock = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "ScanPipeline.h"
+
+#define OPEN_LOG_SLOTS 64 // a full class of time-ins and then some
+
+// The attendance logs this scanner has opened and not yet closed, by user
+// and class, so a time-out knows which log to close without reading the
+// user's attendance history. Kept in RAM and mirrored slot for slot into a
+// preallocated LittleFS file; each slot carries a CRC, so a slot torn by a
+// power cut is dropped on the next boot. When every slot is taken the
+// oldest log makes room, and its time-out falls back to a backend lookup.
+// Not thread-safe: use from the decision task only.
+class OpenLogIndex
+{
+public:
+  // maxAge: seconds after which an open log is no longer trusted, e.g.
+  // when a student left without scanning out.
+  bool begin(fs::FS &fs, const char *path, uint32_t maxAge);
+
+  // Copies the key of the log open for userId in classId into logKey.
+  bool find(const char *userId, const char *classId, uint32_t now, char *logKey, size_t logKeySize);
+
+  // Records that a time-in opened logKey at openedAt (epoch seconds),
+  // replacing any earlier log of the same user and class. IDs or keys too
+  // long for a slot are not recorded.
+  void opened(const char *userId, const char *classId, const char *logKey, uint32_t openedAt);
+
+  void closed(const char *userId, const char *classId);
+
+  size_t size();
+
+private:
+  struct Record
+  {
+    uint32_t magic;
+    char userId[USER_ID_SIZE];
+    char classId[32]; // ScanEvent::classId
+    char logKey[24];  // ScanEvent::logKey
+    uint32_t openedAt;
+    uint32_t crc;
+  };
+
+  int indexOf(const char *userId, const char *classId);
+  void write(size_t slot);
+  static uint32_t recordCrc(const Record &record);
+
+  Record slots[OPEN_LOG_SLOTS];
+  fs::File file;
+  uint32_t maxAge = 0;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Low-power mode for the hours the room has no class: the CPU clock drops
+// and, if the camera is stopped, the chip light-sleeps whenever every task
+// is blocked, with WiFi kept associated so a wake is quick. Needs power management in the SDK
+// config (CONFIG_PM_ENABLE, CONFIG_FREERTOS_USE_TICKLESS_IDLE); without
+// it the mode is still tracked, only the clock is left alone.
+// Keeps the time spent in each mode and how long wakes took, for the
+// trace dump. Call from one task only.
+class PowerManager
+{
+public:
+  void begin();
+
+  // lightSleep: only with the camera stopped, since light sleep halts its DMA
+  void enterLowPower(bool lightSleep);
+  // requestedAt: esp_timer time the wake was asked for, to time the wake
+  void exitLowPower(int64_t requestedAt);
+  bool lowPower() const { return low; }
+
+  // Counts a pass through loop(), to show how rarely it runs
+  void countLoopWake() { loopWakes[low ? 1 : 0]++; }
+
+  // Writes the time in each mode and wake latencies as plain text, after
+  // the scan trace.
+  void dump(Print &out);
+
+private:
+  bool configure(bool lowPower, bool lightSleep);
+
+  bool low = false;
+  bool supported = false;
+  int64_t modeSince = 0;         // esp_timer us
+  uint64_t modeTime[2] = {0, 0}; // us spent active and in low power
+  uint32_t loopWakes[2] = {0, 0};
+  uint32_t wakes = 0;
+  uint32_t lastWake = 0; // us
+  uint32_t longestWake = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP32QRCodeReader.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "MotionGate.h"
+
+#define QR_SCANNER_QUEUE_LENGTH 4
+
+// When the frame holding a code came off the camera and how long quirc
+// took over it, in esp_timer microseconds.
+struct QrScanTiming
+{
+  int64_t capturedAt;
+  int64_t decodeStart;
+  int64_t decodeEnd;
+};
+
+// Replaces ESP32QRCodeReader's own decode task (reader.setup() still brings
+// up the camera). Every frame goes through a MotionGate first; quirc only
+// runs while something is moving in front of the scanner, and frames are
+// pulled at a slower rate while the gate is closed.
+class QrScanner
+{
+public:
+  bool begin(const MotionGateConfig &config, BaseType_t core);
+
+  // Same contract as ESP32QRCodeReader::receiveQrCode(), plus the timing
+  // of the frame the code came from if timing is given.
+  bool receiveQrCode(struct QRCodeData *codeData, long timeoutMs, QrScanTiming *timing = nullptr);
+
+  // Stops pulling frames until resume(); the task blocks in the meantime.
+  void pause() { paused = true; }
+  void resume();
+  bool isPaused() const { return paused; }
+
+  // While slowed, frames are pulled far less often as long as the motion
+  // gate is closed; movement in front of the scanner brings back the
+  // normal rate at once.
+  void setSlow(bool on) { slow = on; }
+
+  uint32_t framesSeen() const { return seen; }
+  uint32_t framesDecoded() const { return decoded; }
+
+private:
+  static void task(void *arg);
+  void run();
+
+  struct ScannedCode
+  {
+    struct QRCodeData data;
+    QrScanTiming timing;
+  };
+
+  MotionGate gate;
+  QueueHandle_t queue = nullptr;
+  TaskHandle_t taskHandle = nullptr;
+  volatile bool paused = false;
+  volatile bool slow = false;
+  ScannedCode result;
+  volatile uint32_t seen = 0;
+  volatile uint32_t decoded = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mbedtls/md.h>
+
+// Signed QR credential, issued by the issueQrToken cloud function:
+//
+//   IA1.<userId>.<notBefore>.<notAfter>.<classes>.<mac>
+//
+// notBefore and notAfter are Unix seconds. classes lists the class IDs the
+// holder was enrolled in when the token was issued, comma-separated, or is
+// "*" for every class. mac is HMAC-SHA256 over everything before it, cut to
+// 16 bytes and base64url-encoded without padding. Firebase keys cannot hold
+// '.', so the fields split cleanly.
+
+#define QR_TOKEN_PREFIX "IA1."
+#define QR_TOKEN_MAC_BYTES 16
+
+enum QrTokenStatus : uint8_t
+{
+  TOKEN_VALID,
+  TOKEN_NO_CLOCK,      // signature good, but the clock is not set to check the window
+  TOKEN_MALFORMED,
+  TOKEN_BAD_SIGNATURE, // or no key to check it with
+  TOKEN_NOT_YET_VALID,
+  TOKEN_EXPIRED,
+};
+
+// Verifies tokens against the shared key. The HMAC context is set up once
+// in begin(), so verify() makes no heap allocation and costs well under a
+// millisecond. Not thread-safe: verify from one task only.
+class QrTokenVerifier
+{
+public:
+  // keyHex is the shared secret as hex, the same as the functions config
+  // value qrtoken.key. Returns false, and verify() rejects every token, if
+  // it is empty or not hex.
+  bool begin(const char *keyHex);
+
+  static bool isToken(const char *payload);
+
+  // Checks the signature, then the validity window against now (Unix
+  // seconds; 0 for a clock that cannot be trusted, which gives
+  // TOKEN_NO_CLOCK). On TOKEN_VALID and TOKEN_NO_CLOCK, copies the user ID
+  // and the class list out; both are cut short rather than overflow.
+  QrTokenStatus verify(const char *payload, uint32_t now, char *userId, size_t userIdSize, char *classes,
+                       size_t classesSize);
+
+  // True if a verified class list admits to classId.
+  static bool allowsClass(const char *classes, const char *classId);
+
+  static const char *statusName(QrTokenStatus status);
+
+private:
+  mbedtls_md_context_t hmac;
+  bool keyed = false;
+};
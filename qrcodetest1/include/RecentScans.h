@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ScanPipeline.h"
+
+#define RECENT_SCAN_ENTRIES 16     // users remembered at once
+#define RECENT_SCAN_BUCKETS 32     // hash buckets; a power of two
+#define RECENT_SCAN_WHEEL_SLOTS 16 // a power of two
+#define RECENT_SCAN_TICK_SHIFT 9   // wheel slots are 512 ms apart, so cooldowns up to ~7.5 s
+
+// The last door decision for a user, strongest last: a decision only gives
+// way to a stronger one, or to anything while it is still pending.
+enum RecentOutcome : uint8_t
+{
+  RECENT_PENDING, // waiting on a backend verdict
+  RECENT_NOTED,   // nothing to open, e.g. no open log or no active class
+  RECENT_REFUSED, // turned away
+  RECENT_OPENED,  // the door was opened
+};
+
+struct RecentDecision
+{
+  RecentOutcome outcome;
+  const char *message; // what the display showed; a string literal
+};
+
+// Door decisions of the last few seconds, so a student who presents the
+// same code again is answered without a roster lookup or a backend trip.
+// Users are found through a chained hash table on their ID; each entry
+// also hangs in the slot of a time wheel for the tick its cooldown ends in,
+// and turning the wheel frees whole slots at once. Every call is O(1)
+// apart from walking short chains, and nothing is allocated. When all
+// entries are taken the one closest to expiring makes room. Not
+// thread-safe: use from the decision task only.
+class RecentScans
+{
+public:
+  RecentScans() { clear(); }
+
+  // Finds the decision for userId if it was made while classId was active
+  // and its cooldown has not run out.
+  bool find(const char *userId, const char *classId, uint32_t now, RecentDecision &decision);
+
+  // Starts a fresh decision for a scan as pending, replacing any earlier
+  // one for the user. The cooldown runs from now.
+  void begin(const char *userId, const char *classId, uint32_t now, uint32_t cooldown);
+
+  // Records how the user's decision came out, from the scan itself or
+  // from a verdict, if it outranks what is recorded or that is still
+  // pending; the cooldown then restarts from now. Does nothing if the user
+  // has been forgotten meanwhile.
+  void settle(const char *userId, RecentOutcome outcome, const char *message, uint32_t now, uint32_t cooldown);
+
+  void clear();
+
+private:
+  struct Entry
+  {
+    char userId[USER_ID_SIZE];
+    char classId[32]; // active class when scanned
+    const char *message;
+    uint32_t expiresAt; // millis()
+    RecentOutcome outcome;
+    bool used;
+    int8_t nextInBucket;
+    int8_t prevInSlot;
+    int8_t nextInSlot;
+  };
+
+  static uint32_t hashId(const char *userId);
+  int8_t lookup(const char *userId);
+  void advance(uint32_t now);
+  void arm(int8_t index, uint32_t now, uint32_t cooldown);
+  void unlinkSlot(int8_t index);
+  void release(int8_t index);
+  int8_t allocate();
+
+  Entry entries[RECENT_SCAN_ENTRIES];
+  int8_t buckets[RECENT_SCAN_BUCKETS];
+  int8_t slots[RECENT_SCAN_WHEEL_SLOTS];
+  uint32_t wheelTick; // tick the wheel has been turned to
+  bool wheelStarted;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "ScanPipeline.h"
+
+enum ScanDirection : uint8_t
+{
+  SCAN_TIME_IN = 0,  // scan for the active class (time-in, or time-out if a log of the day is open)
+  SCAN_TIME_OUT = 1, // time-out for the previous class
+};
+
+// One scan as it must eventually reach the backend. Fixed size so it can be
+// written into a preallocated journal slot without touching the heap.
+struct ScanEvent
+{
+  char userId[USER_ID_SIZE];
+  char classId[32];
+  // Time-out: the open attendance log to close, if already known. Time-in:
+  // the key of the log it opens, <date>_<random>, so a retry can tell its
+  // own earlier write from another scan's.
+  char logKey[24];
+  char scannerId[24];
+  uint32_t timestamp; // epoch seconds at scan time
+  uint8_t direction;
+  // Set while the clock is still the one restored from NVS: timestamp is
+  // not trusted yet and is redone from uptime (millis() at scan) once NTP
+  // syncs, if that happens before bootId's boot ends. An event delivered
+  // before then carries the mark to the backend.
+  uint8_t clockUnverified;
+  uint32_t uptime;
+  uint32_t bootId;
+};
+
+// Append-only ring of scan events in a preallocated LittleFS file.
+// Every slot carries a sequence number and a CRC, so a record torn by a
+// power cut is detected and skipped on the next boot. The uploader peeks a
+// batch, sends it, then acks through the last event it sent; the ack point
+// is persisted separately so events survive reboots until the backend has
+// them. Between holdForClock() and restamp(), appended events are marked
+// clock unverified and held back from peekFrom(), so a scan stamped by a
+// stale clock does not reach the backend with the wrong time, unless
+// releaseHeld() gives up waiting and lets them go marked as they are.
+class ScanJournal
+{
+public:
+  bool begin(fs::FS &fs, const char *path, size_t capacity);
+
+  // Returns false only if the event could not be written to flash.
+  // When the ring is full the oldest unsent event is overwritten.
+  bool append(const ScanEvent &event);
+
+  size_t pending();
+
+  // Uploaders work by sequence number, so an event the ring overwrote while
+  // it was out is never acked in another's place: the oldest pending
+  // event's number, up to max pending events from from on (from the oldest
+  // if from is already gone) with their numbers, and an ack of every event
+  // up to and including seq.
+  uint32_t firstPending();
+  size_t peekFrom(uint32_t from, ScanEvent *out, uint32_t *seqs, size_t max);
+  void ackThrough(uint32_t seq);
+
+  // Marks events appended from now on as clock unverified; for a clock
+  // restored from NVS after a power cut.
+  void holdForClock();
+  // Once the clock is right: stamps every held event of this boot with
+  // now minus the time since its scan, and releases them.
+  void restamp(uint32_t now, uint32_t nowUptime);
+  // For a clock that never syncs: stops holding events back. They keep
+  // their clock unverified mark, and restamp() still corrects any not yet
+  // delivered if the clock syncs after all. Returns true the first time.
+  bool releaseHeld();
+
+private:
+  struct Record
+  {
+    uint32_t magic;
+    uint32_t seq;
+    ScanEvent event;
+    uint32_t crc;
+  };
+
+  bool readSlot(uint32_t seq, Record &record);
+  void saveAck();
+  bool writeSlot(Record &record);
+  bool heldBack(const Record &record) const;
+  static uint32_t recordCrc(const Record &record);
+
+  fs::FS *fs = nullptr;
+  fs::File file;
+  String ackPath;
+  size_t capacity = 0;
+  uint32_t head = 0; // sequence number of the next append
+  uint32_t tail = 0; // sequence number of the oldest unacked event
+  SemaphoreHandle_t lock = nullptr;
+  uint32_t bootId = 0;
+  bool holding = false;
+  bool released = false;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+// Messages passed between the three scan stages:
+//
+//   decodeTask  --scanQueue-->  decisionTask  --networkQueue-->  networkTask
+//                                    ^                                |
+//                                    +---------- verdicts ------------+
+//
+// The decode stage only reads the camera and hands user IDs on. The
+// decision stage owns the door, buzzer and display. The network stage
+// does every backend round trip and reports answers that a door
+// decision waits on back to the decision stage as verdicts.
+
+#define SCAN_QUEUE_LENGTH 8
+#define NETWORK_QUEUE_LENGTH 8
+// Every buffer holding a user ID, in these messages, the scan journal and
+// the open log index, is this size. A code whose ID does not fit is refused
+// at decode time; an ID is never cut short, as the shortened one would be
+// another user's path in the backend.
+#define USER_ID_SIZE 64
+
+enum DecisionMessageType : uint8_t
+{
+  MSG_SCAN,               // a freshly decoded QR code
+  MSG_ENROLLMENT_VERDICT, // answer to NET_VERIFY_ENROLLMENT
+  MSG_TIMEOUT_VERDICT,    // answer to NET_FIND_OPEN_LOG
+  MSG_BURST_ENTRY,        // from loop(): burst entry starts (VERDICT_YES) or ends
+};
+
+// What a scanned code proved about its holder
+enum Credential : uint8_t
+{
+  CREDENTIAL_USER_ID,      // plain hex user ID; needs the roster or the backend
+  CREDENTIAL_TOKEN,        // signed token, checked and within its validity window
+  CREDENTIAL_TOKEN_ID,     // signed token, but the clock is not set to check its window
+  CREDENTIAL_BAD_TOKEN,    // a token that failed verification
+};
+
+enum Verdict : uint8_t
+{
+  VERDICT_YES,
+  VERDICT_NO,
+  VERDICT_UNKNOWN, // offline or the request failed
+};
+
+struct DecisionMessage
+{
+  uint8_t type;
+  uint8_t verdict;
+  uint8_t credential; // scans: how the user ID was proved
+  char userId[USER_ID_SIZE];
+  char classId[32];
+  char classes[96];   // scans with CREDENTIAL_TOKEN: the classes it admits to
+  uint32_t capturedAt; // millis() when the code was decoded
+  uint32_t scanId;     // ScanTrace id of the scan this belongs to
+  uint64_t codeHash;   // scans: EnrollmentRoster::hashId() of the payload
+};
+
+enum NetworkJobType : uint8_t
+{
+  NET_VERIFY_ENROLLMENT, // roster could not answer; ask the backend
+  NET_FIND_OPEN_LOG,     // time-out for the previous class
+  NET_LOG_USER_NAME,     // resolve a display name for the serial log
+  NET_FLUSH_JOURNAL,     // new events in the scan journal
+};
+
+struct NetworkJob
+{
+  uint8_t type;
+  char userId[USER_ID_SIZE];
+  char classId[32];
+  uint32_t scanId; // ScanTrace id, 0 for jobs not raised by a scan
+};
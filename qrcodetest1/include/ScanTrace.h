@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+
+#define TRACE_RING_SIZE 128        // recent records kept in detail; a power of two
+#define TRACE_SCAN_SLOTS 16        // scans whose start time is remembered; a power of two
+#define TRACE_HISTOGRAM_BUCKETS 16 // bucket i holds times below 250 us << i, the last everything above
+
+// Stages of the scan path that are timed. All but TRACE_RELAY time one
+// piece of work; TRACE_RELAY runs from the frame that held the code coming
+// off the camera to the relay being driven for it.
+enum TraceStage : uint8_t
+{
+  TRACE_DECODE,           // quirc, for frames that held a code
+  TRACE_DECODE_HEX,       // payload to user ID
+  TRACE_TOKEN_VERIFY,     // signature and validity check of a signed code
+  TRACE_ENROLLMENT,       // roster lookup, or the backend check when it misses
+  TRACE_NAME_FETCH,       // display name from logins/<user>
+  TRACE_ATTENDANCE_WRITE, // journaled time-in reaching the backend
+  TRACE_TIMEOUT_UPDATE,   // open log lookup for a scan, and journaled time-outs
+  TRACE_RELAY,            // frame captured to door open
+  TRACE_STAGE_COUNT
+};
+
+// Where a scan's time goes. Each record is one stage's duration tagged
+// with the scan it belongs to (0 for work not tied to a scan, like journal
+// uploads). Records go into a ring of recent ones and into a histogram per
+// stage that covers everything since boot or reset(). Recording is
+// lock-free and safe from any task; dump() runs alongside it and skips
+// ring slots that are being overwritten.
+class ScanTrace
+{
+public:
+  // Numbers a new scan whose frame was captured at capturedAt (esp_timer us).
+  uint32_t beginScan(int64_t capturedAt);
+
+  void record(TraceStage stage, uint32_t scanId, int64_t start, int64_t end);
+  void record(TraceStage stage, uint32_t scanId, int64_t start) { record(stage, scanId, start, esp_timer_get_time()); }
+  // Records a stage that runs from the scan's capture until now.
+  void recordSinceCapture(TraceStage stage, uint32_t scanId);
+
+  // Writes the recent records and the histograms as plain text.
+  void dump(Print &out);
+  void reset();
+
+  static const char *stageName(TraceStage stage);
+
+private:
+  struct Record
+  {
+    std::atomic<uint32_t> sequence; // index + 1 once written, 0 while being written
+    uint32_t scanId;
+    uint32_t duration; // us
+    uint32_t at;       // millis() when recorded
+    uint8_t stage;
+  };
+
+  static size_t bucketFor(uint32_t duration);
+  static uint32_t bucketLimit(size_t bucket);
+  uint32_t percentile(TraceStage stage, uint32_t rank);
+
+  Record ring[TRACE_RING_SIZE] = {};
+  std::atomic<uint32_t> ringHead{0};
+
+  std::atomic<uint32_t> nextScan{1};
+  std::atomic<int64_t> scanStarts[TRACE_SCAN_SLOTS] = {};
+  std::atomic<uint32_t> scanIds[TRACE_SCAN_SLOTS] = {};
+
+  std::atomic<uint32_t> histogram[TRACE_STAGE_COUNT][TRACE_HISTOGRAM_BUCKETS] = {};
+  std::atomic<uint32_t> longest[TRACE_STAGE_COUNT] = {};
+};
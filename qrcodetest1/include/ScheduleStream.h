@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+// Holds a Firebase REST event stream (text/event-stream) open on one node
+// and hands each complete event to a callback. Driven from loop(): loop()
+// reads whatever has arrived without blocking, and reconnects on its own
+// when the stream drops or goes quiet. An event the callback could not
+// apply, or a line too long to hold, drops the stream, so that polling
+// takes over until the full resync on reconnect.
+class ScheduleStream
+{
+public:
+  // Returns false if the event could not be applied.
+  typedef bool (*EventHandler)(const String &event, const String &data);
+
+  void begin(const char *baseUrl, const String &path, EventHandler handler);
+  void loop();
+  bool connected() const { return streaming; }
+  void stop();
+
+private:
+  bool connect();
+  void processLine(const String &line);
+
+  String url;
+  EventHandler handler = nullptr;
+  WiFiClientSecure secureClient;
+  WiFiClient plainClient;
+  WiFiClient *client = &secureClient;
+  HTTPClient http;
+  bool streaming = false;
+  String line;
+  String eventName;
+  String eventData;
+  unsigned long lastActivity = 0;
+  unsigned long lastAttempt = 0;
+  bool attempted = false;
+};
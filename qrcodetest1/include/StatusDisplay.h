@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#define DISPLAY_LINES 4      // 128x32 at text size 1: one text line per SSD1306 page
+#define DISPLAY_LINE_CHARS 22 // 21 glyphs of 6 px fit in 128 px
+#define DISPLAY_QUEUE_LENGTH 8
+
+enum DisplayLine : uint8_t
+{
+  DISPLAY_LINE_ROOM = 0,
+  DISPLAY_LINE_CLOCK = 1,
+  DISPLAY_LINE_STATUS = 2,
+};
+
+// Owns the OLED once started. Other tasks post line updates through a
+// queue and return at once; the display task coalesces whatever has queued
+// up, redraws only the lines whose text changed, and pushes just those
+// pages over I2C. The clock line is kept current by the task itself.
+class StatusDisplay
+{
+public:
+  bool begin(Adafruit_SSD1306 &oled, uint8_t i2cAddress, const char *room, BaseType_t core);
+
+  // Non-blocking; returns false if the queue is full or the task is not running.
+  bool setLine(DisplayLine line, const char *text);
+  bool setLine(DisplayLine line, const String &text) { return setLine(line, text.c_str()); }
+
+private:
+  struct Update
+  {
+    uint8_t line;
+    char text[DISPLAY_LINE_CHARS];
+  };
+
+  static void task(void *arg);
+  void run();
+  void apply(const Update &update);
+  void updateClock();
+  void render();
+  void flushPage(uint8_t page);
+
+  Adafruit_SSD1306 *display = nullptr;
+  uint8_t address = 0x3C;
+  QueueHandle_t queue = nullptr;
+  char wanted[DISPLAY_LINES][DISPLAY_LINE_CHARS] = {};
+  char shown[DISPLAY_LINES][DISPLAY_LINE_CHARS] = {};
+  bool cleared = false;
+};
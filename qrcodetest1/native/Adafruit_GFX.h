@@ -0,0 +1,65 @@
+#pragma once
+
+// Minimal Adafruit_GFX: keeps a cursor and ignores drawing. Text is not
+// rasterised; the native build only cares about when and how much is sent.
+
+#include <Arduino.h>
+
+class Adafruit_GFX : public Print
+{
+public:
+  Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h) {}
+
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+  {
+    for (int16_t row = y; row < y + h; row++)
+    {
+      for (int16_t column = x; column < x + w; column++)
+      {
+        drawPixel(column, row, color);
+      }
+    }
+  }
+  void fillScreen(uint16_t color) { fillRect(0, 0, WIDTH, HEIGHT, color); }
+
+  void setCursor(int16_t x, int16_t y)
+  {
+    cursorX = x;
+    cursorY = y;
+  }
+  void setTextSize(uint8_t size) { textSize = size; }
+  void setTextColor(uint16_t color) { (void)color; }
+  void setTextColor(uint16_t color, uint16_t background)
+  {
+    (void)color;
+    (void)background;
+  }
+  void setTextWrap(bool wrap) { (void)wrap; }
+  void setRotation(uint8_t rotation) { (void)rotation; }
+
+  int16_t width() const { return WIDTH; }
+  int16_t height() const { return HEIGHT; }
+
+  size_t write(uint8_t c) override
+  {
+    if (c == '\n')
+    {
+      cursorX = 0;
+      cursorY += 8 * textSize;
+    }
+    else if (c != '\r')
+    {
+      cursorX += 6 * textSize;
+    }
+    return 1;
+  }
+  using Print::write;
+
+protected:
+  const int16_t WIDTH;
+  const int16_t HEIGHT;
+  int16_t cursorX = 0;
+  int16_t cursorY = 0;
+  uint8_t textSize = 1;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+// SSD1306 with a real frame buffer, sending to the simulated Wire bus the
+// same number of bytes the library would.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "Adafruit_GFX.h"
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_MEMORYMODE 0x20
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi = &Wire, int8_t resetPin = -1)
+      : Adafruit_GFX(w, h), wire(twi)
+  {
+    (void)resetPin;
+    buffer = new uint8_t[(size_t)w * ((h + 7) / 8)]();
+  }
+  ~Adafruit_SSD1306() { delete[] buffer; }
+
+  bool begin(uint8_t vccState = SSD1306_SWITCHCAPVCC, uint8_t address = 0, bool reset = true, bool periphBegin = true)
+  {
+    (void)vccState;
+    (void)address;
+    (void)reset;
+    (void)periphBegin;
+    return true;
+  }
+
+  void clearDisplay() { memset(buffer, 0, bufferSize()); }
+  void display() { wire->write(buffer, bufferSize()); }
+  void ssd1306_command(uint8_t c) { wire->write(c); }
+  uint8_t *getBuffer() { return buffer; }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override
+  {
+    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT)
+    {
+      return;
+    }
+    uint8_t &cell = buffer[x + (y / 8) * WIDTH];
+    uint8_t bit = 1 << (y & 7);
+    if (color == SSD1306_WHITE)
+      cell |= bit;
+    else if (color == SSD1306_BLACK)
+      cell &= ~bit;
+    else
+      cell ^= bit;
+  }
+
+private:
+  size_t bufferSize() const { return (size_t)WIDTH * ((HEIGHT + 7) / 8); }
+
+  TwoWire *wire;
+  uint8_t *buffer;
+};
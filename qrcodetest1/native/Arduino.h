@@ -0,0 +1,516 @@
+#pragma once
+
+// Host stand-in for the parts of the arduino-esp32 core the firmware uses,
+// so the scan/decision/backend logic builds and runs under `pio run -e native`.
+// Hardware is simulated in MockHal.cpp and can be driven through MockHal.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define DEC 10
+#define HEX 16
+#define F(string_literal) (string_literal)
+
+// --- String ---
+
+class StringSumHelper;
+
+class String
+{
+public:
+  String() {}
+  String(const char *text) : value(text ? text : "") {}
+  String(const char *text, size_t length) : value(text, length) {}
+  String(const String &other) = default;
+  String(String &&other) = default;
+  explicit String(char c) : value(1, c) {}
+  explicit String(unsigned char number, unsigned char base = 10) { fromUnsigned(number, base); }
+  explicit String(int number, unsigned char base = 10) { fromSigned(number, base); }
+  explicit String(unsigned int number, unsigned char base = 10) { fromUnsigned(number, base); }
+  explicit String(long number, unsigned char base = 10) { fromSigned(number, base); }
+  explicit String(unsigned long number, unsigned char base = 10) { fromUnsigned(number, base); }
+  explicit String(long long number, unsigned char base = 10) { fromSigned(number, base); }
+  explicit String(unsigned long long number, unsigned char base = 10) { fromUnsigned(number, base); }
+  explicit String(float number, unsigned int decimalPlaces = 2) : String((double)number, decimalPlaces) {}
+  explicit String(double number, unsigned int decimalPlaces = 2)
+  {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimalPlaces, number);
+    value = buffer;
+  }
+
+  String &operator=(const String &other) = default;
+  String &operator=(String &&other) = default;
+  String &operator=(const char *text)
+  {
+    value = text ? text : "";
+    return *this;
+  }
+
+  const char *c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+  bool isEmpty() const { return value.empty(); }
+  bool reserve(unsigned int size)
+  {
+    value.reserve(size);
+    return true;
+  }
+
+  bool concat(const String &other)
+  {
+    value += other.value;
+    return true;
+  }
+  bool concat(const char *text)
+  {
+    if (text == nullptr)
+    {
+      return false;
+    }
+    value += text;
+    return true;
+  }
+  bool concat(const char *text, unsigned int length)
+  {
+    value.append(text, length);
+    return true;
+  }
+  bool concat(char c)
+  {
+    value += c;
+    return true;
+  }
+  template <typename T, typename std::enable_if<std::is_arithmetic<T>::value, int>::type = 0>
+  bool concat(T number) { return concat(String(number)); }
+
+  String &operator+=(const String &other)
+  {
+    concat(other);
+    return *this;
+  }
+  String &operator+=(const char *text)
+  {
+    concat(text);
+    return *this;
+  }
+  String &operator+=(char c)
+  {
+    concat(c);
+    return *this;
+  }
+  template <typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+  String &operator+=(T number)
+  {
+    concat(String(number));
+    return *this;
+  }
+
+  char charAt(unsigned int index) const { return index < value.size() ? value[index] : 0; }
+  void setCharAt(unsigned int index, char c)
+  {
+    if (index < value.size())
+    {
+      value[index] = c;
+    }
+  }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index) { return value[index]; }
+
+  int compareTo(const String &other) const { return value.compare(other.value); }
+  bool equals(const String &other) const { return value == other.value; }
+  bool equals(const char *text) const { return value == (text ? text : ""); }
+  bool equalsIgnoreCase(const String &other) const
+  {
+    if (value.size() != other.value.size())
+    {
+      return false;
+    }
+    for (size_t i = 0; i < value.size(); i++)
+    {
+      if (tolower((unsigned char)value[i]) != tolower((unsigned char)other.value[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool startsWith(const String &prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+  bool startsWith(const String &prefix, unsigned int offset) const
+  {
+    return offset <= value.size() && value.compare(offset, prefix.value.size(), prefix.value) == 0;
+  }
+  bool endsWith(const String &suffix) const
+  {
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return found(value.find(c, from)); }
+  int indexOf(const String &text, unsigned int from = 0) const { return found(value.find(text.value, from)); }
+  int lastIndexOf(char c) const { return found(value.rfind(c)); }
+  int lastIndexOf(const String &text) const { return found(value.rfind(text.value)); }
+
+  String substring(unsigned int from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to)
+    {
+      std::swap(from, to);
+    }
+    if (from >= value.size())
+    {
+      return String();
+    }
+    return String(value.substr(from, to - from));
+  }
+
+  void replace(const String &find, const String &replacement)
+  {
+    if (find.value.empty())
+    {
+      return;
+    }
+    size_t at = 0;
+    while ((at = value.find(find.value, at)) != std::string::npos)
+    {
+      value.replace(at, find.value.size(), replacement.value);
+      at += replacement.value.size();
+    }
+  }
+  void replace(char find, char replacement) { std::replace(value.begin(), value.end(), find, replacement); }
+  void remove(unsigned int index)
+  {
+    if (index < value.size())
+    {
+      value.erase(index);
+    }
+  }
+  void remove(unsigned int index, unsigned int count)
+  {
+    if (index < value.size())
+    {
+      value.erase(index, count);
+    }
+  }
+  void toLowerCase() { std::transform(value.begin(), value.end(), value.begin(), ::tolower); }
+  void toUpperCase() { std::transform(value.begin(), value.end(), value.begin(), ::toupper); }
+  void trim()
+  {
+    size_t first = value.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+      value.clear();
+      return;
+    }
+    size_t last = value.find_last_not_of(" \t\r\n");
+    value = value.substr(first, last - first + 1);
+  }
+
+  long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(value.c_str(), nullptr); }
+  double toDouble() const { return strtod(value.c_str(), nullptr); }
+
+  void getBytes(unsigned char *buffer, unsigned int size, unsigned int index = 0) const
+  {
+    toCharArray((char *)buffer, size, index);
+  }
+  void toCharArray(char *buffer, unsigned int size, unsigned int index = 0) const
+  {
+    if (size == 0)
+    {
+      return;
+    }
+    size_t count = index < value.size() ? std::min<size_t>(size - 1, value.size() - index) : 0;
+    memcpy(buffer, value.data() + index, count);
+    buffer[count] = '\0';
+  }
+
+  bool operator==(const String &other) const { return value == other.value; }
+  bool operator==(const char *text) const { return equals(text); }
+  bool operator!=(const String &other) const { return value != other.value; }
+  bool operator!=(const char *text) const { return !equals(text); }
+  bool operator<(const String &other) const { return value < other.value; }
+
+private:
+  explicit String(const std::string &text) : value(text) {}
+  static int found(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+  void fromUnsigned(unsigned long long number, unsigned char base)
+  {
+    char buffer[66];
+    char *end = buffer + sizeof(buffer) - 1;
+    char *p = end;
+    *p = '\0';
+    if (base < 2)
+    {
+      base = 10;
+    }
+    do
+    {
+      unsigned digit = number % base;
+      *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+      number /= base;
+    } while (number > 0);
+    value = p;
+  }
+  void fromSigned(long long number, unsigned char base)
+  {
+    if (number < 0 && base == 10)
+    {
+      fromUnsigned((unsigned long long)(-number), base);
+      value.insert(value.begin(), '-');
+    }
+    else
+    {
+      // Like the Arduino core, other bases print the two's complement
+      fromUnsigned(base == 10 ? (unsigned long long)number : (unsigned long)number, base);
+    }
+  }
+
+  std::string value;
+};
+
+class StringSumHelper : public String
+{
+public:
+  StringSumHelper(const String &text) : String(text) {}
+  StringSumHelper(const char *text) : String(text) {}
+};
+
+inline StringSumHelper operator+(const String &left, const String &right)
+{
+  StringSumHelper sum(left);
+  sum.concat(right);
+  return sum;
+}
+inline StringSumHelper operator+(const String &left, const char *right)
+{
+  StringSumHelper sum(left);
+  sum.concat(right);
+  return sum;
+}
+inline StringSumHelper operator+(const char *left, const String &right)
+{
+  StringSumHelper sum(left);
+  sum.concat(right);
+  return sum;
+}
+inline StringSumHelper operator+(const String &left, char right)
+{
+  StringSumHelper sum(left);
+  sum.concat(right);
+  return sum;
+}
+template <typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+inline StringSumHelper operator+(const String &left, T right)
+{
+  StringSumHelper sum(left);
+  sum.concat(String(right));
+  return sum;
+}
+inline bool operator==(const char *left, const String &right) { return right == left; }
+inline bool operator!=(const char *left, const String &right) { return right != left; }
+
+// --- Print / Stream ---
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t written = 0;
+    while (size-- > 0 && write(*buffer++) == 1)
+    {
+      written++;
+    }
+    return written;
+  }
+  size_t write(const char *text) { return text ? write((const uint8_t *)text, strlen(text)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  virtual void flush() {}
+
+  // Like arduino-esp32: a 64-byte stack buffer, and a heap one past that
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buffer[64];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+      return 0;
+    }
+    if ((size_t)length < sizeof(buffer))
+    {
+      return write((const uint8_t *)buffer, length);
+    }
+    char *large = new char[length + 1];
+    va_start(args, format);
+    vsnprintf(large, length + 1, format, args);
+    va_end(args);
+    size_t written = write((const uint8_t *)large, length);
+    delete[] large;
+    return written;
+  }
+
+  size_t print(const String &text) { return write((const uint8_t *)text.c_str(), text.length()); }
+  size_t print(const char *text) { return write(text); }
+  size_t print(char c) { return write((uint8_t)c); }
+  template <typename T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+  size_t print(T number, int base = DEC) { return print(numberString(number, base)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &value)
+  {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(T number, int base)
+  {
+    size_t n = print(number, base);
+    return n + println();
+  }
+
+private:
+  template <typename T>
+  static String numberString(T number, int base)
+  {
+    return std::is_floating_point<T>::value ? String((double)number) : String(number, (unsigned char)base);
+  }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+  unsigned long getTimeout() const { return timeout; }
+
+  virtual size_t readBytes(char *buffer, size_t length)
+  {
+    size_t count = 0;
+    while (count < length)
+    {
+      int c = timedRead();
+      if (c < 0)
+      {
+        break;
+      }
+      buffer[count++] = (char)c;
+    }
+    return count;
+  }
+  size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+
+  String readString()
+  {
+    String text;
+    int c;
+    while ((c = timedRead()) >= 0)
+    {
+      text += (char)c;
+    }
+    return text;
+  }
+
+  String readStringUntil(char terminator)
+  {
+    String text;
+    int c;
+    while ((c = timedRead()) >= 0 && c != terminator)
+    {
+      text += (char)c;
+    }
+    return text;
+  }
+
+protected:
+  int timedRead();
+  unsigned long timeout = 1000;
+};
+
+// --- Serial ---
+
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+// --- Timing, GPIO, LEDC, time ---
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+uint32_t ledcSetup(uint8_t channel, uint32_t frequency, uint8_t resolutionBits);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+void ledcWrite(uint8_t channel, uint32_t duty);
+uint32_t ledcWriteTone(uint8_t channel, uint32_t frequency);
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2 = nullptr,
+                const char *server3 = nullptr);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+bool psramFound();
+void *ps_malloc(size_t size);
+
+// Heap figures of an ESP32-CAM after WiFi is up, and of its 4 MB PSRAM
+// with the camera's frame buffer taken
+class EspClass
+{
+public:
+  uint32_t getFreeHeap() { return 180000; }
+  uint32_t getMinFreeHeap() { return 150000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+  uint32_t getPsramSize() { return 4192139; }
+  uint32_t getFreePsram() { return 4114000; }
+  uint32_t getMinFreePsram() { return 4100000; }
+  uint32_t getMaxAllocPsram() { return 4063220; }
+};
+
+extern EspClass ESP;
@@ -0,0 +1,49 @@
+#pragma once
+
+// The part of ESP32QRCodeReader the firmware still uses: camera setup and
+// the QRCodeData result type. Decoding itself lives in QrScanner.
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+struct CameraPins
+{
+  int PWDN_GPIO_NUM;
+};
+
+#define CAMERA_MODEL_AI_THINKER CameraPins{32}
+
+enum QRCodeReaderSetupErr
+{
+  SETUP_OK,
+  SETUP_NO_PSRAM_ERROR,
+  SETUP_CAMERA_INIT_ERROR,
+};
+
+struct QRCodeData
+{
+  bool valid;
+  int dataType;
+  uint8_t payload[1024];
+  int payloadLen;
+};
+
+class ESP32QRCodeReader
+{
+public:
+  explicit ESP32QRCodeReader(CameraPins pins)
+  {
+    (void)pins;
+    cameraConfig.pixel_format = PIXFORMAT_GRAYSCALE;
+    cameraConfig.frame_size = FRAMESIZE_QVGA;
+    cameraConfig.jpeg_quality = 15;
+    cameraConfig.fb_count = 1;
+  }
+
+  QRCodeReaderSetupErr setup()
+  {
+    return esp_camera_init(&cameraConfig) == ESP_OK ? SETUP_OK : SETUP_CAMERA_INIT_ERROR;
+  }
+
+  camera_config_t cameraConfig = {};
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+// fs::FS over a host directory, for the scan journal and other flash files.
+
+#include <Arduino.h>
+
+namespace fs
+{
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2,
+};
+
+class File : public Stream
+{
+public:
+  File() {}
+  explicit File(FILE *handle) : file(handle) {}
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+  File(File &&other) noexcept : file(other.file) { other.file = nullptr; }
+  File &operator=(File &&other) noexcept
+  {
+    if (this != &other)
+    {
+      close();
+      file = other.file;
+      other.file = nullptr;
+    }
+    return *this;
+  }
+  ~File() { close(); }
+
+  operator bool() const { return file != nullptr; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override { return file ? fwrite(buffer, 1, size, file) : 0; }
+  using Print::write;
+  size_t read(uint8_t *buffer, size_t size) { return file ? fread(buffer, 1, size, file) : 0; }
+  int read() override
+  {
+    if (!file)
+    {
+      return -1;
+    }
+    int c = fgetc(file);
+    return c == EOF ? -1 : c;
+  }
+  int peek() override
+  {
+    int c = read();
+    if (c >= 0)
+    {
+      ungetc(c, file);
+    }
+    return c;
+  }
+  int available() override { return file ? (int)(size() - position()) : 0; }
+  void flush() override
+  {
+    if (file)
+    {
+      fflush(file);
+    }
+  }
+  bool seek(uint32_t position, SeekMode mode = SeekSet)
+  {
+    return file && fseek(file, position, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+  }
+  size_t position() const { return file ? (size_t)ftell(file) : 0; }
+  size_t size() const
+  {
+    if (!file)
+    {
+      return 0;
+    }
+    long here = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long end = ftell(file);
+    fseek(file, here, SEEK_SET);
+    return (size_t)end;
+  }
+  void close()
+  {
+    if (file)
+    {
+      fclose(file);
+      file = nullptr;
+    }
+  }
+
+private:
+  FILE *file = nullptr;
+};
+
+class FS
+{
+public:
+  explicit FS(const char *root) : root(root) {}
+
+  File open(const char *path, const char *mode = "r");
+  File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+
+protected:
+  String hostPath(const char *path) const;
+  String root;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
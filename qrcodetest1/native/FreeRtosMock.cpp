@@ -0,0 +1,496 @@
+// FreeRTOS and esp_timer on std::thread for the native build.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "MockHal.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point bootTime = Clock::now();
+
+// Deadline for a blocking call; portMAX_DELAY waits forever.
+static bool waitUntil(std::condition_variable &condition, std::unique_lock<std::mutex> &guard, TickType_t ticks,
+                      const std::function<bool()> &ready)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    condition.wait(guard, ready);
+    return true;
+  }
+  return condition.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+}
+
+// --- Tasks ---
+
+struct NativeTask
+{
+  TaskFunction_t function;
+  void *parameter;
+  char name[16];
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notifications = 0;
+  std::atomic<uint32_t> allocations{0}; // operator new calls made by the task
+};
+
+static thread_local NativeTask *currentTask = nullptr;
+
+static std::mutex tasksMutex;
+static std::vector<NativeTask *> tasks;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  (void)stackDepth;
+  (void)priority;
+  (void)core;
+  NativeTask *task = new NativeTask();
+  task->function = function;
+  task->parameter = parameter;
+  snprintf(task->name, sizeof(task->name), "%s", name != nullptr ? name : "");
+  {
+    std::lock_guard<std::mutex> guard(tasksMutex);
+    tasks.push_back(task);
+  }
+  if (handle != nullptr)
+  {
+    *handle = task;
+  }
+  std::thread([task]() {
+    currentTask = task;
+    task->function(task->parameter);
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  // Only self-deletion is used: end the calling thread's work for good
+  if (task == nullptr || task == currentTask)
+  {
+    while (true)
+    {
+      std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - bootTime).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return currentTask;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+  (void)task;
+  return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  std::lock_guard<std::mutex> guard(task->mutex);
+  task->notifications++;
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+  NativeTask *task = currentTask;
+  if (task == nullptr)
+  {
+    vTaskDelay(ticks == portMAX_DELAY ? 0 : ticks);
+    return 0;
+  }
+  std::unique_lock<std::mutex> guard(task->mutex);
+  waitUntil(task->notified, guard, ticks, [task]() { return task->notifications > 0; });
+  uint32_t count = task->notifications;
+  if (count > 0)
+  {
+    task->notifications = clearOnExit ? 0 : count - 1;
+  }
+  return count;
+}
+
+// --- Heap allocations, counted per task ---
+
+uint32_t mockTaskAllocations(const char *name)
+{
+  std::lock_guard<std::mutex> guard(tasksMutex);
+  uint32_t total = 0;
+  for (NativeTask *task : tasks)
+  {
+    if (strcmp(task->name, name) == 0)
+    {
+      total += task->allocations.load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+void *operator new(size_t size)
+{
+  if (currentTask != nullptr)
+  {
+    currentTask->allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void *block = malloc(size > 0 ? size : 1);
+  if (block == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+// GCC does not see that these replace the library's operators and warns
+// about free() on memory from new.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *block) noexcept
+{
+  free(block);
+}
+
+void operator delete(void *block, size_t size) noexcept
+{
+  (void)size;
+  free(block);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// --- Queues ---
+
+// Storage is allocated once at creation, as FreeRTOS does, so sending and
+// receiving never touch the heap.
+struct NativeQueue
+{
+  size_t length;
+  size_t itemSize;
+  std::vector<uint8_t> storage; // length slots of itemSize bytes, used as a ring
+  size_t head = 0;              // slot of the oldest item
+  size_t count = 0;
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+
+  uint8_t *slot(size_t index) { return &storage[((head + index) % length) * itemSize]; }
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  NativeQueue *queue = new NativeQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  queue->storage.resize((size_t)length * itemSize);
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+  delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t queue, const void *item, TickType_t ticks, bool front)
+{
+  std::unique_lock<std::mutex> guard(queue->mutex);
+  if (!waitUntil(queue->notFull, guard, ticks, [queue]() { return queue->count < queue->length; }))
+  {
+    return pdFALSE;
+  }
+  if (front)
+  {
+    queue->head = (queue->head + queue->length - 1) % queue->length;
+    memcpy(queue->slot(0), item, queue->itemSize);
+  }
+  else
+  {
+    memcpy(queue->slot(queue->count), item, queue->itemSize);
+  }
+  queue->count++;
+  queue->notEmpty.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  return queueSend(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  return queueSend(queue, item, ticks, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+  std::lock_guard<std::mutex> guard(queue->mutex);
+  queue->count = 0;
+  memcpy(queue->slot(0), item, queue->itemSize);
+  queue->count = 1;
+  queue->notEmpty.notify_one();
+  return pdTRUE;
+}
+
+static BaseType_t queueReceive(QueueHandle_t queue, void *item, TickType_t ticks, bool remove)
+{
+  std::unique_lock<std::mutex> guard(queue->mutex);
+  if (!waitUntil(queue->notEmpty, guard, ticks, [queue]() { return queue->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  memcpy(item, queue->slot(0), queue->itemSize);
+  if (remove)
+  {
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->notFull.notify_one();
+  }
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  return queueReceive(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  return queueReceive(queue, item, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> guard(queue->mutex);
+  return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> guard(queue->mutex);
+  return queue->length - queue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  std::lock_guard<std::mutex> guard(queue->mutex);
+  queue->count = 0;
+  queue->notFull.notify_all();
+  return pdPASS;
+}
+
+// --- Semaphores (mutexes are counting semaphores of one) ---
+
+struct NativeSemaphore
+{
+  UBaseType_t count;
+  UBaseType_t maxCount;
+  std::mutex mutex;
+  std::condition_variable available;
+};
+
+static SemaphoreHandle_t createSemaphore(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+  NativeSemaphore *semaphore = new NativeSemaphore();
+  semaphore->count = initialCount;
+  semaphore->maxCount = maxCount;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return createSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+  return createSemaphore(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount)
+{
+  return createSemaphore(maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+  std::unique_lock<std::mutex> guard(semaphore->mutex);
+  if (!waitUntil(semaphore->available, guard, ticks, [semaphore]() { return semaphore->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  std::lock_guard<std::mutex> guard(semaphore->mutex);
+  if (semaphore->count >= semaphore->maxCount)
+  {
+    return pdFALSE;
+  }
+  semaphore->count++;
+  semaphore->available.notify_one();
+  return pdTRUE;
+}
+
+// --- esp_timer ---
+
+// Like esp_timer, timers live in a list and starting one allocates nothing.
+struct NativeTimer
+{
+  esp_timer_cb_t callback;
+  void *arg;
+  int64_t period = 0; // us, 0 for one-shot
+  int64_t due = 0;    // us, while armed
+  bool armed = false;
+};
+
+static std::mutex timerMutex;
+static std::condition_variable timerChanged;
+static std::vector<NativeTimer *> timers;
+static bool timerThreadStarted = false;
+
+int64_t esp_timer_get_time()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count();
+}
+
+static NativeTimer *nextTimer()
+{
+  NativeTimer *next = nullptr;
+  for (NativeTimer *timer : timers)
+  {
+    if (timer->armed && (next == nullptr || timer->due < next->due))
+    {
+      next = timer;
+    }
+  }
+  return next;
+}
+
+static void timerThread()
+{
+  std::unique_lock<std::mutex> guard(timerMutex);
+  while (true)
+  {
+    NativeTimer *timer = nextTimer();
+    if (timer == nullptr)
+    {
+      timerChanged.wait(guard);
+      continue;
+    }
+    int64_t now = esp_timer_get_time();
+    if (timer->due > now)
+    {
+      timerChanged.wait_for(guard, std::chrono::microseconds(timer->due - now));
+      continue;
+    }
+    if (timer->period > 0)
+    {
+      timer->due = now + timer->period;
+    }
+    else
+    {
+      timer->armed = false;
+    }
+    guard.unlock();
+    timer->callback(timer->arg);
+    guard.lock();
+  }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+  std::lock_guard<std::mutex> guard(timerMutex);
+  if (!timerThreadStarted)
+  {
+    std::thread(timerThread).detach();
+    timerThreadStarted = true;
+  }
+  NativeTimer *timer = new NativeTimer();
+  timer->callback = args->callback;
+  timer->arg = args->arg;
+  timers.push_back(timer);
+  *handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t timeoutUs, int64_t period)
+{
+  std::lock_guard<std::mutex> guard(timerMutex);
+  if (timer->armed)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = true;
+  timer->period = period;
+  timer->due = esp_timer_get_time() + (int64_t)timeoutUs;
+  timerChanged.notify_one();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+  return startTimer(timer, timeoutUs, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+  return startTimer(timer, periodUs, (int64_t)periodUs);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  std::lock_guard<std::mutex> guard(timerMutex);
+  if (!timer->armed)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+  esp_timer_stop(timer);
+  // It stays in the list, disarmed; leak the handle rather than race the
+  // dispatcher.
+  return ESP_OK;
+}
@@ -0,0 +1,441 @@
+// HTTPClient and WiFiClient over POSIX sockets for the native build.
+
+#include "HTTPClient.h"
+#include "MockHal.h"
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// --- WiFiClient ---
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  stop();
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    return 0;
+  }
+
+  struct addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *result = nullptr;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &result) != 0 || result == nullptr)
+  {
+    return 0;
+  }
+  int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  if (fd >= 0 && ::connect(fd, result->ai_addr, result->ai_addrlen) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0)
+  {
+    return 0;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  socketFd = fd;
+  bufferStart = bufferEnd = 0;
+  mockHal().connections++;
+  return 1;
+}
+
+WiFiClient &WiFiClient::operator=(WiFiClient &&other)
+{
+  if (this != &other)
+  {
+    stop();
+    socketFd = other.socketFd;
+    memcpy(buffer, other.buffer + other.bufferStart, other.bufferEnd - other.bufferStart);
+    bufferStart = 0;
+    bufferEnd = other.bufferEnd - other.bufferStart;
+    other.socketFd = -1;
+    other.bufferStart = other.bufferEnd = 0;
+  }
+  return *this;
+}
+
+void WiFiClient::stop()
+{
+  if (socketFd >= 0)
+  {
+    close(socketFd);
+    socketFd = -1;
+  }
+  bufferStart = bufferEnd = 0;
+}
+
+// Pulls whatever the socket has into the buffer. Returns false on EOF or error.
+bool WiFiClient::fill(bool wait)
+{
+  if (socketFd < 0)
+  {
+    return false;
+  }
+  if (bufferStart < bufferEnd)
+  {
+    return true;
+  }
+  ssize_t n = recv(socketFd, buffer, sizeof(buffer), wait ? 0 : MSG_DONTWAIT);
+  if (n > 0)
+  {
+    bufferStart = 0;
+    bufferEnd = n;
+    mockHal().bytesReceived += n;
+    return true;
+  }
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+  {
+    return false;
+  }
+  return true;
+}
+
+uint8_t WiFiClient::connected()
+{
+  if (socketFd < 0)
+  {
+    return 0;
+  }
+  if (bufferStart < bufferEnd)
+  {
+    return 1;
+  }
+  uint8_t probe;
+  ssize_t n = recv(socketFd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+  {
+    return 1;
+  }
+  return 0;
+}
+
+int WiFiClient::available()
+{
+  if (bufferStart == bufferEnd)
+  {
+    fill(false);
+  }
+  return bufferEnd - bufferStart;
+}
+
+int WiFiClient::read()
+{
+  if (available() == 0)
+  {
+    return -1;
+  }
+  return buffer[bufferStart++];
+}
+
+int WiFiClient::read(uint8_t *out, size_t size)
+{
+  int count = std::min<int>(available(), size);
+  if (count <= 0)
+  {
+    return -1;
+  }
+  memcpy(out, buffer + bufferStart, count);
+  bufferStart += count;
+  return count;
+}
+
+int WiFiClient::peek()
+{
+  return available() > 0 ? buffer[bufferStart] : -1;
+}
+
+size_t WiFiClient::write(const uint8_t *data, size_t size)
+{
+  if (socketFd < 0)
+  {
+    return 0;
+  }
+  size_t sent = 0;
+  while (sent < size)
+  {
+    ssize_t n = send(socketFd, data + sent, size - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      break;
+    }
+    sent += n;
+  }
+  mockHal().bytesSent += sent;
+  return sent;
+}
+
+// --- HTTPClient ---
+
+bool HTTPClient::begin(WiFiClient &connection, const String &url)
+{
+  client = &connection;
+  requestHeaders = "";
+  collected.clear();
+  size = -1;
+  chunked = false;
+
+  String rest = url;
+  int scheme = rest.indexOf("://");
+  port = 80;
+  if (scheme >= 0)
+  {
+    if (rest.substring(0, scheme) == "https")
+    {
+      port = 443;
+    }
+    rest = rest.substring(scheme + 3);
+  }
+  int slash = rest.indexOf('/');
+  String authority = slash >= 0 ? rest.substring(0, slash) : rest;
+  uri = slash >= 0 ? rest.substring(slash) : String("/");
+  int colon = authority.indexOf(':');
+  if (colon >= 0)
+  {
+    port = (uint16_t)authority.substring(colon + 1).toInt();
+    authority = authority.substring(0, colon);
+  }
+  host = authority;
+  return true;
+}
+
+void HTTPClient::end()
+{
+  if (client == nullptr)
+  {
+    return;
+  }
+  if (client->connected())
+  {
+    while (client->available() > 0)
+    {
+      client->read();
+    }
+    if (!(reuse && canReuse))
+    {
+      client->stop();
+    }
+  }
+  else
+  {
+    client->stop();
+  }
+}
+
+void HTTPClient::addHeader(const String &name, const String &value)
+{
+  requestHeaders += name + ": " + value + "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char *headerKeys[], size_t count)
+{
+  collected.clear();
+  for (size_t i = 0; i < count; i++)
+  {
+    collected.push_back({String(headerKeys[i]), String()});
+  }
+}
+
+String HTTPClient::header(const char *name)
+{
+  for (const Header &entry : collected)
+  {
+    if (entry.name.equalsIgnoreCase(name))
+    {
+      return entry.value;
+    }
+  }
+  return String();
+}
+
+int HTTPClient::sendRequest(const char *method, const String &payload)
+{
+  return sendRequest(method, (uint8_t *)payload.c_str(), payload.length());
+}
+
+int HTTPClient::sendRequest(const char *method, uint8_t *payload, size_t payloadSize)
+{
+  if (client == nullptr)
+  {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  if (!client->connected() && !client->connect(host.c_str(), port))
+  {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  mockHal().httpRequests++;
+
+  String request = String(method) + " " + uri + (http10 ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n");
+  request += "Host: " + host + ":" + String((unsigned)port) + "\r\n";
+  request += "User-Agent: ESP32HTTPClient\r\n";
+  request += reuse && !http10 ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  request += requestHeaders;
+  if (payloadSize > 0 || strcmp(method, "GET") != 0)
+  {
+    request += "Content-Length: " + String((unsigned)payloadSize) + "\r\n";
+  }
+  request += "\r\n";
+  requestHeaders = "";
+
+  if (client->write((const uint8_t *)request.c_str(), request.length()) != request.length())
+  {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (payloadSize > 0 && client->write(payload, payloadSize) != payloadSize)
+  {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  return readResponse();
+}
+
+int HTTPClient::readResponse()
+{
+  size = -1;
+  chunked = false;
+  canReuse = reuse && !http10;
+  for (Header &entry : collected)
+  {
+    entry.value = "";
+  }
+
+  unsigned long start = millis();
+  int code = 0;
+  while (true)
+  {
+    if (!client->connected())
+    {
+      return HTTPC_ERROR_CONNECTION_LOST;
+    }
+    if (client->available() == 0)
+    {
+      if (millis() - start > timeout)
+      {
+        return HTTPC_ERROR_READ_TIMEOUT;
+      }
+      delay(1);
+      continue;
+    }
+
+    client->setTimeout(timeout);
+    String line = client->readStringUntil('\n');
+    line.trim();
+    if (code == 0)
+    {
+      if (!line.startsWith("HTTP/1."))
+      {
+        return HTTPC_ERROR_NO_HTTP_SERVER;
+      }
+      code = line.substring(9, 12).toInt();
+      continue;
+    }
+    if (line.isEmpty())
+    {
+      break;
+    }
+    int colon = line.indexOf(':');
+    if (colon < 0)
+    {
+      continue;
+    }
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    if (name.equalsIgnoreCase("Content-Length"))
+    {
+      size = value.toInt();
+    }
+    else if (name.equalsIgnoreCase("Connection") && value.equalsIgnoreCase("close"))
+    {
+      canReuse = false;
+    }
+    else if (name.equalsIgnoreCase("Transfer-Encoding") && value.equalsIgnoreCase("chunked"))
+    {
+      chunked = true;
+    }
+    for (Header &entry : collected)
+    {
+      if (entry.name.equalsIgnoreCase(name))
+      {
+        entry.value = value;
+      }
+    }
+  }
+  return code;
+}
+
+String HTTPClient::getString()
+{
+  String body;
+  if (client == nullptr)
+  {
+    return body;
+  }
+  client->setTimeout(timeout);
+  if (chunked)
+  {
+    while (true)
+    {
+      String sizeLine = client->readStringUntil('\n');
+      long chunkSize = strtol(sizeLine.c_str(), nullptr, 16);
+      if (chunkSize <= 0)
+      {
+        client->readStringUntil('\n');
+        break;
+      }
+      std::vector<char> chunk(chunkSize);
+      size_t got = client->readBytes(chunk.data(), chunkSize);
+      body.concat(chunk.data(), got);
+      client->readStringUntil('\n');
+      if ((long)got < chunkSize)
+      {
+        break;
+      }
+    }
+  }
+  else if (size >= 0)
+  {
+    std::vector<char> data(size);
+    size_t got = client->readBytes(data.data(), size);
+    body.concat(data.data(), got);
+  }
+  else
+  {
+    body = client->readString();
+    canReuse = false;
+  }
+  return body;
+}
+
+String HTTPClient::errorToString(int error)
+{
+  switch (error)
+  {
+  case HTTPC_ERROR_CONNECTION_REFUSED:
+    return F("connection refused");
+  case HTTPC_ERROR_SEND_HEADER_FAILED:
+    return F("send header failed");
+  case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+    return F("send payload failed");
+  case HTTPC_ERROR_NOT_CONNECTED:
+    return F("not connected");
+  case HTTPC_ERROR_CONNECTION_LOST:
+    return F("connection lost");
+  case HTTPC_ERROR_NO_STREAM:
+    return F("no stream");
+  case HTTPC_ERROR_NO_HTTP_SERVER:
+    return F("no HTTP server");
+  case HTTPC_ERROR_READ_TIMEOUT:
+    return F("read Timeout");
+  default:
+    return String();
+  }
+}
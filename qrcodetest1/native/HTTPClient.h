@@ -0,0 +1,98 @@
+#pragma once
+
+// The subset of arduino-esp32's HTTPClient the firmware uses, with the same
+// connection behaviour: the response body is left on the socket until read,
+// and with setReuse(true) end() keeps a keep-alive connection open.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+typedef enum
+{
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_NO_CONTENT = 204,
+  HTTP_CODE_MOVED_PERMANENTLY = 301,
+  HTTP_CODE_FOUND = 302,
+  HTTP_CODE_TEMPORARY_REDIRECT = 307,
+  HTTP_CODE_NOT_MODIFIED = 304,
+  HTTP_CODE_BAD_REQUEST = 400,
+  HTTP_CODE_UNAUTHORIZED = 401,
+  HTTP_CODE_FORBIDDEN = 403,
+  HTTP_CODE_NOT_FOUND = 404,
+  HTTP_CODE_PRECONDITION_FAILED = 412,
+  HTTP_CODE_INTERNAL_SERVER_ERROR = 500,
+} t_http_codes;
+
+typedef enum
+{
+  HTTPC_DISABLE_FOLLOW_REDIRECTS,
+  HTTPC_STRICT_FOLLOW_REDIRECTS,
+  HTTPC_FORCE_FOLLOW_REDIRECTS,
+} followRedirects_t;
+
+class HTTPClient
+{
+public:
+  bool begin(WiFiClient &client, const String &url);
+  void end();
+
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  void useHTTP10(bool useHttp10) { http10 = useHttp10; }
+  void setFollowRedirects(followRedirects_t follow) { (void)follow; }
+  void setTimeout(uint16_t timeoutMs) { timeout = timeoutMs; }
+  void setConnectTimeout(int32_t timeoutMs) { (void)timeoutMs; }
+
+  void addHeader(const String &name, const String &value);
+  void collectHeaders(const char *headerKeys[], size_t count);
+  String header(const char *name);
+
+  int GET() { return sendRequest("GET", String()); }
+  int PATCH(const String &payload) { return sendRequest("PATCH", payload); }
+  int PUT(const String &payload) { return sendRequest("PUT", payload); }
+  int POST(const String &payload) { return sendRequest("POST", payload); }
+  int sendRequest(const char *method, const String &payload);
+  int sendRequest(const char *method, uint8_t *payload, size_t size);
+
+  int getSize() { return size; }
+  String getString();
+  WiFiClient &getStream() { return *client; }
+  WiFiClient *getStreamPtr() { return connected() ? client : nullptr; }
+  bool connected() { return client != nullptr && client->connected(); }
+
+  static String errorToString(int error);
+
+private:
+  struct Header
+  {
+    String name;
+    String value;
+  };
+
+  int readResponse();
+
+  WiFiClient *client = nullptr;
+  String host;
+  uint16_t port = 80;
+  String uri;
+  bool reuse = true;
+  bool http10 = false;
+  bool canReuse = false;
+  uint16_t timeout = 5000;
+  int size = -1;
+  bool chunked = false;
+  String requestHeaders;
+  std::vector<Header> collected;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+class IPAddress
+{
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  // In network order, like the ESP32 core's
+  explicit IPAddress(uint32_t address) { memcpy(octets, &address, sizeof(octets)); }
+  operator uint32_t() const
+  {
+    uint32_t address;
+    memcpy(&address, octets, sizeof(address));
+    return address;
+  }
+  uint8_t operator[](int index) const { return octets[index]; }
+  String toString() const
+  {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(text);
+  }
+
+private:
+  uint8_t octets[4] = {0, 0, 0, 0};
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <FS.h>
+
+class LittleFSFS : public fs::FS
+{
+public:
+  LittleFSFS();
+  // Uses $NATIVE_FS_DIR, or ./native_fs, as the flash partition.
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = "spiffs");
+  size_t totalBytes() { return 1536 * 1024; }
+  size_t usedBytes() { return 0; }
+};
+
+extern LittleFSFS LittleFS;
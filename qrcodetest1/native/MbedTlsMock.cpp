@@ -0,0 +1,191 @@
+// HMAC-SHA256 for the native build, behind mbedtls' md API (FIPS 180-4,
+// RFC 2104).
+
+#include "mbedtls/md.h"
+#include <string.h>
+
+struct mbedtls_md_info_t
+{
+  mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256Info = {MBEDTLS_MD_SHA256};
+
+static const uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t rotateRight(uint32_t value, int bits)
+{
+  return (value >> bits) | (value << (32 - bits));
+}
+
+static void shaStart(NativeSha256 &sha)
+{
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(sha.state, initial, sizeof(initial));
+  sha.length = 0;
+  sha.used = 0;
+}
+
+static void shaBlock(NativeSha256 &sha, const uint8_t *block)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+  {
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 |
+           block[i * 4 + 3];
+  }
+  for (int i = 16; i < 64; i++)
+  {
+    uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+  uint32_t v[8];
+  memcpy(v, sha.state, sizeof(v));
+  for (int i = 0; i < 64; i++)
+  {
+    uint32_t s1 = rotateRight(v[4], 6) ^ rotateRight(v[4], 11) ^ rotateRight(v[4], 25);
+    uint32_t choice = (v[4] & v[5]) ^ (~v[4] & v[6]);
+    uint32_t t1 = v[7] + s1 + choice + roundConstants[i] + w[i];
+    uint32_t s0 = rotateRight(v[0], 2) ^ rotateRight(v[0], 13) ^ rotateRight(v[0], 22);
+    uint32_t majority = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+    memmove(v + 1, v, 7 * sizeof(uint32_t));
+    v[4] += t1;
+    v[0] = t1 + s0 + majority;
+  }
+  for (int i = 0; i < 8; i++)
+  {
+    sha.state[i] += v[i];
+  }
+}
+
+static void shaUpdate(NativeSha256 &sha, const uint8_t *data, size_t length)
+{
+  sha.length += length;
+  while (length > 0)
+  {
+    size_t take = sizeof(sha.block) - sha.used;
+    if (take > length)
+    {
+      take = length;
+    }
+    memcpy(sha.block + sha.used, data, take);
+    sha.used += take;
+    data += take;
+    length -= take;
+    if (sha.used == sizeof(sha.block))
+    {
+      shaBlock(sha, sha.block);
+      sha.used = 0;
+    }
+  }
+}
+
+static void shaFinish(NativeSha256 &sha, uint8_t *digest)
+{
+  uint64_t bits = sha.length * 8;
+  uint8_t padding = 0x80;
+  shaUpdate(sha, &padding, 1);
+  padding = 0;
+  while (sha.used != 56)
+  {
+    shaUpdate(sha, &padding, 1);
+  }
+  uint8_t lengthBytes[8];
+  for (int i = 0; i < 8; i++)
+  {
+    lengthBytes[i] = (uint8_t)(bits >> (56 - i * 8));
+  }
+  shaUpdate(sha, lengthBytes, sizeof(lengthBytes));
+  for (int i = 0; i < 8; i++)
+  {
+    digest[i * 4] = (uint8_t)(sha.state[i] >> 24);
+    digest[i * 4 + 1] = (uint8_t)(sha.state[i] >> 16);
+    digest[i * 4 + 2] = (uint8_t)(sha.state[i] >> 8);
+    digest[i * 4 + 3] = (uint8_t)sha.state[i];
+  }
+}
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+  return type == MBEDTLS_MD_SHA256 ? &sha256Info : nullptr;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac)
+{
+  if (md_info == nullptr || hmac == 0)
+  {
+    return -1;
+  }
+  ctx->md_info = md_info;
+  return 0;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+  if (ctx->md_info == nullptr)
+  {
+    return -1;
+  }
+  uint8_t keyBlock[64] = {};
+  if (keylen > sizeof(keyBlock))
+  {
+    shaStart(ctx->sha);
+    shaUpdate(ctx->sha, key, keylen);
+    shaFinish(ctx->sha, keyBlock);
+  }
+  else
+  {
+    memcpy(keyBlock, key, keylen);
+  }
+  for (size_t i = 0; i < sizeof(keyBlock); i++)
+  {
+    ctx->innerPad[i] = keyBlock[i] ^ 0x36;
+    ctx->outerPad[i] = keyBlock[i] ^ 0x5c;
+  }
+  return mbedtls_md_hmac_reset(ctx);
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+  shaUpdate(ctx->sha, input, ilen);
+  return 0;
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+  uint8_t inner[32];
+  shaFinish(ctx->sha, inner);
+  shaStart(ctx->sha);
+  shaUpdate(ctx->sha, ctx->outerPad, sizeof(ctx->outerPad));
+  shaUpdate(ctx->sha, inner, sizeof(inner));
+  shaFinish(ctx->sha, output);
+  return 0;
+}
+
+int mbedtls_md_hmac_reset(mbedtls_md_context_t *ctx)
+{
+  shaStart(ctx->sha);
+  shaUpdate(ctx->sha, ctx->innerPad, sizeof(ctx->innerPad));
+  return 0;
+}
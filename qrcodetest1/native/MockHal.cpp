@@ -0,0 +1,421 @@
+// Simulated ESP32-CAM peripherals for the native build: serial console,
+// clock, GPIO, LEDC, camera, QR decoder, flash and the WiFi link.
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp32/rom/crc.h>
+#include "MockHal.h"
+#include "esp_camera.h"
+#include "esp_sntp.h"
+#include "quirc/quirc.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point bootTime = Clock::now();
+
+MockHal &mockHal()
+{
+  static MockHal hal;
+  return hal;
+}
+
+HardwareSerial Serial;
+TwoWire Wire;
+WiFiClass WiFi;
+LittleFSFS LittleFS;
+EspClass ESP;
+
+// --- Serial ---
+
+static std::mutex serialMutex;
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (mockHal().echoSerial)
+  {
+    std::lock_guard<std::mutex> guard(serialMutex);
+    fwrite(buffer, 1, size, stdout);
+    fflush(stdout);
+  }
+  return size;
+}
+
+int Stream::timedRead()
+{
+  unsigned long start = millis();
+  do
+  {
+    int c = read();
+    if (c >= 0)
+    {
+      return c;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  } while (millis() - start < timeout);
+  return -1;
+}
+
+// --- Timing ---
+
+unsigned long millis()
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+  std::this_thread::yield();
+}
+
+// --- GPIO and LEDC ---
+
+static uint8_t pinLevels[40];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin < sizeof(pinLevels))
+  {
+    pinLevels[pin] = value;
+  }
+  PinWriteHook hook = mockHal().pinWriteHook;
+  if (hook != nullptr)
+  {
+    hook(pin, value);
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+uint32_t ledcSetup(uint8_t channel, uint32_t frequency, uint8_t resolutionBits)
+{
+  (void)channel;
+  (void)resolutionBits;
+  return frequency;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+  (void)pin;
+  (void)channel;
+}
+
+void ledcDetachPin(uint8_t pin)
+{
+  (void)pin;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+  (void)channel;
+  (void)duty;
+}
+
+uint32_t ledcWriteTone(uint8_t channel, uint32_t frequency)
+{
+  (void)channel;
+  mockHal().tonesStarted++;
+  ToneHook hook = mockHal().toneHook;
+  if (hook != nullptr)
+  {
+    hook(frequency);
+  }
+  return frequency;
+}
+
+// --- Wall clock: the host's, in the zone configTime() asks for ---
+
+static sntp_sync_time_cb_t timeSyncCallback = nullptr;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+  timeSyncCallback = callback;
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2,
+                const char *server3)
+{
+  (void)server1;
+  (void)server2;
+  (void)server3;
+  // POSIX TZ offsets count west of UTC, so the sign flips
+  long offset = gmtOffsetSec + daylightOffsetSec;
+  char zone[32];
+  snprintf(zone, sizeof(zone), "UTC%+ld:%02ld", -offset / 3600, labs(offset % 3600) / 60);
+  setenv("TZ", zone, 1);
+  tzset();
+  if (timeSyncCallback != nullptr)
+  {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    timeSyncCallback(&now);
+  }
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms)
+{
+  (void)ms;
+  time_t now = time(nullptr);
+  localtime_r(&now, info);
+  return true;
+}
+
+bool psramFound()
+{
+  return true;
+}
+
+void *ps_malloc(size_t size)
+{
+  return malloc(size);
+}
+
+// --- WiFi ---
+
+wl_status_t WiFiClass::status()
+{
+  return mockHal().wifiUp ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+// --- Camera and QR decoder ---
+
+static std::mutex cameraMutex;
+static std::string codeInView;
+static uint32_t codeSerial = 0;        // changes each time a code is shown, so the patch moves
+static std::string lastFrameCode;      // what the most recent frame showed
+static camera_fb_t frameBuffer;
+static uint8_t *framePixels = nullptr;
+static Clock::time_point nextFrame;
+
+void mockShowCode(const char *payload)
+{
+  std::lock_guard<std::mutex> guard(cameraMutex);
+  codeInView = payload ? payload : "";
+  codeSerial++;
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+  (void)config;
+  frameBuffer.width = 320;
+  frameBuffer.height = 240;
+  frameBuffer.len = frameBuffer.width * frameBuffer.height;
+  frameBuffer.format = PIXFORMAT_GRAYSCALE;
+  framePixels = new uint8_t[frameBuffer.len];
+  frameBuffer.buf = framePixels;
+  nextFrame = Clock::now();
+  return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get()
+{
+  if (framePixels == nullptr)
+  {
+    return nullptr;
+  }
+  // The sensor streams at a fixed rate; a grab waits for the next frame
+  std::this_thread::sleep_until(nextFrame);
+  nextFrame = std::max(nextFrame + std::chrono::milliseconds(mockHal().frameInterval.load()), Clock::now());
+
+  std::lock_guard<std::mutex> guard(cameraMutex);
+  memset(framePixels, 110, frameBuffer.len);
+  if (!codeInView.empty())
+  {
+    // A high-contrast patch standing in for the printed code
+    size_t offset = (codeSerial % 8) * 8;
+    for (size_t y = 60; y < 180; y++)
+    {
+      for (size_t x = 100 + offset; x < 220 + offset; x++)
+      {
+        framePixels[y * frameBuffer.width + x] = ((x / 8 + y / 8 + codeSerial) & 1) ? 20 : 235;
+      }
+    }
+  }
+  lastFrameCode = codeInView;
+  mockHal().framesCaptured++;
+  return &frameBuffer;
+}
+
+void esp_camera_fb_return(camera_fb_t *frame)
+{
+  (void)frame;
+}
+
+struct quirc
+{
+  std::vector<uint8_t> image;
+  int width = 0;
+  int height = 0;
+  std::string code;
+};
+
+static thread_local std::string extractedCode;
+
+struct quirc *quirc_new(void)
+{
+  return new quirc();
+}
+
+void quirc_destroy(struct quirc *q)
+{
+  delete q;
+}
+
+int quirc_resize(struct quirc *q, int width, int height)
+{
+  q->width = width;
+  q->height = height;
+  q->image.assign((size_t)width * height, 0);
+  return 0;
+}
+
+uint8_t *quirc_begin(struct quirc *q, int *width, int *height)
+{
+  if (width != nullptr)
+  {
+    *width = q->width;
+  }
+  if (height != nullptr)
+  {
+    *height = q->height;
+  }
+  return q->image.data();
+}
+
+void quirc_end(struct quirc *q)
+{
+  std::lock_guard<std::mutex> guard(cameraMutex);
+  q->code = lastFrameCode;
+}
+
+int quirc_count(const struct quirc *q)
+{
+  return q->code.empty() ? 0 : 1;
+}
+
+void quirc_extract(const struct quirc *q, int index, struct quirc_code *code)
+{
+  memset(code, 0, sizeof(*code));
+  code->index = index;
+  extractedCode = q->code;
+}
+
+quirc_decode_error_t quirc_decode(const struct quirc_code *code, struct quirc_data *data)
+{
+  (void)code;
+  memset(data, 0, sizeof(*data));
+  data->data_type = QUIRC_DATA_TYPE_BYTE;
+  data->payload_len = std::min<int>(extractedCode.size(), QUIRC_MAX_PAYLOAD - 1);
+  memcpy(data->payload, extractedCode.data(), data->payload_len);
+  return QUIRC_SUCCESS;
+}
+
+// --- CRC ---
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length)
+{
+  crc = ~crc;
+  while (length-- > 0)
+  {
+    crc ^= *buffer++;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+// --- Flash ---
+
+namespace fs
+{
+
+String FS::hostPath(const char *path) const
+{
+  return root + (path[0] == '/' ? "" : "/") + path;
+}
+
+File FS::open(const char *path, const char *mode)
+{
+  std::string hostMode = mode;
+  if (hostMode.find('b') == std::string::npos)
+  {
+    hostMode += 'b';
+  }
+  return File(fopen(hostPath(path).c_str(), hostMode.c_str()));
+}
+
+bool FS::exists(const char *path)
+{
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to)
+{
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+} // namespace fs
+
+LittleFSFS::LittleFSFS() : fs::FS("native_fs")
+{
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel)
+{
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  const char *dir = getenv("NATIVE_FS_DIR");
+  if (dir != nullptr)
+  {
+    root = dir;
+  }
+  mkdir(root.c_str(), 0755);
+  struct stat info;
+  return stat(root.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
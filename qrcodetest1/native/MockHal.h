@@ -0,0 +1,43 @@
+#pragma once
+
+// Controls and counters of the simulated hardware, for bench/ and anything
+// else that drives the native build.
+
+#include <Arduino.h>
+#include <atomic>
+
+typedef void (*PinWriteHook)(uint8_t pin, uint8_t value);
+typedef void (*ToneHook)(uint32_t frequency);
+
+struct MockHal
+{
+  // Network
+  std::atomic<bool> wifiUp{true};
+  std::atomic<uint32_t> httpRequests{0};
+  std::atomic<uint32_t> connections{0};
+  std::atomic<uint64_t> bytesSent{0};
+  std::atomic<uint64_t> bytesReceived{0};
+
+  // GPIO: called on every digitalWrite(), from the writing thread
+  std::atomic<PinWriteHook> pinWriteHook{nullptr};
+
+  // Camera: frames are produced every frameInterval ms
+  std::atomic<uint32_t> frameInterval{40};
+  std::atomic<uint32_t> framesCaptured{0};
+
+  // Buzzer: the hook is called on every tone started, from the playing thread
+  std::atomic<uint32_t> tonesStarted{0};
+  std::atomic<ToneHook> toneHook{nullptr};
+
+  // Serial output is dropped unless this is set
+  std::atomic<bool> echoSerial{true};
+};
+
+MockHal &mockHal();
+
+// Puts a QR code with this payload in front of the camera, or takes it
+// away for nullptr. Frames captured from then on show it.
+void mockShowCode(const char *payload);
+
+// operator new calls made so far by the FreeRTOS tasks with this name.
+uint32_t mockTaskAllocations(const char *taskName);
@@ -0,0 +1,65 @@
+#pragma once
+
+// NVS on the host: kept in RAM for the life of the process, so every run
+// of the native build is a first boot.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences
+{
+public:
+  bool begin(const char *name, bool readOnly = false)
+  {
+    (void)readOnly;
+    space = name;
+    return true;
+  }
+  void end() {}
+
+  size_t putBytes(const char *key, const void *value, size_t length)
+  {
+    const uint8_t *bytes = (const uint8_t *)value;
+    store()[space + "/" + key].assign(bytes, bytes + length);
+    return length;
+  }
+  size_t getBytes(const char *key, void *buffer, size_t length)
+  {
+    auto entry = store().find(space + "/" + key);
+    if (entry == store().end() || entry->second.size() > length)
+    {
+      return 0;
+    }
+    memcpy(buffer, entry->second.data(), entry->second.size());
+    return entry->second.size();
+  }
+  size_t getBytesLength(const char *key)
+  {
+    auto entry = store().find(space + "/" + key);
+    return entry == store().end() ? 0 : entry->second.size();
+  }
+  size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0)
+  {
+    uint32_t value = defaultValue;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+  }
+  size_t putBool(const char *key, bool value) { return putBytes(key, &value, sizeof(value)); }
+  bool getBool(const char *key, bool defaultValue = false)
+  {
+    bool value = defaultValue;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+  }
+  bool remove(const char *key) { return store().erase(space + "/" + key) > 0; }
+
+private:
+  static std::map<std::string, std::vector<uint8_t>> &store()
+  {
+    static std::map<std::string, std::vector<uint8_t>> entries;
+    return entries;
+  }
+
+  std::string space;
+};
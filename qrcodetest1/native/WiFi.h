@@ -0,0 +1,123 @@
+#pragma once
+
+// WiFi on the host: the link is up unless a benchmark takes it down through
+// MockHal.h, and WiFiClient is a plain POSIX TCP socket.
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+typedef enum
+{
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+#define WIFI_STA 1
+
+class Client : public Stream
+{
+public:
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual int read(uint8_t *buffer, size_t size) = 0;
+  using Stream::read;
+};
+
+class WiFiClient : public Client
+{
+public:
+  WiFiClient() {}
+  // Takes over a connected socket, as WiFiServer::available() hands out.
+  explicit WiFiClient(int connectedFd) : socketFd(connectedFd) {}
+  ~WiFiClient() { stop(); }
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient &operator=(const WiFiClient &) = delete;
+  WiFiClient(WiFiClient &&other) { *this = std::move(other); }
+  WiFiClient &operator=(WiFiClient &&other);
+
+  int connect(const char *host, uint16_t port) override;
+  uint8_t connected() override;
+  void stop() override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  void setNoDelay(bool noDelay) { (void)noDelay; }
+  operator bool() { return connected(); }
+
+private:
+  bool fill(bool wait);
+
+  int socketFd = -1;
+  uint8_t buffer[1460];
+  size_t bufferStart = 0;
+  size_t bufferEnd = 0;
+};
+
+class WiFiClass
+{
+public:
+  wl_status_t status();
+  // Joining is instant: the link state is whatever MockHal says
+  wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0,
+                    const uint8_t *bssid = nullptr, bool connect = true)
+  {
+    (void)ssid;
+    (void)passphrase;
+    (void)channel;
+    (void)bssid;
+    (void)connect;
+    return status();
+  }
+  bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress())
+  {
+    (void)localIp;
+    (void)gateway;
+    (void)subnet;
+    (void)dns1;
+    return true;
+  }
+  String SSID() { return String("native"); }
+  uint8_t *BSSID()
+  {
+    static uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    return bssid;
+  }
+  int32_t channel() { return 6; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+  IPAddress dnsIP(uint8_t index = 0)
+  {
+    (void)index;
+    return IPAddress(127, 0, 0, 1);
+  }
+  int32_t RSSI() { return -40; }
+  bool mode(int mode)
+  {
+    (void)mode;
+    return true;
+  }
+  bool disconnect(bool wifiOff = false)
+  {
+    (void)wifiOff;
+    return true;
+  }
+  bool setSleep(bool enabled)
+  {
+    (void)enabled;
+    return true;
+  }
+};
+
+extern WiFiClass WiFi;
+
+#include <WiFiServer.h>
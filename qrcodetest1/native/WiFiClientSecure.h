@@ -0,0 +1,14 @@
+#pragma once
+
+// No TLS on the host: the native build talks plain HTTP to
+// tools/mock-firebase.js, so the secure client is an ordinary socket.
+
+#include <WiFi.h>
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+  void setInsecure() {}
+  void setCACert(const char *rootCA) { (void)rootCA; }
+  void setHandshakeTimeout(unsigned long seconds) { (void)seconds; }
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <WiFi.h>
+
+class WiFiMulti
+{
+public:
+  bool addAP(const char *ssid, const char *passphrase = nullptr)
+  {
+    (void)ssid;
+    (void)passphrase;
+    return true;
+  }
+  uint8_t run(uint32_t connectTimeout = 5000)
+  {
+    (void)connectTimeout;
+    return WiFi.status();
+  }
+};
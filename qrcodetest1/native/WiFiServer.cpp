@@ -0,0 +1,48 @@
+#include <WiFi.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void WiFiServer::begin()
+{
+  end();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 4) != 0)
+  {
+    fprintf(stderr, "native: cannot listen on port %u\n", (unsigned)port);
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  listenFd = fd;
+}
+
+void WiFiServer::end()
+{
+  if (listenFd >= 0)
+  {
+    close(listenFd);
+    listenFd = -1;
+  }
+}
+
+WiFiClient WiFiServer::available()
+{
+  if (listenFd < 0 || WiFi.status() != WL_CONNECTED)
+  {
+    return WiFiClient();
+  }
+  int fd = ::accept(listenFd, nullptr, nullptr);
+  return fd >= 0 ? WiFiClient(fd) : WiFiClient();
+}
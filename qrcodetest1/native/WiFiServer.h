@@ -0,0 +1,22 @@
+#pragma once
+
+// A listening TCP socket on the host. available() never blocks.
+
+#include <WiFi.h>
+
+class WiFiServer
+{
+public:
+  explicit WiFiServer(uint16_t port) : port(port) {}
+  ~WiFiServer() { end(); }
+  void begin();
+  void end();
+  // The next waiting connection, or an unconnected client.
+  WiFiClient available();
+  WiFiClient accept() { return available(); }
+  explicit operator bool() const { return listenFd >= 0; }
+
+private:
+  uint16_t port;
+  int listenFd = -1;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+// I2C bus that accepts every transfer. Bytes are counted so a benchmark can
+// see how much display traffic a scan causes.
+
+#include <Arduino.h>
+
+class TwoWire : public Stream
+{
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0)
+  {
+    (void)sda;
+    (void)scl;
+    (void)frequency;
+    return true;
+  }
+  void setClock(uint32_t frequency) { (void)frequency; }
+  void beginTransmission(uint8_t address) { (void)address; }
+  uint8_t endTransmission(bool sendStop = true)
+  {
+    (void)sendStop;
+    return 0;
+  }
+  uint8_t requestFrom(uint8_t address, uint8_t count)
+  {
+    (void)address;
+    (void)count;
+    return 0;
+  }
+
+  size_t write(uint8_t c) override
+  {
+    (void)c;
+    bytesWritten++;
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    (void)buffer;
+    bytesWritten += size;
+    return size;
+  }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  uint32_t bytesWritten = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Same result as the ESP32 ROM routine (zlib CRC-32 when crc starts at 0).
+uint32_t crc32_le(uint32_t crc, const uint8_t *buffer, uint32_t length);
@@ -0,0 +1,71 @@
+#pragma once
+
+// Simulated OV2640: grayscale QVGA frames at camera pace. A code "in view"
+// (see MockHal.h) shows as a patch in the frame and is what the stub quirc
+// decoder returns.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum
+{
+  PIXFORMAT_RGB565,
+  PIXFORMAT_YUV422,
+  PIXFORMAT_GRAYSCALE,
+  PIXFORMAT_JPEG,
+} pixformat_t;
+
+typedef enum
+{
+  FRAMESIZE_96X96,
+  FRAMESIZE_QQVGA,
+  FRAMESIZE_QCIF,
+  FRAMESIZE_HQVGA,
+  FRAMESIZE_240X240,
+  FRAMESIZE_QVGA,
+  FRAMESIZE_CIF,
+  FRAMESIZE_HVGA,
+  FRAMESIZE_VGA,
+  FRAMESIZE_SVGA,
+} framesize_t;
+
+typedef enum
+{
+  CAMERA_GRAB_WHEN_EMPTY,
+  CAMERA_GRAB_LATEST,
+} camera_grab_mode_t;
+
+typedef struct
+{
+  int pin_pwdn;
+  int pin_reset;
+  int pin_xclk;
+  int pin_sscb_sda;
+  int pin_sscb_scl;
+  int pin_d7, pin_d6, pin_d5, pin_d4, pin_d3, pin_d2, pin_d1, pin_d0;
+  int pin_vsync;
+  int pin_href;
+  int pin_pclk;
+  int xclk_freq_hz;
+  int ledc_timer;
+  int ledc_channel;
+  pixformat_t pixel_format;
+  framesize_t frame_size;
+  int jpeg_quality;
+  size_t fb_count;
+  camera_grab_mode_t grab_mode;
+} camera_config_t;
+
+typedef struct
+{
+  uint8_t *buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+} camera_fb_t;
+
+esp_err_t esp_camera_init(const camera_config_t *config);
+camera_fb_t *esp_camera_fb_get();
+void esp_camera_fb_return(camera_fb_t *frame);
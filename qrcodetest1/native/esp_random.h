@@ -0,0 +1,14 @@
+#pragma once
+
+// esp_random() on the host, from a seeded generator rather than the chip's
+// RF noise; good enough for WebSocket keys and masks. Seeded per run, so
+// attendance log keys differ between runs against the same mock backend.
+
+#include <stdint.h>
+#include <random>
+
+inline uint32_t esp_random()
+{
+  static thread_local std::mt19937 generator(std::random_device{}());
+  return (uint32_t)generator();
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// SNTP on the host: the host clock is always set, so configTime() reports
+// a sync straight away.
+
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
@@ -0,0 +1,31 @@
+#pragma once
+
+// esp_timer on the host: one dispatcher thread runs every callback, like the
+// esp_timer task on the chip.
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct NativeTimer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+  ESP_TIMER_TASK,
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+  esp_timer_cb_t callback;
+  void *arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char *name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time();
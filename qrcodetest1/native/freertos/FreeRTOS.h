@@ -0,0 +1,33 @@
+#pragma once
+
+// FreeRTOS subset on top of std::thread for the native build. One tick is
+// one millisecond; task priorities and core pinning are accepted and ignored.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Critical sections guard a few shared fields; a plain mutex is enough here.
+struct portMUX_TYPE
+{
+  std::mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
@@ -0,0 +1,40 @@
+#pragma once
+
+// The part of mbedtls' message digest API the firmware uses: HMAC-SHA256
+// with a context that is set up once and reset per message.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  MBEDTLS_MD_NONE = 0,
+  MBEDTLS_MD_SHA256 = 6,
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+struct NativeSha256
+{
+  uint32_t state[8];
+  uint64_t length; // bytes hashed so far
+  uint8_t block[64];
+  size_t used;
+};
+
+typedef struct
+{
+  const mbedtls_md_info_t *md_info;
+  NativeSha256 sha;
+  uint8_t innerPad[64];
+  uint8_t outerPad[64];
+} mbedtls_md_context_t;
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type);
+void mbedtls_md_init(mbedtls_md_context_t *ctx);
+void mbedtls_md_free(mbedtls_md_context_t *ctx);
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+int mbedtls_md_hmac_reset(mbedtls_md_context_t *ctx);
@@ -0,0 +1,7 @@
+#pragma once
+
+// mbedtls' platform layer on the host. The native build has no TLS, so
+// MBEDTLS_PLATFORM_MEMORY is left undefined and the firmware keeps the
+// allocator it would have found (see serveTlsBuffers()).
+
+#include <stddef.h>
@@ -0,0 +1,58 @@
+#pragma once
+
+// Stand-in for the quirc decoder bundled with ESP32QRCodeReader. It does
+// not look at pixels: a frame decodes to whatever code the simulated camera
+// had in view when the frame was taken (see MockHal.h).
+
+#include <stdint.h>
+
+#define QUIRC_MAX_PAYLOAD 8896
+
+struct quirc;
+
+struct quirc_point
+{
+  int x;
+  int y;
+};
+
+struct quirc_code
+{
+  struct quirc_point corners[4];
+  int size;
+  int index; // which code of the frame, for quirc_decode
+};
+
+struct quirc_data
+{
+  int version;
+  int ecc_level;
+  int mask;
+  int data_type;
+  uint8_t payload[QUIRC_MAX_PAYLOAD];
+  int payload_len;
+  uint32_t eci;
+};
+
+typedef enum
+{
+  QUIRC_SUCCESS = 0,
+  QUIRC_ERROR_INVALID_GRID_SIZE,
+  QUIRC_ERROR_INVALID_VERSION,
+  QUIRC_ERROR_FORMAT_ECC,
+  QUIRC_ERROR_DATA_ECC,
+  QUIRC_ERROR_UNKNOWN_DATA_TYPE,
+  QUIRC_ERROR_DATA_OVERFLOW,
+  QUIRC_ERROR_DATA_UNDERFLOW,
+} quirc_decode_error_t;
+
+#define QUIRC_DATA_TYPE_BYTE 4
+
+struct quirc *quirc_new(void);
+void quirc_destroy(struct quirc *q);
+int quirc_resize(struct quirc *q, int width, int height);
+uint8_t *quirc_begin(struct quirc *q, int *width, int *height);
+void quirc_end(struct quirc *q);
+int quirc_count(const struct quirc *q);
+void quirc_extract(const struct quirc *q, int index, struct quirc_code *code);
+quirc_decode_error_t quirc_decode(const struct quirc_code *code, struct quirc_data *data);
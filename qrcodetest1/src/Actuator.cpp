@@ -0,0 +1,177 @@
+#include "Actuator.h"
+#include "Log.h"
+
+bool Actuator::begin(uint8_t buzzer, uint8_t channel, uint8_t relay, uint8_t activeLevel)
+{
+  buzzerPin = buzzer;
+  buzzerChannel = channel;
+  relayPin = relay;
+  relayActiveLevel = activeLevel;
+
+  ledcSetup(buzzerChannel, 2000, 8);
+  ledcAttachPin(buzzerPin, buzzerChannel);
+  ledcWrite(buzzerChannel, 0);
+  pinMode(relayPin, OUTPUT);
+  writeRelay(false);
+
+  esp_timer_create_args_t toneArgs = {};
+  toneArgs.callback = &Actuator::onToneTimer;
+  toneArgs.arg = this;
+  toneArgs.name = "tone";
+  esp_timer_create_args_t relayArgs = {};
+  relayArgs.callback = &Actuator::onRelayTimer;
+  relayArgs.arg = this;
+  relayArgs.name = "relay";
+  if (esp_timer_create(&toneArgs, &toneTimer) != ESP_OK || esp_timer_create(&relayArgs, &relayTimer) != ESP_OK)
+  {
+    LOG_ERROR("Failed to create actuator timers");
+    return false;
+  }
+  return true;
+}
+
+bool Actuator::playTone(uint16_t frequency, uint16_t duration)
+{
+  ToneStep step = {frequency, duration};
+  return playSequence(&step, 1);
+}
+
+bool Actuator::playSequence(const ToneStep *sequence, size_t length)
+{
+  bool start = false;
+  portENTER_CRITICAL(&mux);
+  if (count + length > MAX_TONE_STEPS)
+  {
+    portEXIT_CRITICAL(&mux);
+    return false;
+  }
+  for (size_t i = 0; i < length; i++)
+  {
+    steps[(head + count) % MAX_TONE_STEPS] = sequence[i];
+    count++;
+  }
+  if (!playing)
+  {
+    playing = true;
+    start = true;
+  }
+  portEXIT_CRITICAL(&mux);
+
+  // Only the caller that found the buzzer idle starts it; after that the
+  // timer callback owns the sequence until the ring runs dry.
+  if (start)
+  {
+    nextTone();
+  }
+  return true;
+}
+
+void Actuator::nextTone()
+{
+  ToneStep step;
+  bool more = false;
+  portENTER_CRITICAL(&mux);
+  if (count > 0)
+  {
+    step = steps[head];
+    head = (head + 1) % MAX_TONE_STEPS;
+    count--;
+    more = true;
+  }
+  else
+  {
+    playing = false;
+  }
+  portEXIT_CRITICAL(&mux);
+
+  if (!more)
+  {
+    ledcWrite(buzzerChannel, 0);
+    return;
+  }
+  if (step.frequency > 0)
+  {
+    ledcWriteTone(buzzerChannel, step.frequency);
+  }
+  else
+  {
+    ledcWrite(buzzerChannel, 0);
+  }
+  esp_timer_start_once(toneTimer, (uint64_t)step.duration * 1000);
+}
+
+void Actuator::onToneTimer(void *arg)
+{
+  static_cast<Actuator *>(arg)->nextTone();
+}
+
+void Actuator::writeRelay(bool open)
+{
+  relayIsOpen = open;
+  digitalWrite(relayPin, open ? relayActiveLevel : !relayActiveLevel);
+}
+
+void Actuator::armRelay(uint32_t duration)
+{
+  esp_timer_stop(relayTimer);
+  esp_timer_start_once(relayTimer, (uint64_t)duration * 1000);
+}
+
+void Actuator::pulseRelay(uint32_t duration)
+{
+  int64_t closeAt = esp_timer_get_time() + (int64_t)duration * 1000;
+  bool arm = false;
+  portENTER_CRITICAL(&mux);
+  if (!relayHeld && closeAt > relayCloseAt)
+  {
+    relayCloseAt = closeAt;
+    arm = true;
+  }
+  portEXIT_CRITICAL(&mux);
+
+  writeRelay(true);
+  if (arm)
+  {
+    armRelay(duration);
+  }
+}
+
+void Actuator::holdRelay()
+{
+  portENTER_CRITICAL(&mux);
+  relayHeld = true;
+  portEXIT_CRITICAL(&mux);
+  esp_timer_stop(relayTimer);
+  writeRelay(true);
+}
+
+void Actuator::releaseRelay(uint32_t delay)
+{
+  portENTER_CRITICAL(&mux);
+  relayHeld = false;
+  relayCloseAt = esp_timer_get_time() + (int64_t)delay * 1000;
+  portEXIT_CRITICAL(&mux);
+
+  if (delay == 0)
+  {
+    esp_timer_stop(relayTimer);
+    writeRelay(false);
+  }
+  else
+  {
+    armRelay(delay);
+  }
+}
+
+void Actuator::onRelayTimer(void *arg)
+{
+  Actuator *self = static_cast<Actuator *>(arg);
+  portENTER_CRITICAL(&self->mux);
+  bool close = !self->relayHeld;
+  self->relayCloseAt = 0;
+  portEXIT_CRITICAL(&self->mux);
+  if (close)
+  {
+    self->writeRelay(false);
+  }
+}
@@ -0,0 +1,342 @@
+#include "BackendClient.h"
+#include "Log.h"
+
+// Body of one HTTP/1.1 response as a Stream, undoing chunked transfer
+// encoding and stopping at Content-Length, so a JSON parser can read it
+// directly and whatever it leaves can be drained for keep-alive.
+class BodyStream : public Stream
+{
+public:
+  BodyStream(Client &source, int contentLength, bool isChunked)
+      : client(source), chunked(isChunked), remaining(contentLength)
+  {
+    setTimeout(5000);
+    if (chunked)
+    {
+      remaining = 0;
+    }
+  }
+
+  int available() override
+  {
+    if (!ensureData())
+    {
+      return 0;
+    }
+    int n = client.available();
+    return remaining >= 0 && n > remaining ? remaining : n;
+  }
+
+  int read() override
+  {
+    if (!ensureData())
+    {
+      return -1;
+    }
+    int c = client.read();
+    if (c >= 0 && remaining > 0)
+    {
+      remaining--;
+    }
+    return c;
+  }
+
+  int peek() override
+  {
+    return ensureData() ? client.peek() : -1;
+  }
+
+  // Stream::readBytes() waits out the timeout for bytes that a finished
+  // body will never get, which ArduinoJson asks for when it reads past the
+  // end of a bare value such as a number to see where it stops.
+  size_t readBytes(char *buffer, size_t length) override
+  {
+    size_t count = 0;
+    while (count < length && ensureData())
+    {
+      int c = timedRead();
+      if (c < 0)
+      {
+        break;
+      }
+      buffer[count++] = (char)c;
+    }
+    return count;
+  }
+  using Stream::readBytes;
+
+  size_t write(uint8_t) override { return 0; }
+
+  // Reads and discards the rest of the body. Returns false if the end of
+  // the body could not be found, in which case the socket is unusable.
+  bool drain()
+  {
+    unsigned long start = millis();
+    while (!finished && millis() - start < 5000)
+    {
+      if (remaining < 0)
+      {
+        // No length and not chunked: the body ends when the server closes
+        if (!client.connected() && client.available() == 0)
+        {
+          return false;
+        }
+      }
+      if (read() < 0)
+      {
+        delay(1);
+      }
+    }
+    return finished;
+  }
+
+private:
+  // True if the current chunk (or the body) still has bytes to read.
+  bool ensureData()
+  {
+    if (finished)
+    {
+      return false;
+    }
+    if (remaining != 0)
+    {
+      return true;
+    }
+    if (!chunked)
+    {
+      finished = true;
+      return false;
+    }
+    // End of a chunk: skip its CRLF (not before the first chunk), then read the next size line
+    if (started)
+    {
+      client.readStringUntil('\n');
+    }
+    started = true;
+    String sizeLine = client.readStringUntil('\n');
+    remaining = (int)strtol(sizeLine.c_str(), nullptr, 16);
+    if (remaining == 0)
+    {
+      client.readStringUntil('\n'); // blank line after the last chunk
+      finished = true;
+      return false;
+    }
+    return true;
+  }
+
+  Client &client;
+  bool chunked;
+  int remaining; // bytes left in the body or current chunk; -1 = until close
+  bool started = false;
+  bool finished = false;
+};
+
+// Firebase closes keep-alive sockets that sit idle for a while. Rather than
+// write into a socket the server has already dropped, start over after this.
+// It has to outlast the minute between schedule checks, or every check pays
+// for a new TLS handshake; a socket the server drops sooner is caught by the
+// stale-connection retry in request().
+static const unsigned long idleTimeout = 90000;
+
+void BackendClient::begin(const char *url)
+{
+  baseUrl = url;
+  if (lock == nullptr)
+  {
+    lock = xSemaphoreCreateMutex();
+  }
+  secureClient.setInsecure();
+  client = (strncmp(url, "http://", 7) == 0) ? &plainClient : (WiFiClient *)&secureClient;
+  http.setReuse(true);
+}
+
+int BackendClient::get(const char *path, String &response)
+{
+  Response sink;
+  sink.text = &response;
+  return request("GET", path, "", sink);
+}
+
+int BackendClient::getJson(const char *path, JsonDocument &doc, const JsonDocument *filter,
+                           DeserializationError *error)
+{
+  Response sink;
+  sink.json = &doc;
+  sink.filter = filter;
+  int httpCode = request("GET", path, "", sink);
+  if (error != nullptr)
+  {
+    *error = sink.jsonError;
+  }
+  return httpCode;
+}
+
+int BackendClient::getJsonIfChanged(const char *path, String &etag, JsonDocument &doc, const JsonDocument *filter,
+                                    DeserializationError *error)
+{
+  String previous = etag;
+  Response sink;
+  sink.etag = &etag;
+  sink.json = &doc;
+  sink.filter = filter;
+  sink.skipIfEtag = previous.isEmpty() ? nullptr : &previous;
+  int httpCode = request("GET", path, "", sink);
+  if (error != nullptr)
+  {
+    *error = sink.jsonError;
+  }
+  // Not every server honours If-None-Match on reads; compare tags ourselves.
+  if (httpCode == HTTP_CODE_OK && !previous.isEmpty() && etag == previous)
+  {
+    return HTTP_CODE_NOT_MODIFIED;
+  }
+  return httpCode;
+}
+
+int BackendClient::put(const char *path, const char *body, String *response)
+{
+  Response sink;
+  sink.text = response;
+  return request("PUT", path, body, sink);
+}
+
+int BackendClient::post(const char *path, const char *body, String *response)
+{
+  Response sink;
+  sink.text = response;
+  return request("POST", path, body, sink);
+}
+
+int BackendClient::patch(const char *path, const char *body, String *response)
+{
+  Response sink;
+  sink.text = response;
+  return request("PATCH", path, body, sink);
+}
+
+void BackendClient::disconnect()
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  http.end();
+  client->stop();
+  xSemaphoreGive(lock);
+}
+
+int BackendClient::request(const char *method, const char *path, const char *body, Response &response)
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  if (client->connected() && millis() - lastUsed > idleTimeout)
+  {
+    client->stop();
+  }
+
+  url = baseUrl;
+  url += path;
+  bool reused = client->connected();
+  int httpCode = send(method, body, response);
+
+  // A kept-alive socket can be closed by the server between requests. Retry
+  // once on a fresh connection, but only where the request cannot have been
+  // applied yet (or is a read), so a POST is never duplicated.
+  bool safeToRetry = httpCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                     httpCode == HTTPC_ERROR_NOT_CONNECTED ||
+                     (httpCode == HTTPC_ERROR_CONNECTION_LOST && strcmp(method, "GET") == 0);
+  if (reused && safeToRetry)
+  {
+    LOG_WARN("Backend connection went stale, reconnecting...");
+    client->stop();
+    httpCode = send(method, body, response);
+  }
+
+  lastUsed = millis();
+  xSemaphoreGive(lock);
+  return httpCode;
+}
+
+int BackendClient::send(const char *method, const char *body, Response &response)
+{
+  if (!client->connected())
+  {
+    handshakes++;
+    LOG_INFOF("Opening backend connection (handshake #%u)\n", handshakes);
+  }
+
+  http.begin(*client, url);
+  size_t bodyLength = strlen(body);
+  if (bodyLength > 0)
+  {
+    http.addHeader("Content-Type", "application/json");
+  }
+  static const char *responseHeaders[] = {"ETag", "Transfer-Encoding"};
+  http.collectHeaders(responseHeaders, 2);
+  if (response.etag != nullptr)
+  {
+    http.addHeader("X-Firebase-ETag", "true");
+    if (!response.etag->isEmpty())
+    {
+      http.addHeader("If-None-Match", *response.etag);
+    }
+  }
+  int httpCode = http.sendRequest(method, (uint8_t *)body, bodyLength);
+  if (response.etag != nullptr && httpCode == HTTP_CODE_OK)
+  {
+    *response.etag = http.header("ETag");
+  }
+
+  // Always drain the body, otherwise the socket cannot be reused.
+  bool unchanged = response.skipIfEtag != nullptr && response.etag != nullptr && *response.etag == *response.skipIfEtag;
+  if (httpCode == HTTP_CODE_OK && response.json != nullptr && !unchanged)
+  {
+    readJson(response);
+  }
+  else if (httpCode > 0 && response.text != nullptr)
+  {
+    *response.text = http.getString();
+  }
+  else if (httpCode > 0)
+  {
+    // Nobody wants the body (a write's echo, an error): skip it unbuffered
+    BodyStream body = bodyStream();
+    if (!body.drain())
+    {
+      client->stop();
+    }
+  }
+  else
+  {
+    LOG_WARNF("Backend %s failed: %s\n", method, http.errorToString(httpCode).c_str());
+    client->stop();
+  }
+
+  // With reuse enabled and a keep-alive response, end() leaves the socket open.
+  http.end();
+  return httpCode;
+}
+
+BodyStream BackendClient::bodyStream()
+{
+  bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+  return BodyStream(*client, http.getSize(), chunked);
+}
+
+void BackendClient::readJson(Response &response)
+{
+  BodyStream body = bodyStream();
+  if (response.filter != nullptr)
+  {
+    response.jsonError = deserializeJson(*response.json, body, DeserializationOption::Filter(*response.filter));
+  }
+  else
+  {
+    response.jsonError = deserializeJson(*response.json, body);
+  }
+  if (response.jsonError)
+  {
+    LOG_WARNF("Backend JSON parse failed: %s\n", response.jsonError.c_str());
+  }
+  if (!body.drain())
+  {
+    client->stop();
+  }
+}
@@ -0,0 +1,224 @@
+#include "BootCache.h"
+#include "Log.h"
+#include <esp32/rom/crc.h>
+
+static const char *scheduleFile = "/schedule.bin";
+static const char *rosterFile = "/roster.bin";
+static const uint32_t scheduleMagic = 0x53434844; // "SCHD"
+static const uint32_t rosterMagic = 0x524F5354;   // "ROST"
+
+struct ScheduleHeader
+{
+  uint32_t magic;
+  uint32_t recordSize; // sizeof(ClassRecord) when written
+  uint32_t count;
+  char version[24];    // classesMeta/version it was compiled from
+};
+
+struct RosterHeader
+{
+  uint32_t magic;
+  uint32_t count;
+  char classId[40];
+};
+
+bool BootCache::begin()
+{
+  ready = prefs.begin("boot", false);
+  if (!ready)
+  {
+    LOG_WARN("NVS unavailable, booting without cached state");
+  }
+  return ready;
+}
+
+bool BootCache::loadWiFi(WiFiCache &wifi)
+{
+  return ready && prefs.getBytes("wifi", &wifi, sizeof(wifi)) == sizeof(wifi);
+}
+
+void BootCache::saveWiFi(const WiFiCache &wifi)
+{
+  WiFiCache saved;
+  if (!ready || (loadWiFi(saved) && memcmp(&saved, &wifi, sizeof(wifi)) == 0))
+  {
+    return;
+  }
+  prefs.putBytes("wifi", &wifi, sizeof(wifi));
+}
+
+uint32_t BootCache::lastTime()
+{
+  return ready ? prefs.getUInt("time", 0) : 0;
+}
+
+void BootCache::saveTime(uint32_t now)
+{
+  if (ready)
+  {
+    prefs.putUInt("time", now);
+  }
+}
+
+void BootCache::requestSelfTest()
+{
+  if (ready)
+  {
+    prefs.putBool("selftest", true);
+  }
+}
+
+bool BootCache::takeSelfTestRequest()
+{
+  if (!ready || !prefs.getBool("selftest", false))
+  {
+    return false;
+  }
+  prefs.remove("selftest");
+  return true;
+}
+
+bool BootCache::loadSchedule(fs::FS &fs, RoomClassList &classes, String &version)
+{
+  fs::File file = fs.open(scheduleFile, "r");
+  if (!file)
+  {
+    return false;
+  }
+  ScheduleHeader header;
+  ClassRecord records[MAX_ROOM_CLASSES];
+  uint32_t crc = 0;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == scheduleMagic &&
+            header.recordSize == sizeof(ClassRecord) && header.count <= MAX_ROOM_CLASSES;
+  size_t recordBytes = ok ? header.count * sizeof(ClassRecord) : 0;
+  ok = ok && file.read((uint8_t *)records, recordBytes) == recordBytes &&
+       file.read((uint8_t *)&crc, sizeof(crc)) == sizeof(crc);
+  file.close();
+  if (!ok || crc != crc32_le(crc32_le(0, (const uint8_t *)&header, sizeof(header)), (const uint8_t *)records,
+                             recordBytes))
+  {
+    LOG_WARN("Saved schedule unreadable, ignored");
+    return false;
+  }
+
+  classes.clear();
+  for (uint32_t i = 0; i < header.count; i++)
+  {
+    ClassRecord *record = classes.upsert(records[i].id);
+    if (record != nullptr)
+    {
+      *record = records[i];
+    }
+  }
+  header.version[sizeof(header.version) - 1] = '\0';
+  version = header.version;
+  scheduleCrc = crc;
+  return true;
+}
+
+void BootCache::saveSchedule(fs::FS &fs, const RoomClassList &classes, const String &version)
+{
+  ScheduleHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = scheduleMagic;
+  header.recordSize = sizeof(ClassRecord);
+  header.count = classes.size();
+  strncpy(header.version, version.c_str(), sizeof(header.version) - 1);
+  uint32_t crc = crc32_le(0, (const uint8_t *)&header, sizeof(header));
+  for (int i = 0; i < classes.size(); i++)
+  {
+    crc = crc32_le(crc, (const uint8_t *)&classes.record(i), sizeof(ClassRecord));
+  }
+  if (crc == scheduleCrc)
+  {
+    return;
+  }
+
+  fs::File file = fs.open(scheduleFile, "w");
+  if (!file)
+  {
+    LOG_WARN("Failed to save schedule");
+    return;
+  }
+  file.write((const uint8_t *)&header, sizeof(header));
+  for (int i = 0; i < classes.size(); i++)
+  {
+    file.write((const uint8_t *)&classes.record(i), sizeof(ClassRecord));
+  }
+  file.write((const uint8_t *)&crc, sizeof(crc));
+  file.close();
+  scheduleCrc = crc;
+}
+
+bool BootCache::loadRoster(fs::FS &fs, EnrollmentRoster &roster)
+{
+  fs::File file = fs.open(rosterFile, "r");
+  if (!file)
+  {
+    return false;
+  }
+  RosterHeader header;
+  bool ok = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == rosterMagic;
+  header.classId[sizeof(header.classId) - 1] = '\0';
+  ok = ok && roster.reset(header.classId, header.count);
+  uint32_t crc = ok ? crc32_le(0, (const uint8_t *)&header, sizeof(header)) : 0;
+  for (uint32_t i = 0; ok && i < header.count; i++)
+  {
+    uint64_t h;
+    ok = file.read((uint8_t *)&h, sizeof(h)) == sizeof(h);
+    crc = crc32_le(crc, (const uint8_t *)&h, sizeof(h));
+    roster.addHash(h);
+  }
+  uint32_t savedCrc = 0;
+  ok = ok && file.read((uint8_t *)&savedCrc, sizeof(savedCrc)) == sizeof(savedCrc) && savedCrc == crc;
+  file.close();
+  if (!ok)
+  {
+    LOG_WARN("Saved roster unreadable, ignored");
+    roster.clear();
+    return false;
+  }
+  rosterCrc = crc;
+  return true;
+}
+
+void BootCache::saveRoster(fs::FS &fs, const EnrollmentRoster &roster)
+{
+  RosterHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = rosterMagic;
+  header.count = roster.size();
+  strncpy(header.classId, roster.loadedClassId(), sizeof(header.classId) - 1);
+  uint32_t crc = crc32_le(0, (const uint8_t *)&header, sizeof(header));
+  for (size_t i = 0; i < roster.capacity(); i++)
+  {
+    uint64_t h = roster.hashAt(i);
+    if (h != 0)
+    {
+      crc = crc32_le(crc, (const uint8_t *)&h, sizeof(h));
+    }
+  }
+  if (crc == rosterCrc)
+  {
+    return;
+  }
+
+  fs::File file = fs.open(rosterFile, "w");
+  if (!file)
+  {
+    LOG_WARN("Failed to save roster");
+    return;
+  }
+  file.write((const uint8_t *)&header, sizeof(header));
+  for (size_t i = 0; i < roster.capacity(); i++)
+  {
+    uint64_t h = roster.hashAt(i);
+    if (h != 0)
+    {
+      file.write((const uint8_t *)&h, sizeof(h));
+    }
+  }
+  file.write((const uint8_t *)&crc, sizeof(crc));
+  file.close();
+  rosterCrc = crc;
+}
@@ -0,0 +1,428 @@
+#include "GatewayLink.h"
+#include "Log.h"
+#include <esp_random.h>
+
+// The link pings the gateway when it has heard nothing for pingInterval;
+// a gateway that stays silent past linkTimeout is gone even if the socket
+// still looks open.
+static const unsigned long pingInterval = 20000;
+static const unsigned long linkTimeout = 45000;
+static const unsigned long reconnectInterval = 10000;
+static const unsigned long handshakeTimeout = 3000;
+
+enum Opcode : uint8_t
+{
+  OP_TEXT = 0x1,
+  OP_BINARY = 0x2,
+  OP_CLOSE = 0x8,
+  OP_PING = 0x9,
+  OP_PONG = 0xA,
+};
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Compares without returning early, so the time taken does not say how
+// much of a forged MAC was right.
+static bool sameBytes(const uint8_t *a, const uint8_t *b, size_t length)
+{
+  uint8_t difference = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    difference |= a[i] ^ b[i];
+  }
+  return difference == 0;
+}
+
+static void base64Encode(const uint8_t *data, size_t length, char *out)
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t i = 0; i < length; i += 3)
+  {
+    uint32_t group = (uint32_t)data[i] << 16;
+    if (i + 1 < length)
+    {
+      group |= (uint32_t)data[i + 1] << 8;
+    }
+    if (i + 2 < length)
+    {
+      group |= data[i + 2];
+    }
+    *out++ = alphabet[(group >> 18) & 0x3F];
+    *out++ = alphabet[(group >> 12) & 0x3F];
+    *out++ = i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+    *out++ = i + 2 < length ? alphabet[group & 0x3F] : '=';
+  }
+  *out = '\0';
+}
+
+bool GatewayLink::begin(const char *gatewayHost, uint16_t gatewayPort, const char *keyHex, MessageHandler onMessage,
+                        MemoryArena &frameArena)
+{
+  host = gatewayHost;
+  port = gatewayPort;
+  handler = onMessage;
+  arena = &frameArena;
+
+  uint8_t key[64];
+  size_t keyLength = 0;
+  for (; keyHex[0] != '\0'; keyHex += 2)
+  {
+    int high = hexDigit(keyHex[0]);
+    int low = high < 0 ? -1 : hexDigit(keyHex[1]);
+    if (low < 0 || keyLength >= sizeof(key))
+    {
+      return false;
+    }
+    key[keyLength++] = (uint8_t)(high << 4 | low);
+  }
+  if (keyLength == 0)
+  {
+    return false;
+  }
+  mbedtls_md_init(&hmac);
+  if (mbedtls_md_setup(&hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+      mbedtls_md_hmac_starts(&hmac, key, keyLength) != 0)
+  {
+    mbedtls_md_free(&hmac);
+    return false;
+  }
+  memset(key, 0, sizeof(key));
+  keyed = true;
+  return true;
+}
+
+bool GatewayLink::takeConnected()
+{
+  bool connectedNow = justConnected;
+  justConnected = false;
+  return connectedNow;
+}
+
+void GatewayLink::stop()
+{
+  if (open)
+  {
+    LOG_WARN("Gateway link closed, falling back to Firebase");
+  }
+  open = false;
+  justConnected = false;
+  client.stop();
+}
+
+void GatewayLink::loop()
+{
+  if (!open)
+  {
+    if (keyed && WiFi.status() == WL_CONNECTED && (!attempted || millis() - lastAttempt >= reconnectInterval))
+    {
+      connect();
+    }
+    return;
+  }
+
+  if (WiFi.status() != WL_CONNECTED || (!client.connected() && client.available() == 0))
+  {
+    stop();
+    return;
+  }
+  while (client.available() >= 2)
+  {
+    if (!readFrame())
+    {
+      stop();
+      return;
+    }
+  }
+
+  unsigned long quiet = millis() - lastActivity;
+  if (quiet > linkTimeout)
+  {
+    LOG_WARN("Gateway link timed out");
+    stop();
+  }
+  else if (quiet > pingInterval && millis() - lastPing > pingInterval)
+  {
+    lastPing = millis();
+    sendFrame(OP_PING, 0);
+  }
+}
+
+// --- connect ---
+// Opens the socket and upgrades it to a WebSocket. The gateway's
+// Sec-WebSocket-Accept only guards against caching proxies; what is checked
+// is its X-Gateway-Proof, which only a holder of the key can compute for
+// this session's Sec-WebSocket-Key.
+bool GatewayLink::connect()
+{
+  attempted = true;
+  lastAttempt = millis();
+  if (!client.connect(host, port))
+  {
+    LOG_WARNF("Gateway %s:%u unreachable\n", host, (unsigned)port);
+    return false;
+  }
+  client.setNoDelay(true);
+
+  uint8_t random[16];
+  for (size_t i = 0; i < sizeof(random); i += 4)
+  {
+    uint32_t r = esp_random();
+    memcpy(random + i, &r, 4);
+  }
+  base64Encode(random, sizeof(random), wsKey);
+  client.printf("GET /scanner HTTP/1.1\r\nHost: %s:%u\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                host, (unsigned)port, wsKey);
+
+  client.setTimeout(handshakeTimeout);
+  String status = client.readStringUntil('\n');
+  if (!status.startsWith("HTTP/1.1 101"))
+  {
+    LOG_WARN("Gateway refused the WebSocket upgrade: " + status);
+    client.stop();
+    return false;
+  }
+  String gatewayNonce;
+  String proof;
+  while (client.connected())
+  {
+    String line = client.readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0)
+    {
+      break;
+    }
+    int colon = line.indexOf(':');
+    if (colon < 0)
+    {
+      continue;
+    }
+    String name = line.substring(0, colon);
+    name.toLowerCase();
+    String value = line.substring(colon + 1);
+    value.trim();
+    if (name == "x-gateway-nonce")
+    {
+      gatewayNonce = value;
+    }
+    else if (name == "x-gateway-proof")
+    {
+      proof = value;
+    }
+  }
+
+  uint8_t expected[32];
+  uint8_t given[32];
+  bool proven = gatewayNonce.length() == sizeof(nonce) - 1 && proof.length() == 2 * sizeof(given);
+  for (size_t i = 0; proven && i < sizeof(given); i++)
+  {
+    int high = hexDigit(proof[2 * i]);
+    int low = hexDigit(proof[2 * i + 1]);
+    proven = high >= 0 && low >= 0;
+    given[i] = (uint8_t)(high << 4 | low);
+  }
+  if (proven)
+  {
+    memcpy(nonce, gatewayNonce.c_str(), sizeof(nonce));
+    mbedtls_md_hmac_reset(&hmac);
+    mbedtls_md_hmac_update(&hmac, (const unsigned char *)"gateway ", 8);
+    mbedtls_md_hmac_update(&hmac, (const unsigned char *)wsKey, strlen(wsKey));
+    mbedtls_md_hmac_update(&hmac, (const unsigned char *)" ", 1);
+    mbedtls_md_hmac_update(&hmac, (const unsigned char *)nonce, strlen(nonce));
+    mbedtls_md_hmac_finish(&hmac, expected);
+    proven = sameBytes(expected, given, sizeof(expected));
+  }
+  if (!proven)
+  {
+    LOG_WARN("Gateway could not prove it holds the key, not connecting");
+    client.stop();
+    return false;
+  }
+
+  LOG_INFOF("Gateway link to %s:%u connected\n", host, (unsigned)port);
+  open = true;
+  justConnected = true;
+  sent = heard = 0;
+  lastActivity = lastPing = millis();
+  return true;
+}
+
+// --- readFrame ---
+// Reads one frame that has started to arrive; the rest of it is waited for,
+// as the gateway writes every frame whole. Returns false if the session
+// has to be dropped.
+bool GatewayLink::readFrame()
+{
+  uint8_t header[2];
+  if (client.readBytes(header, 2) != 2)
+  {
+    return false;
+  }
+  uint8_t opcode = header[0] & 0x0F;
+  bool fin = (header[0] & 0x80) != 0;
+  uint64_t length = header[1] & 0x7F;
+  if ((header[1] & 0x80) != 0)
+  {
+    LOG_WARN("Gateway sent a masked frame");
+    return false;
+  }
+  if (length >= 126)
+  {
+    uint8_t extended[8];
+    size_t size = length == 126 ? 2 : 8;
+    if (client.readBytes(extended, size) != size)
+    {
+      return false;
+    }
+    length = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      length = length << 8 | extended[i];
+    }
+  }
+  if (length > GATEWAY_MAX_FRAME || !fin)
+  {
+    LOG_WARN("Gateway frame too long or fragmented");
+    return false;
+  }
+
+  uint8_t *payload = (uint8_t *)arena->allocate(length + 1);
+  if (payload == nullptr)
+  {
+    LOG_ERROR("Not enough memory for gateway frame");
+    return false;
+  }
+  bool ok = client.readBytes(payload, (size_t)length) == length;
+  lastActivity = millis();
+  if (ok)
+  {
+    switch (opcode)
+    {
+    case OP_BINARY:
+    {
+      uint8_t mac[GATEWAY_MAC_BYTES];
+      size_t messageLength = length >= GATEWAY_MAC_BYTES ? (size_t)length - GATEWAY_MAC_BYTES : 0;
+      sign('g', heard, payload, messageLength, mac);
+      if (length < GATEWAY_MAC_BYTES || !sameBytes(mac, payload + messageLength, GATEWAY_MAC_BYTES))
+      {
+        LOG_WARN("Gateway message failed authentication");
+        ok = false;
+        break;
+      }
+      heard++;
+      // Parsed in place: strings point into payload until it is freed
+      PooledJsonDocument message(*arena, messageLength * 2 + 1024);
+      DeserializationError error = deserializeMsgPack(message, (char *)payload, messageLength);
+      if (error)
+      {
+        LOG_WARNF("Unreadable gateway message: %s\n", error.c_str());
+      }
+      else if (handler != nullptr)
+      {
+        handler(message);
+      }
+      break;
+    }
+    case OP_PING:
+      if (length <= GATEWAY_MAX_MESSAGE)
+      {
+        memcpy(frame + 8, payload, length);
+        sendFrame(OP_PONG, length);
+      }
+      break;
+    case OP_CLOSE:
+      LOG_WARN("Gateway closed the link");
+      sendFrame(OP_CLOSE, 0);
+      ok = false;
+      break;
+    default:
+      break; // pongs only count as activity; text frames are not used
+    }
+  }
+  arena->deallocate(payload);
+  return ok;
+}
+
+bool GatewayLink::send(const JsonDocument &message)
+{
+  if (!open)
+  {
+    return false;
+  }
+  size_t length = serializeMsgPack(message, frame + 8, GATEWAY_MAX_MESSAGE);
+  if (length == 0 || length >= GATEWAY_MAX_MESSAGE)
+  {
+    LOG_WARN("Gateway message too long, not sent");
+    return false;
+  }
+  sign('s', sent++, frame + 8, length, frame + 8 + length);
+  if (!sendFrame(OP_BINARY, length + GATEWAY_MAC_BYTES))
+  {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+// --- sign ---
+// The MAC of the count'th message from sender this session, into mac.
+void GatewayLink::sign(char sender, uint64_t count, const uint8_t *message, size_t length, uint8_t *mac)
+{
+  uint8_t counter[8];
+  for (int i = 0; i < 8; i++)
+  {
+    counter[i] = (uint8_t)(count >> (56 - 8 * i));
+  }
+  uint8_t digest[32];
+  mbedtls_md_hmac_reset(&hmac);
+  mbedtls_md_hmac_update(&hmac, (const unsigned char *)&sender, 1);
+  mbedtls_md_hmac_update(&hmac, (const unsigned char *)wsKey, strlen(wsKey));
+  mbedtls_md_hmac_update(&hmac, (const unsigned char *)nonce, strlen(nonce));
+  mbedtls_md_hmac_update(&hmac, counter, sizeof(counter));
+  mbedtls_md_hmac_update(&hmac, message, length);
+  mbedtls_md_hmac_finish(&hmac, digest);
+  memcpy(mac, digest, GATEWAY_MAC_BYTES);
+}
+
+// --- sendFrame ---
+// Sends the length bytes at frame + 8 as one masked frame, the header
+// written just in front of them so the frame goes out in one write.
+bool GatewayLink::sendFrame(uint8_t opcode, size_t length)
+{
+  size_t headerSize = length < 126 ? 6 : 8;
+  uint8_t *start = frame + 8 - headerSize;
+  start[0] = 0x80 | opcode;
+  if (length < 126)
+  {
+    start[1] = 0x80 | (uint8_t)length;
+  }
+  else
+  {
+    start[1] = 0x80 | 126;
+    start[2] = (uint8_t)(length >> 8);
+    start[3] = (uint8_t)length;
+  }
+  uint32_t mask = esp_random();
+  uint8_t *maskKey = frame + 4;
+  memcpy(maskKey, &mask, 4);
+  for (size_t i = 0; i < length; i++)
+  {
+    frame[8 + i] ^= maskKey[i & 3];
+  }
+  return client.write(start, headerSize + length) == headerSize + length;
+}
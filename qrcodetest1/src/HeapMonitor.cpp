@@ -0,0 +1,51 @@
+#include "HeapMonitor.h"
+#include "Log.h"
+
+void HeapMonitor::begin(uint32_t warnLevel)
+{
+  warnBelow = warnLevel;
+  sample();
+}
+
+void HeapMonitor::sample()
+{
+  uint32_t largestBlock = ESP.getMaxAllocHeap();
+  bool warn = false;
+  portENTER_CRITICAL(&mux);
+  lowestLargestBlock = min(lowestLargestBlock, largestBlock);
+  if (!low && largestBlock < warnBelow)
+  {
+    low = true;
+    warn = true;
+  }
+  else if (low && largestBlock >= warnBelow)
+  {
+    low = false;
+  }
+  portEXIT_CRITICAL(&mux);
+  if (warn)
+  {
+    LOG_WARNF("Heap low: largest free block %u bytes, %u free\n", (unsigned)largestBlock,
+              (unsigned)ESP.getFreeHeap());
+  }
+}
+
+void HeapMonitor::dump(Print &out)
+{
+  portENTER_CRITICAL(&mux);
+  uint32_t lowestBlock = lowestLargestBlock;
+  portEXIT_CRITICAL(&mux);
+  out.println("# heap: free lowest_free largest_block lowest_largest_block");
+  out.printf("%u %u %u %u\n", (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(),
+             (unsigned)ESP.getMaxAllocHeap(), (unsigned)lowestBlock);
+  out.println("# psram: size free lowest_free largest_block");
+  if (psramFound())
+  {
+    out.printf("%u %u %u %u\n", (unsigned)ESP.getPsramSize(), (unsigned)ESP.getFreePsram(),
+               (unsigned)ESP.getMinFreePsram(), (unsigned)ESP.getMaxAllocPsram());
+  }
+  else
+  {
+    out.println("0 0 0 0");
+  }
+}
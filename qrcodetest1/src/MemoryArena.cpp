@@ -0,0 +1,167 @@
+#include "MemoryArena.h"
+#include "Log.h"
+#include <mbedtls/platform.h>
+
+bool MemoryArena::begin(size_t size, size_t count, bool internalFallback)
+{
+  count = min(count, (size_t)MEMORY_ARENA_MAX_BLOCKS);
+  size = (size + 7) & ~(size_t)7;
+  uint8_t *memory = nullptr;
+  bool psram = false;
+  if (psramFound())
+  {
+    memory = (uint8_t *)ps_malloc(size * count);
+    psram = memory != nullptr;
+  }
+  if (memory == nullptr && internalFallback)
+  {
+    memory = (uint8_t *)malloc(size * count);
+  }
+  if (memory == nullptr)
+  {
+    LOG_WARNF("No room for the %s arena, using the heap\n", name);
+    return false;
+  }
+
+  portENTER_CRITICAL(&mux);
+  base = memory;
+  blockSize = size;
+  blocks = count;
+  inPsram = psram;
+  portEXIT_CRITICAL(&mux);
+  LOG_INFOF("%s arena: %u x %u bytes in %s\n", name, (unsigned)count, (unsigned)size, psram ? "PSRAM" : "internal RAM");
+  return true;
+}
+
+bool MemoryArena::owns(const void *pointer) const
+{
+  return base != nullptr && pointer >= base && pointer < base + blockSize * blocks;
+}
+
+size_t MemoryArena::capacityFor(size_t size) const
+{
+  return blocks > 0 && size <= blockSize ? blockSize : size;
+}
+
+void *MemoryArena::allocate(size_t size)
+{
+  portENTER_CRITICAL(&mux);
+  if (size <= blockSize)
+  {
+    for (size_t i = 0; i < blocks; i++)
+    {
+      if ((lent & (1u << i)) == 0)
+      {
+        lent |= 1u << i;
+        mostInUse = max(mostInUse, (uint32_t)__builtin_popcount(lent));
+        portEXIT_CRITICAL(&mux);
+        return base + i * blockSize;
+      }
+    }
+  }
+  if (blocks > 0)
+  {
+    fallbacks++;
+  }
+  portEXIT_CRITICAL(&mux);
+  return malloc(size);
+}
+
+void MemoryArena::deallocate(void *pointer)
+{
+  if (!owns(pointer))
+  {
+    free(pointer);
+    return;
+  }
+  portENTER_CRITICAL(&mux);
+  lent &= ~(1u << (((uint8_t *)pointer - base) / blockSize));
+  portEXIT_CRITICAL(&mux);
+}
+
+void *MemoryArena::reallocate(void *pointer, size_t size)
+{
+  if (!owns(pointer))
+  {
+    return realloc(pointer, size);
+  }
+  if (size <= blockSize)
+  {
+    return pointer;
+  }
+  void *grown = malloc(size);
+  if (grown != nullptr)
+  {
+    memcpy(grown, pointer, blockSize);
+    deallocate(pointer);
+  }
+  return grown;
+}
+
+void MemoryArena::recordUse(size_t bytes)
+{
+  portENTER_CRITICAL(&mux);
+  peakBytes = max(peakBytes, bytes);
+  portEXIT_CRITICAL(&mux);
+}
+
+void MemoryArena::dump(Print &out)
+{
+  portENTER_CRITICAL(&mux);
+  unsigned inUse = (unsigned)__builtin_popcount(lent);
+  unsigned most = (unsigned)mostInUse;
+  unsigned peak = (unsigned)peakBytes;
+  unsigned fellBack = (unsigned)fallbacks;
+  portEXIT_CRITICAL(&mux);
+  out.printf("%s %s %u %u %u %u %u %u\n", name, blocks == 0 ? "none" : inPsram ? "psram" : "internal",
+             (unsigned)blockSize, (unsigned)blocks, inUse, most, peak, fellBack);
+}
+
+// --- serveTlsBuffers ---
+// mbedTLS allocates through a replaceable calloc/free pair when it is built
+// with MBEDTLS_PLATFORM_MEMORY. Small allocations (contexts, certificates,
+// handshake state) stay on the heap; only the record buffers, which are the
+// large ones, come from the arena.
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+static MemoryArena *tlsArena = nullptr;
+static size_t tlsMinimum = 0;
+
+static void *tlsCalloc(size_t count, size_t size)
+{
+  if (size != 0 && count > SIZE_MAX / size)
+  {
+    return nullptr;
+  }
+  size_t total = count * size;
+  if (total < tlsMinimum)
+  {
+    return calloc(count, size);
+  }
+  tlsArena->recordUse(total);
+  void *buffer = tlsArena->allocate(total);
+  if (buffer != nullptr)
+  {
+    memset(buffer, 0, total);
+  }
+  return buffer;
+}
+
+static void tlsFree(void *pointer)
+{
+  tlsArena->deallocate(pointer);
+}
+
+bool serveTlsBuffers(MemoryArena &arena, size_t minimum)
+{
+  tlsArena = &arena;
+  tlsMinimum = minimum;
+  return mbedtls_platform_set_calloc_free(tlsCalloc, tlsFree) == 0;
+}
+#else
+bool serveTlsBuffers(MemoryArena &arena, size_t minimum)
+{
+  (void)arena;
+  (void)minimum;
+  return false;
+}
+#endif
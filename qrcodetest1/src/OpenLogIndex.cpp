@@ -0,0 +1,164 @@
+#include "OpenLogIndex.h"
+#include "Log.h"
+#include <esp32/rom/crc.h>
+
+static const uint32_t indexMagic = 0x4F4C4F47; // "OLOG"
+
+// Copies text into out; false, leaving out alone, if it does not fit whole.
+static bool copyField(char *out, size_t outSize, const char *text)
+{
+  size_t length = strlen(text);
+  if (length >= outSize)
+  {
+    return false;
+  }
+  memcpy(out, text, length + 1);
+  return true;
+}
+
+bool OpenLogIndex::begin(fs::FS &fs, const char *path, uint32_t maxOpenAge)
+{
+  maxAge = maxOpenAge;
+  memset(slots, 0, sizeof(slots));
+
+  if (!fs.exists(path) || fs.open(path, "r").size() != sizeof(slots))
+  {
+    fs::File init = fs.open(path, "w");
+    if (!init)
+    {
+      LOG_ERROR("Failed to create open log index");
+      return false;
+    }
+    init.write((const uint8_t *)slots, sizeof(slots));
+    init.close();
+  }
+
+  file = fs.open(path, "r+");
+  if (!file)
+  {
+    LOG_ERROR("Failed to open open log index");
+    return false;
+  }
+  if (file.read((uint8_t *)slots, sizeof(slots)) != sizeof(slots))
+  {
+    memset(slots, 0, sizeof(slots));
+  }
+  for (Record &record : slots)
+  {
+    if (record.magic != indexMagic || record.crc != recordCrc(record))
+    {
+      memset(&record, 0, sizeof(record));
+    }
+  }
+  LOG_INFOF("Open log index ready: %u open log(s)\n", (unsigned)size());
+  return true;
+}
+
+int OpenLogIndex::indexOf(const char *userId, const char *classId)
+{
+  for (size_t i = 0; i < OPEN_LOG_SLOTS; i++)
+  {
+    const Record &record = slots[i];
+    if (record.magic == indexMagic && strcmp(record.userId, userId) == 0 && strcmp(record.classId, classId) == 0)
+    {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+bool OpenLogIndex::find(const char *userId, const char *classId, uint32_t now, char *logKey, size_t logKeySize)
+{
+  int slot = indexOf(userId, classId);
+  if (slot < 0)
+  {
+    return false;
+  }
+  const Record &record = slots[slot];
+  if (now - record.openedAt > maxAge)
+  {
+    closed(userId, classId);
+    return false;
+  }
+  return copyField(logKey, logKeySize, record.logKey);
+}
+
+void OpenLogIndex::opened(const char *userId, const char *classId, const char *logKey, uint32_t openedAt)
+{
+  Record fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  if (!copyField(fresh.userId, sizeof(fresh.userId), userId) ||
+      !copyField(fresh.classId, sizeof(fresh.classId), classId) ||
+      !copyField(fresh.logKey, sizeof(fresh.logKey), logKey))
+  {
+    LOG_WARNF("Open log of %s not indexed: ID too long\n", userId);
+    return;
+  }
+  int slot = indexOf(userId, classId);
+  if (slot < 0)
+  {
+    // A free slot, or else the log opened longest ago
+    slot = 0;
+    for (size_t i = 0; i < OPEN_LOG_SLOTS; i++)
+    {
+      if (slots[i].magic != indexMagic)
+      {
+        slot = (int)i;
+        break;
+      }
+      if ((int32_t)(slots[i].openedAt - slots[slot].openedAt) < 0)
+      {
+        slot = (int)i;
+      }
+    }
+  }
+  Record &record = slots[slot];
+  record = fresh;
+  record.magic = indexMagic;
+  record.openedAt = openedAt;
+  record.crc = recordCrc(record);
+  write(slot);
+}
+
+void OpenLogIndex::closed(const char *userId, const char *classId)
+{
+  int slot = indexOf(userId, classId);
+  if (slot < 0)
+  {
+    return;
+  }
+  memset(&slots[slot], 0, sizeof(Record));
+  write(slot);
+}
+
+size_t OpenLogIndex::size()
+{
+  size_t count = 0;
+  for (const Record &record : slots)
+  {
+    if (record.magic == indexMagic)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+void OpenLogIndex::write(size_t slot)
+{
+  if (!file)
+  {
+    return; // RAM only; forgotten on reboot
+  }
+  if (!file.seek(slot * sizeof(Record)) ||
+      file.write((const uint8_t *)&slots[slot], sizeof(Record)) != sizeof(Record))
+  {
+    LOG_WARN("Failed to write open log index");
+  }
+  file.flush();
+}
+
+uint32_t OpenLogIndex::recordCrc(const Record &record)
+{
+  return crc32_le(0, (const uint8_t *)&record, offsetof(Record, crc));
+}
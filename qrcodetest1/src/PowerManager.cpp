@@ -0,0 +1,90 @@
+#include "PowerManager.h"
+#include "Log.h"
+#include <esp_timer.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+static const int activeFrequency = 240; // MHz
+static const int lowFrequency = 80;     // lowest clock WiFi stays up at
+
+void PowerManager::begin()
+{
+  modeSince = esp_timer_get_time();
+  supported = configure(false, false);
+  if (!supported)
+  {
+    LOG_INFO("Power management not in this build, low-power mode only slows or pauses the scanner");
+  }
+}
+
+bool PowerManager::configure(bool lowPower, bool lightSleep)
+{
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t config = {};
+  config.max_freq_mhz = lowPower ? lowFrequency : activeFrequency;
+  // Full speed while scanning: the camera's DMA runs off the APB clock
+  config.min_freq_mhz = lowPower ? lowFrequency : activeFrequency;
+  config.light_sleep_enable = lowPower && lightSleep;
+  esp_err_t err = esp_pm_configure(&config);
+  if (err != ESP_OK)
+  {
+    LOG_WARNF("esp_pm_configure failed: %d\n", (int)err);
+    return false;
+  }
+  return true;
+#else
+  (void)lowPower;
+  (void)lightSleep;
+  return false;
+#endif
+}
+
+void PowerManager::enterLowPower(bool lightSleep)
+{
+  if (low)
+  {
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  modeTime[0] += now - modeSince;
+  modeSince = now;
+  low = true;
+  if (supported)
+  {
+    configure(true, lightSleep);
+  }
+  LOG_INFO("Entering low-power mode until the next class");
+}
+
+void PowerManager::exitLowPower(int64_t requestedAt)
+{
+  if (!low)
+  {
+    return;
+  }
+  if (supported)
+  {
+    configure(false, false);
+  }
+  int64_t now = esp_timer_get_time();
+  modeTime[1] += now - modeSince;
+  modeSince = now;
+  low = false;
+  wakes++;
+  lastWake = (uint32_t)(now - requestedAt);
+  longestWake = max(longestWake, lastWake);
+  LOG_INFOF("Left low-power mode, wake took %u us\n", (unsigned)lastWake);
+}
+
+void PowerManager::dump(Print &out)
+{
+  uint64_t time[2] = {modeTime[0], modeTime[1]};
+  time[low ? 1 : 0] += esp_timer_get_time() - modeSince;
+  out.println("# power: mode seconds loop_wakes");
+  out.printf("active %u %u\n", (unsigned)(time[0] / 1000000), (unsigned)loopWakes[0]);
+  out.printf("low %u %u\n", (unsigned)(time[1] / 1000000), (unsigned)loopWakes[1]);
+  out.printf("# low power: %s\n", supported ? "clock scaling" : "no power management in this build");
+  out.println("# wakes: count last_us max_us");
+  out.printf("%u %u %u\n", (unsigned)wakes, (unsigned)lastWake, (unsigned)longestWake);
+}
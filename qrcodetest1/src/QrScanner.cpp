@@ -0,0 +1,124 @@
+#include "QrScanner.h"
+#include "Log.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "quirc/quirc.h"
+
+static const TickType_t activeFrameInterval = 100 / portTICK_PERIOD_MS; // as the reader library polls
+static const TickType_t idleFrameInterval = 250 / portTICK_PERIOD_MS;
+static const TickType_t slowFrameInterval = 1000 / portTICK_PERIOD_MS;
+
+// Large enough that it should not live on the task stack
+static struct quirc_data decodedData;
+
+bool QrScanner::begin(const MotionGateConfig &config, BaseType_t core)
+{
+  gate.configure(config);
+  queue = xQueueCreate(QR_SCANNER_QUEUE_LENGTH, sizeof(ScannedCode));
+  if (queue == nullptr)
+  {
+    return false;
+  }
+  return xTaskCreatePinnedToCore(task, "qrScanner", 8 * 1024, this, 5, &taskHandle, core) == pdPASS;
+}
+
+void QrScanner::resume()
+{
+  paused = false;
+  if (taskHandle != nullptr)
+  {
+    xTaskNotifyGive(taskHandle);
+  }
+}
+
+bool QrScanner::receiveQrCode(struct QRCodeData *codeData, long timeoutMs, QrScanTiming *timing)
+{
+  ScannedCode code;
+  if (xQueueReceive(queue, &code, timeoutMs / portTICK_PERIOD_MS) != pdTRUE)
+  {
+    return false;
+  }
+  *codeData = code.data;
+  if (timing != nullptr)
+  {
+    *timing = code.timing;
+  }
+  return true;
+}
+
+void QrScanner::task(void *arg)
+{
+  static_cast<QrScanner *>(arg)->run();
+}
+
+void QrScanner::run()
+{
+  struct quirc *decoder = quirc_new();
+  size_t decoderWidth = 0;
+  size_t decoderHeight = 0;
+
+  while (true)
+  {
+    if (paused)
+    {
+      // With no frame taken the camera driver stops filling buffers too
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    camera_fb_t *frame = esp_camera_fb_get();
+    if (frame == nullptr)
+    {
+      vTaskDelay(activeFrameInterval);
+      continue;
+    }
+    int64_t capturedAt = esp_timer_get_time();
+    seen++;
+
+    uint32_t now = millis();
+    bool open = gate.update(frame->buf, frame->width, frame->height, now);
+    if (open)
+    {
+      decoded++;
+      if (frame->width != decoderWidth || frame->height != decoderHeight)
+      {
+        if (quirc_resize(decoder, frame->width, frame->height) < 0)
+        {
+          LOG_ERROR("Failed to size the QR decoder");
+          esp_camera_fb_return(frame);
+          vTaskDelay(idleFrameInterval);
+          continue;
+        }
+        decoderWidth = frame->width;
+        decoderHeight = frame->height;
+      }
+
+      int64_t decodeStart = esp_timer_get_time();
+      uint8_t *image = quirc_begin(decoder, NULL, NULL);
+      memcpy(image, frame->buf, frame->width * frame->height);
+      quirc_end(decoder);
+
+      int count = quirc_count(decoder);
+      for (int i = 0; i < count; i++)
+      {
+        struct quirc_code code;
+        quirc_extract(decoder, i, &code);
+        memset(&result, 0, sizeof(result));
+        if (quirc_decode(&code, &decodedData) == QUIRC_SUCCESS)
+        {
+          size_t length = min((size_t)decodedData.payload_len, sizeof(result.data.payload) - 1);
+          result.data.valid = true;
+          result.data.dataType = decodedData.data_type;
+          result.data.payloadLen = length;
+          memcpy(result.data.payload, decodedData.payload, length);
+          gate.notifyDecoded(now);
+        }
+        result.timing.capturedAt = capturedAt;
+        result.timing.decodeStart = decodeStart;
+        result.timing.decodeEnd = esp_timer_get_time();
+        xQueueSend(queue, &result, 0);
+      }
+    }
+    esp_camera_fb_return(frame);
+    vTaskDelay(open ? activeFrameInterval : (slow ? slowFrameInterval : idleFrameInterval));
+  }
+}
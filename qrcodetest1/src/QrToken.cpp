@@ -0,0 +1,271 @@
+#include "QrToken.h"
+#include <string.h>
+
+// Clocks before this have not been set by NTP yet
+static const uint32_t earliestClock = 1704067200; // 2024-01-01
+
+static const size_t macChars = (QR_TOKEN_MAC_BYTES * 8 + 5) / 6; // base64url, no padding
+
+static int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static int base64UrlDigit(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+  {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z')
+  {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0' + 52;
+  }
+  if (c == '-')
+  {
+    return 62;
+  }
+  if (c == '_')
+  {
+    return 63;
+  }
+  return -1;
+}
+
+// Decodes exactly macChars base64url characters into QR_TOKEN_MAC_BYTES bytes.
+static bool decodeMac(const char *text, size_t length, uint8_t *mac)
+{
+  if (length != macChars)
+  {
+    return false;
+  }
+  uint32_t bits = 0;
+  int pending = 0;
+  size_t out = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    int digit = base64UrlDigit(text[i]);
+    if (digit < 0)
+    {
+      return false;
+    }
+    bits = (bits << 6) | (uint32_t)digit;
+    pending += 6;
+    if (pending >= 8 && out < QR_TOKEN_MAC_BYTES)
+    {
+      pending -= 8;
+      mac[out++] = (uint8_t)(bits >> pending);
+    }
+  }
+  return out == QR_TOKEN_MAC_BYTES;
+}
+
+// Parses a decimal field of [start, end) that fits in 32 bits.
+static bool parseSeconds(const char *start, const char *end, uint32_t &value)
+{
+  if (start == end || end - start > 10)
+  {
+    return false;
+  }
+  uint64_t result = 0;
+  for (const char *c = start; c < end; c++)
+  {
+    if (*c < '0' || *c > '9')
+    {
+      return false;
+    }
+    result = result * 10 + (uint64_t)(*c - '0');
+  }
+  if (result > UINT32_MAX)
+  {
+    return false;
+  }
+  value = (uint32_t)result;
+  return true;
+}
+
+// Copies [start, end) into out. Returns true if it had to be cut short.
+static bool copyField(const char *start, const char *end, char *out, size_t outSize)
+{
+  size_t length = (size_t)(end - start);
+  bool cut = length >= outSize;
+  if (cut)
+  {
+    length = outSize - 1;
+  }
+  memcpy(out, start, length);
+  out[length] = '\0';
+  return cut;
+}
+
+bool QrTokenVerifier::begin(const char *keyHex)
+{
+  uint8_t key[64];
+  size_t keyLength = 0;
+  for (; keyHex[0] != '\0'; keyHex += 2)
+  {
+    int high = hexDigit(keyHex[0]);
+    int low = high < 0 ? -1 : hexDigit(keyHex[1]);
+    if (low < 0 || keyLength >= sizeof(key))
+    {
+      return false;
+    }
+    key[keyLength++] = (uint8_t)(high << 4 | low);
+  }
+  if (keyLength == 0)
+  {
+    return false;
+  }
+
+  mbedtls_md_init(&hmac);
+  if (mbedtls_md_setup(&hmac, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+      mbedtls_md_hmac_starts(&hmac, key, keyLength) != 0)
+  {
+    mbedtls_md_free(&hmac);
+    return false;
+  }
+  memset(key, 0, sizeof(key));
+  keyed = true;
+  return true;
+}
+
+bool QrTokenVerifier::isToken(const char *payload)
+{
+  return strncmp(payload, QR_TOKEN_PREFIX, sizeof(QR_TOKEN_PREFIX) - 1) == 0;
+}
+
+QrTokenStatus QrTokenVerifier::verify(const char *payload, uint32_t now, char *userId, size_t userIdSize,
+                                      char *classes, size_t classesSize)
+{
+  if (!isToken(payload))
+  {
+    return TOKEN_MALFORMED;
+  }
+  // <userId>.<notBefore>.<notAfter>.<classes>.<mac>
+  const char *fields[5];
+  fields[0] = payload + sizeof(QR_TOKEN_PREFIX) - 1;
+  for (size_t i = 1; i < 5; i++)
+  {
+    const char *dot = strchr(fields[i - 1], '.');
+    if (dot == nullptr)
+    {
+      return TOKEN_MALFORMED;
+    }
+    fields[i] = dot + 1;
+  }
+  const char *macText = fields[4];
+  size_t macLength = strlen(macText);
+  uint8_t mac[QR_TOKEN_MAC_BYTES];
+  uint32_t notBefore;
+  uint32_t notAfter;
+  // A user ID too long for userId is refused rather than cut to another user's
+  if (fields[1] - 1 == fields[0] || (size_t)(fields[1] - 1 - fields[0]) >= userIdSize || !parseSeconds(fields[1], fields[2] - 1, notBefore) ||
+      !parseSeconds(fields[2], fields[3] - 1, notAfter) || !decodeMac(macText, macLength, mac))
+  {
+    return TOKEN_MALFORMED;
+  }
+  if (!keyed)
+  {
+    return TOKEN_BAD_SIGNATURE;
+  }
+
+  uint8_t expected[32];
+  mbedtls_md_hmac_reset(&hmac);
+  mbedtls_md_hmac_update(&hmac, (const unsigned char *)payload, (size_t)(macText - 1 - payload));
+  mbedtls_md_hmac_finish(&hmac, expected);
+  // Constant time, so the comparison leaks nothing about how much matched
+  uint8_t difference = 0;
+  for (size_t i = 0; i < QR_TOKEN_MAC_BYTES; i++)
+  {
+    difference |= (uint8_t)(expected[i] ^ mac[i]);
+  }
+  if (difference != 0)
+  {
+    return TOKEN_BAD_SIGNATURE;
+  }
+
+  QrTokenStatus status = TOKEN_VALID;
+  if (now < earliestClock)
+  {
+    status = TOKEN_NO_CLOCK;
+  }
+  else if (now < notBefore)
+  {
+    return TOKEN_NOT_YET_VALID;
+  }
+  else if (now >= notAfter)
+  {
+    return TOKEN_EXPIRED;
+  }
+  copyField(fields[0], fields[1] - 1, userId, userIdSize);
+  if (copyField(fields[3], fields[4] - 1, classes, classesSize))
+  {
+    // Drop the class ID that was cut, so it cannot match a shorter one
+    char *lastComma = strrchr(classes, ',');
+    *(lastComma != nullptr ? lastComma : classes) = '\0';
+  }
+  return status;
+}
+
+bool QrTokenVerifier::allowsClass(const char *classes, const char *classId)
+{
+  if (strcmp(classes, "*") == 0)
+  {
+    return true;
+  }
+  size_t length = strlen(classId);
+  if (length == 0)
+  {
+    return false;
+  }
+  const char *entry = classes;
+  while (true)
+  {
+    if (strncmp(entry, classId, length) == 0 && (entry[length] == ',' || entry[length] == '\0'))
+    {
+      return true;
+    }
+    entry = strchr(entry, ',');
+    if (entry == nullptr)
+    {
+      return false;
+    }
+    entry++;
+  }
+}
+
+const char *QrTokenVerifier::statusName(QrTokenStatus status)
+{
+  switch (status)
+  {
+  case TOKEN_VALID:
+    return "valid";
+  case TOKEN_NO_CLOCK:
+    return "valid, clock not set";
+  case TOKEN_MALFORMED:
+    return "malformed";
+  case TOKEN_BAD_SIGNATURE:
+    return "bad signature";
+  case TOKEN_NOT_YET_VALID:
+    return "not yet valid";
+  case TOKEN_EXPIRED:
+    return "expired";
+  }
+  return "?";
+}
@@ -0,0 +1,200 @@
+#include "RecentScans.h"
+#include <string.h>
+
+static const uint32_t tickMask = (1u << (32 - RECENT_SCAN_TICK_SHIFT)) - 1; // millis() >> shift wraps here
+static const uint32_t longestCooldown = ((RECENT_SCAN_WHEEL_SLOTS - 1) << RECENT_SCAN_TICK_SHIFT) - 1;
+
+static void copyId(char *out, size_t outSize, const char *id)
+{
+  strncpy(out, id, outSize - 1);
+  out[outSize - 1] = '\0';
+}
+
+uint32_t RecentScans::hashId(const char *userId)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (const char *c = userId; *c != '\0'; c++)
+  {
+    h ^= (uint8_t)*c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void RecentScans::clear()
+{
+  for (size_t i = 0; i < RECENT_SCAN_ENTRIES; i++)
+  {
+    entries[i].used = false;
+  }
+  memset(buckets, -1, sizeof(buckets));
+  memset(slots, -1, sizeof(slots));
+  wheelTick = 0;
+  wheelStarted = false;
+}
+
+int8_t RecentScans::lookup(const char *userId)
+{
+  int8_t index = buckets[hashId(userId) & (RECENT_SCAN_BUCKETS - 1)];
+  while (index >= 0 && strcmp(entries[index].userId, userId) != 0)
+  {
+    index = entries[index].nextInBucket;
+  }
+  return index;
+}
+
+void RecentScans::unlinkSlot(int8_t index)
+{
+  Entry &entry = entries[index];
+  if (entry.prevInSlot >= 0)
+  {
+    entries[entry.prevInSlot].nextInSlot = entry.nextInSlot;
+  }
+  else
+  {
+    slots[(entry.expiresAt >> RECENT_SCAN_TICK_SHIFT) & (RECENT_SCAN_WHEEL_SLOTS - 1)] = entry.nextInSlot;
+  }
+  if (entry.nextInSlot >= 0)
+  {
+    entries[entry.nextInSlot].prevInSlot = entry.prevInSlot;
+  }
+}
+
+void RecentScans::release(int8_t index)
+{
+  unlinkSlot(index);
+  int8_t *link = &buckets[hashId(entries[index].userId) & (RECENT_SCAN_BUCKETS - 1)];
+  while (*link != index)
+  {
+    link = &entries[*link].nextInBucket;
+  }
+  *link = entries[index].nextInBucket;
+  entries[index].used = false;
+}
+
+// Hangs the entry in the wheel slot of the tick its cooldown ends in.
+void RecentScans::arm(int8_t index, uint32_t now, uint32_t cooldown)
+{
+  Entry &entry = entries[index];
+  entry.expiresAt = now + (cooldown < longestCooldown ? cooldown : longestCooldown);
+  int8_t &head = slots[(entry.expiresAt >> RECENT_SCAN_TICK_SHIFT) & (RECENT_SCAN_WHEEL_SLOTS - 1)];
+  entry.prevInSlot = -1;
+  entry.nextInSlot = head;
+  if (head >= 0)
+  {
+    entries[head].prevInSlot = index;
+  }
+  head = index;
+}
+
+// Turns the wheel to now, freeing every entry in the slots it passes.
+void RecentScans::advance(uint32_t now)
+{
+  uint32_t tick = (now >> RECENT_SCAN_TICK_SHIFT) & tickMask;
+  if (!wheelStarted)
+  {
+    wheelTick = tick;
+    wheelStarted = true;
+    return;
+  }
+  uint32_t steps = (tick - wheelTick) & tickMask;
+  if (steps > RECENT_SCAN_WHEEL_SLOTS)
+  {
+    steps = RECENT_SCAN_WHEEL_SLOTS; // a full turn empties the wheel
+  }
+  for (uint32_t i = 0; i < steps; i++)
+  {
+    int8_t &head = slots[(wheelTick + i) & (RECENT_SCAN_WHEEL_SLOTS - 1)];
+    while (head >= 0)
+    {
+      release(head);
+    }
+  }
+  wheelTick = tick;
+}
+
+int8_t RecentScans::allocate()
+{
+  for (int8_t i = 0; i < RECENT_SCAN_ENTRIES; i++)
+  {
+    if (!entries[i].used)
+    {
+      return i;
+    }
+  }
+  // Full: the first occupied slot from the current tick on expires soonest
+  for (uint32_t i = 0; i < RECENT_SCAN_WHEEL_SLOTS; i++)
+  {
+    int8_t head = slots[(wheelTick + i) & (RECENT_SCAN_WHEEL_SLOTS - 1)];
+    if (head >= 0)
+    {
+      release(head);
+      return head;
+    }
+  }
+  return 0; // unreachable: every used entry is in a slot
+}
+
+bool RecentScans::find(const char *userId, const char *classId, uint32_t now, RecentDecision &decision)
+{
+  advance(now);
+  int8_t index = lookup(userId);
+  if (index < 0)
+  {
+    return false;
+  }
+  const Entry &entry = entries[index];
+  if ((int32_t)(now - entry.expiresAt) >= 0 || strcmp(entry.classId, classId) != 0)
+  {
+    return false;
+  }
+  decision.outcome = entry.outcome;
+  decision.message = entry.message;
+  return true;
+}
+
+void RecentScans::begin(const char *userId, const char *classId, uint32_t now, uint32_t cooldown)
+{
+  advance(now);
+  int8_t index = lookup(userId);
+  if (index >= 0)
+  {
+    unlinkSlot(index);
+  }
+  else
+  {
+    index = allocate();
+    Entry &entry = entries[index];
+    copyId(entry.userId, sizeof(entry.userId), userId);
+    int8_t &bucket = buckets[hashId(entry.userId) & (RECENT_SCAN_BUCKETS - 1)];
+    entry.nextInBucket = bucket;
+    bucket = index;
+    entry.used = true;
+  }
+  Entry &entry = entries[index];
+  copyId(entry.classId, sizeof(entry.classId), classId);
+  entry.outcome = RECENT_PENDING;
+  entry.message = nullptr;
+  arm(index, now, cooldown);
+}
+
+void RecentScans::settle(const char *userId, RecentOutcome outcome, const char *message, uint32_t now,
+                         uint32_t cooldown)
+{
+  advance(now);
+  int8_t index = lookup(userId);
+  if (index < 0)
+  {
+    return;
+  }
+  Entry &entry = entries[index];
+  if (entry.outcome != RECENT_PENDING && outcome <= entry.outcome)
+  {
+    return;
+  }
+  entry.outcome = outcome;
+  entry.message = message;
+  unlinkSlot(index);
+  arm(index, now, cooldown);
+}
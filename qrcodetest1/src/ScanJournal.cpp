@@ -0,0 +1,289 @@
+#include "ScanJournal.h"
+#include "Log.h"
+#include <esp32/rom/crc.h>
+#include <esp_random.h>
+
+static const uint32_t journalMagic = 0x4A524E4C; // "JRNL"
+
+struct AckRecord
+{
+  uint32_t tail;
+  uint32_t crc;
+};
+
+bool ScanJournal::begin(fs::FS &filesystem, const char *path, size_t slots)
+{
+  fs = &filesystem;
+  capacity = slots;
+  bootId = esp_random() | 1;
+  ackPath = String(path) + ".ack";
+  if (lock == nullptr)
+  {
+    lock = xSemaphoreCreateMutex();
+  }
+
+  // Preallocate the ring once so appends never grow the file.
+  const size_t fileSize = capacity * sizeof(Record);
+  if (!fs->exists(path) || fs->open(path, "r").size() != fileSize)
+  {
+    fs::File init = fs->open(path, "w");
+    if (!init)
+    {
+      LOG_ERROR("Failed to create scan journal");
+      return false;
+    }
+    Record empty;
+    memset(&empty, 0, sizeof(empty));
+    for (size_t i = 0; i < capacity; i++)
+    {
+      init.write((const uint8_t *)&empty, sizeof(empty));
+    }
+    init.close();
+  }
+
+  file = fs->open(path, "r+");
+  if (!file)
+  {
+    LOG_ERROR("Failed to open scan journal");
+    return false;
+  }
+
+  // Recover the write position from the highest valid sequence number.
+  bool found = false;
+  uint32_t maxSeq = 0;
+  for (size_t slot = 0; slot < capacity; slot++)
+  {
+    Record record;
+    file.seek(slot * sizeof(Record));
+    if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record))
+    {
+      break;
+    }
+    if (record.magic != journalMagic || record.crc != recordCrc(record) || record.seq % capacity != slot)
+    {
+      continue;
+    }
+    if (!found || (int32_t)(record.seq - maxSeq) > 0)
+    {
+      maxSeq = record.seq;
+      found = true;
+    }
+  }
+  head = found ? maxSeq + 1 : 0;
+
+  tail = head;
+  fs::File ackFile = fs->open(ackPath, "r");
+  if (ackFile)
+  {
+    AckRecord ackRecord;
+    if (ackFile.read((uint8_t *)&ackRecord, sizeof(ackRecord)) == sizeof(ackRecord) &&
+        ackRecord.crc == crc32_le(0, (const uint8_t *)&ackRecord.tail, sizeof(ackRecord.tail)))
+    {
+      tail = ackRecord.tail;
+    }
+    ackFile.close();
+  }
+  if ((int32_t)(head - tail) < 0)
+  {
+    tail = head;
+  }
+  if (head - tail > capacity)
+  {
+    tail = head - capacity;
+  }
+
+  // Events held for a clock sync that never came before the last reboot
+  // have only the restored time to go on; they are delivered with it.
+  unsigned unverified = 0;
+  for (uint32_t seq = tail; seq != head; seq++)
+  {
+    Record record;
+    if (readSlot(seq, record) && record.event.clockUnverified)
+    {
+      unverified++;
+    }
+  }
+  if (unverified > 0)
+  {
+    LOG_WARNF("%u journaled scan(s) stamped by an unsynced clock before the last reboot\n", unverified);
+  }
+
+  LOG_INFOF("Scan journal ready: %u pending event(s)\n", (unsigned)(head - tail));
+  return true;
+}
+
+bool ScanJournal::append(const ScanEvent &event)
+{
+  if (!file)
+  {
+    return false;
+  }
+
+  Record record;
+  record.magic = journalMagic;
+  record.event = event;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  record.seq = head;
+  record.event.clockUnverified = holding;
+  record.event.uptime = millis();
+  record.event.bootId = bootId;
+  bool ok = writeSlot(record);
+  file.flush();
+  if (ok)
+  {
+    head++;
+    if (head - tail > capacity)
+    {
+      tail = head - capacity;
+      LOG_WARN("Scan journal full, oldest unsent event dropped");
+    }
+  }
+  xSemaphoreGive(lock);
+  return ok;
+}
+
+size_t ScanJournal::pending()
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  size_t count = head - tail;
+  xSemaphoreGive(lock);
+  return count;
+}
+
+uint32_t ScanJournal::firstPending()
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  uint32_t seq = tail;
+  xSemaphoreGive(lock);
+  return seq;
+}
+
+size_t ScanJournal::peekFrom(uint32_t from, ScanEvent *out, uint32_t *seqs, size_t max)
+{
+  size_t count = 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if ((int32_t)(from - tail) < 0 || (int32_t)(head - from) < 0)
+  {
+    from = tail;
+  }
+  for (uint32_t seq = from; seq != head && count < max; seq++)
+  {
+    Record record;
+    // Torn records are skipped; ackThrough() passes over them too
+    if (readSlot(seq, record))
+    {
+      if (heldBack(record))
+      {
+        break;
+      }
+      out[count] = record.event;
+      seqs[count++] = seq;
+    }
+    else if (seq == tail)
+    {
+      // Torn or overwritten record at the front: nothing to deliver.
+      tail++;
+    }
+  }
+  xSemaphoreGive(lock);
+  return count;
+}
+
+void ScanJournal::ackThrough(uint32_t seq)
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if ((int32_t)(seq - tail) >= 0 && (int32_t)(head - seq) > 0)
+  {
+    tail = seq + 1;
+    saveAck();
+  }
+  xSemaphoreGive(lock);
+}
+
+void ScanJournal::holdForClock()
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  holding = true;
+  xSemaphoreGive(lock);
+}
+
+void ScanJournal::restamp(uint32_t now, uint32_t nowUptime)
+{
+  unsigned restamped = 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  for (uint32_t seq = tail; seq != head; seq++)
+  {
+    Record record;
+    if (readSlot(seq, record) && record.event.clockUnverified && record.event.bootId == bootId)
+    {
+      record.event.timestamp = now - (nowUptime - record.event.uptime) / 1000;
+      record.event.clockUnverified = 0;
+      if (writeSlot(record))
+      {
+        restamped++;
+      }
+    }
+  }
+  file.flush();
+  holding = false;
+  released = false;
+  xSemaphoreGive(lock);
+  if (restamped > 0)
+  {
+    LOG_INFOF("Restamped %u scan(s) journaled before the clock synced\n", restamped);
+  }
+}
+
+bool ScanJournal::releaseHeld()
+{
+  xSemaphoreTake(lock, portMAX_DELAY);
+  bool wasHeld = holding && !released;
+  released = true;
+  xSemaphoreGive(lock);
+  if (wasHeld)
+  {
+    LOG_WARN("Clock still not synced, releasing held scans marked clock unverified");
+  }
+  return wasHeld;
+}
+
+bool ScanJournal::heldBack(const Record &record) const
+{
+  return record.event.clockUnverified && record.event.bootId == bootId && !released;
+}
+
+bool ScanJournal::writeSlot(Record &record)
+{
+  record.crc = recordCrc(record);
+  return file.seek((record.seq % capacity) * sizeof(Record)) &&
+         file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record);
+}
+
+bool ScanJournal::readSlot(uint32_t seq, Record &record)
+{
+  if (!file.seek((seq % capacity) * sizeof(Record)) ||
+      file.read((uint8_t *)&record, sizeof(record)) != sizeof(record))
+  {
+    return false;
+  }
+  return record.magic == journalMagic && record.seq == seq && record.crc == recordCrc(record);
+}
+
+void ScanJournal::saveAck()
+{
+  AckRecord ackRecord;
+  ackRecord.tail = tail;
+  ackRecord.crc = crc32_le(0, (const uint8_t *)&ackRecord.tail, sizeof(ackRecord.tail));
+  fs::File ackFile = fs->open(ackPath, "w");
+  if (ackFile)
+  {
+    ackFile.write((const uint8_t *)&ackRecord, sizeof(ackRecord));
+    ackFile.close();
+  }
+}
+
+uint32_t ScanJournal::recordCrc(const Record &record)
+{
+  return crc32_le(0, (const uint8_t *)&record, offsetof(Record, crc));
+}
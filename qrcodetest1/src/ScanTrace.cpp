@@ -0,0 +1,151 @@
+#include "ScanTrace.h"
+
+static const char *const stageNames[TRACE_STAGE_COUNT] = {
+    "decode", "decode-hex", "token-verify", "enrollment", "name-fetch", "attendance-write", "timeout-update", "relay",
+};
+
+const char *ScanTrace::stageName(TraceStage stage)
+{
+  return stage < TRACE_STAGE_COUNT ? stageNames[stage] : "?";
+}
+
+uint32_t ScanTrace::beginScan(int64_t capturedAt)
+{
+  uint32_t scanId = nextScan.fetch_add(1, std::memory_order_relaxed);
+  if (scanId == 0)
+  {
+    // 0 means "no scan"; skip it when the counter wraps
+    scanId = nextScan.fetch_add(1, std::memory_order_relaxed);
+  }
+  size_t slot = scanId & (TRACE_SCAN_SLOTS - 1);
+  scanStarts[slot].store(capturedAt, std::memory_order_relaxed);
+  scanIds[slot].store(scanId, std::memory_order_release);
+  return scanId;
+}
+
+void ScanTrace::recordSinceCapture(TraceStage stage, uint32_t scanId)
+{
+  size_t slot = scanId & (TRACE_SCAN_SLOTS - 1);
+  if (scanId == 0 || scanIds[slot].load(std::memory_order_acquire) != scanId)
+  {
+    return; // too old; its slot went to a newer scan
+  }
+  record(stage, scanId, scanStarts[slot].load(std::memory_order_relaxed));
+}
+
+size_t ScanTrace::bucketFor(uint32_t duration)
+{
+  size_t bucket = 0;
+  while (bucket < TRACE_HISTOGRAM_BUCKETS - 1 && duration >= bucketLimit(bucket))
+  {
+    bucket++;
+  }
+  return bucket;
+}
+
+uint32_t ScanTrace::bucketLimit(size_t bucket)
+{
+  return 250u << bucket;
+}
+
+void ScanTrace::record(TraceStage stage, uint32_t scanId, int64_t start, int64_t end)
+{
+  if (stage >= TRACE_STAGE_COUNT)
+  {
+    return;
+  }
+  int64_t elapsed = end - start;
+  uint32_t duration = elapsed < 0 ? 0 : (elapsed > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+
+  histogram[stage][bucketFor(duration)].fetch_add(1, std::memory_order_relaxed);
+  uint32_t previous = longest[stage].load(std::memory_order_relaxed);
+  while (duration > previous && !longest[stage].compare_exchange_weak(previous, duration, std::memory_order_relaxed))
+  {
+  }
+
+  // Claim a slot, mark it torn while filling it, then publish it
+  uint32_t index = ringHead.fetch_add(1, std::memory_order_relaxed);
+  Record &slot = ring[index & (TRACE_RING_SIZE - 1)];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.scanId = scanId;
+  slot.duration = duration;
+  slot.at = millis();
+  slot.stage = stage;
+  slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void ScanTrace::reset()
+{
+  for (size_t stage = 0; stage < TRACE_STAGE_COUNT; stage++)
+  {
+    for (size_t bucket = 0; bucket < TRACE_HISTOGRAM_BUCKETS; bucket++)
+    {
+      histogram[stage][bucket].store(0, std::memory_order_relaxed);
+    }
+    longest[stage].store(0, std::memory_order_relaxed);
+  }
+  for (size_t i = 0; i < TRACE_RING_SIZE; i++)
+  {
+    ring[i].sequence.store(0, std::memory_order_relaxed);
+  }
+}
+
+// Upper limit of the bucket holding the rank-th (1-based) fastest record,
+// capped by the longest time seen.
+uint32_t ScanTrace::percentile(TraceStage stage, uint32_t rank)
+{
+  uint32_t longestTime = longest[stage].load(std::memory_order_relaxed);
+  uint32_t seen = 0;
+  for (size_t bucket = 0; bucket < TRACE_HISTOGRAM_BUCKETS - 1; bucket++)
+  {
+    seen += histogram[stage][bucket].load(std::memory_order_relaxed);
+    if (seen >= rank)
+    {
+      return min(bucketLimit(bucket), longestTime);
+    }
+  }
+  return longestTime;
+}
+
+void ScanTrace::dump(Print &out)
+{
+  out.println("# recent: scan stage us at_ms");
+  uint32_t head = ringHead.load(std::memory_order_acquire);
+  uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+  for (uint32_t index = first; index < head; index++)
+  {
+    Record &slot = ring[index & (TRACE_RING_SIZE - 1)];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    uint32_t scanId = slot.scanId;
+    uint32_t duration = slot.duration;
+    uint32_t at = slot.at;
+    uint8_t stage = slot.stage;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence != index + 1 || slot.sequence.load(std::memory_order_relaxed) != sequence)
+    {
+      continue; // reset, overwritten or still being written
+    }
+    out.printf("%u %s %u %u\n", (unsigned)scanId, stageName((TraceStage)stage), (unsigned)duration, (unsigned)at);
+  }
+
+  // Percentiles are bucket limits: "p50 1000" means half took under 1 ms
+  out.println("# histograms: stage count p50_us p90_us p99_us max_us");
+  for (size_t i = 0; i < TRACE_STAGE_COUNT; i++)
+  {
+    TraceStage stage = (TraceStage)i;
+    uint32_t count = 0;
+    for (size_t bucket = 0; bucket < TRACE_HISTOGRAM_BUCKETS; bucket++)
+    {
+      count += histogram[stage][bucket].load(std::memory_order_relaxed);
+    }
+    if (count == 0)
+    {
+      continue;
+    }
+    out.printf("%s %u %u %u %u %u\n", stageName(stage), (unsigned)count, (unsigned)percentile(stage, (count + 1) / 2),
+               (unsigned)percentile(stage, (count * 9 + 9) / 10),
+               (unsigned)percentile(stage, (count * 99 + 99) / 100),
+               (unsigned)longest[stage].load(std::memory_order_relaxed));
+  }
+}
@@ -0,0 +1,143 @@
+#include "ScheduleStream.h"
+#include "Log.h"
+#include <WiFi.h>
+
+// Firebase sends a keep-alive event every 30 s; twice that without any data
+// means the stream is dead even if the socket still looks open.
+static const unsigned long streamTimeout = 65000;
+static const unsigned long reconnectInterval = 30000;
+static const size_t maxLineLength = 16384;
+
+void ScheduleStream::begin(const char *baseUrl, const String &path, EventHandler onEvent)
+{
+  url = String(baseUrl) + path;
+  handler = onEvent;
+  secureClient.setInsecure();
+  client = url.startsWith("http://") ? &plainClient : (WiFiClient *)&secureClient;
+}
+
+void ScheduleStream::stop()
+{
+  if (streaming)
+  {
+    LOG_WARN("Schedule stream closed, falling back to polling");
+  }
+  streaming = false;
+  http.end();
+  client->stop();
+  line = "";
+  eventName = "";
+  eventData = "";
+}
+
+void ScheduleStream::loop()
+{
+  if (!streaming)
+  {
+    if (WiFi.status() == WL_CONNECTED && (!attempted || millis() - lastAttempt >= reconnectInterval))
+    {
+      connect();
+    }
+    return;
+  }
+
+  WiFiClient *stream = http.getStreamPtr();
+  if (stream == nullptr || (!stream->connected() && stream->available() == 0))
+  {
+    stop();
+    return;
+  }
+
+  while (stream->available() > 0)
+  {
+    char c = (char)stream->read();
+    lastActivity = millis();
+    if (c == '\n')
+    {
+      processLine(line);
+      line = "";
+      if (!streaming)
+      {
+        return;
+      }
+    }
+    else if (c != '\r')
+    {
+      if (line.length() >= maxLineLength)
+      {
+        LOG_WARN("Schedule stream line too long");
+        stop();
+        return;
+      }
+      line += c;
+    }
+  }
+
+  if (millis() - lastActivity > streamTimeout)
+  {
+    LOG_WARN("Schedule stream timed out");
+    stop();
+  }
+}
+
+bool ScheduleStream::connect()
+{
+  attempted = true;
+  lastAttempt = millis();
+
+  http.begin(*client, url);
+  // HTTP/1.0 keeps the server from chunking the response, so the event
+  // lines can be read straight off the socket.
+  http.useHTTP10(true);
+  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+  http.addHeader("Accept", "text/event-stream");
+  int httpCode = http.GET();
+  if (httpCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Schedule stream failed to open. HTTP error code: %d\n", httpCode);
+    http.end();
+    client->stop();
+    return false;
+  }
+
+  LOG_INFO("Schedule stream connected");
+  streaming = true;
+  lastActivity = millis();
+  return true;
+}
+
+void ScheduleStream::processLine(const String &text)
+{
+  if (text.isEmpty())
+  {
+    // A blank line ends the event
+    if (!eventName.isEmpty())
+    {
+      if (eventName == "cancel" || eventName == "auth_revoked")
+      {
+        LOG_WARN("Schedule stream ended by server: " + eventName);
+        stop();
+        return;
+      }
+      if (eventName != "keep-alive" && handler != nullptr && !handler(eventName, eventData))
+      {
+        LOG_WARN("Schedule event not applied: " + eventName);
+        stop();
+        return;
+      }
+    }
+    eventName = "";
+    eventData = "";
+  }
+  else if (text.startsWith("event:"))
+  {
+    eventName = text.substring(6);
+    eventName.trim();
+  }
+  else if (text.startsWith("data:"))
+  {
+    String data = text.substring(5);
+    data.trim();
+    eventData += data;
+  }
+}
@@ -0,0 +1,124 @@
+#include "StatusDisplay.h"
+#include <Wire.h>
+
+static const TickType_t clockInterval = 1000 / portTICK_PERIOD_MS;
+static const TickType_t settleTime = 20 / portTICK_PERIOD_MS; // lets a burst of updates land together
+static const uint8_t pageChunk = 16;                         // data bytes per I2C write, well inside the Wire buffer
+
+bool StatusDisplay::begin(Adafruit_SSD1306 &oled, uint8_t i2cAddress, const char *room, BaseType_t core)
+{
+  display = &oled;
+  address = i2cAddress;
+  strncpy(wanted[DISPLAY_LINE_ROOM], room, DISPLAY_LINE_CHARS - 1);
+  queue = xQueueCreate(DISPLAY_QUEUE_LENGTH, sizeof(Update));
+  if (queue == nullptr)
+  {
+    return false;
+  }
+  return xTaskCreatePinnedToCore(task, "display", 3 * 1024, this, 1, NULL, core) == pdPASS;
+}
+
+bool StatusDisplay::setLine(DisplayLine line, const char *text)
+{
+  if (queue == nullptr || line >= DISPLAY_LINES)
+  {
+    return false;
+  }
+  Update update;
+  update.line = line;
+  strncpy(update.text, text, sizeof(update.text) - 1);
+  update.text[sizeof(update.text) - 1] = '\0';
+  return xQueueSend(queue, &update, 0) == pdTRUE;
+}
+
+void StatusDisplay::task(void *arg)
+{
+  static_cast<StatusDisplay *>(arg)->run();
+}
+
+void StatusDisplay::run()
+{
+  Update update;
+  while (true)
+  {
+    if (xQueueReceive(queue, &update, clockInterval) == pdTRUE)
+    {
+      vTaskDelay(settleTime);
+      apply(update);
+      while (xQueueReceive(queue, &update, 0) == pdTRUE)
+      {
+        apply(update);
+      }
+    }
+    updateClock();
+    render();
+  }
+}
+
+void StatusDisplay::apply(const Update &update)
+{
+  strncpy(wanted[update.line], update.text, DISPLAY_LINE_CHARS);
+}
+
+void StatusDisplay::updateClock()
+{
+  struct tm timeinfo;
+  // Never wait for NTP here; an unsynced clock just shows as an error
+  if (!getLocalTime(&timeinfo, 0))
+  {
+    strncpy(wanted[DISPLAY_LINE_CLOCK], "Error", DISPLAY_LINE_CHARS);
+    return;
+  }
+  snprintf(wanted[DISPLAY_LINE_CLOCK], DISPLAY_LINE_CHARS, "%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min);
+}
+
+void StatusDisplay::render()
+{
+  if (!cleared)
+  {
+    // First frame: start from a blank panel so every page is known
+    display->clearDisplay();
+    display->setTextSize(1);
+    display->setTextColor(SSD1306_WHITE);
+    display->setTextWrap(false);
+    display->display();
+    memset(shown, 0, sizeof(shown));
+    cleared = true;
+  }
+
+  for (uint8_t line = 0; line < DISPLAY_LINES; line++)
+  {
+    if (strcmp(wanted[line], shown[line]) == 0)
+    {
+      continue;
+    }
+    display->fillRect(0, line * 8, display->width(), 8, SSD1306_BLACK);
+    display->setCursor(0, line * 8);
+    display->print(wanted[line]);
+    flushPage(line);
+    memcpy(shown[line], wanted[line], DISPLAY_LINE_CHARS);
+  }
+}
+
+// Sends one 8-pixel page of the frame buffer instead of the whole frame.
+void StatusDisplay::flushPage(uint8_t page)
+{
+  const uint8_t width = display->width();
+  display->ssd1306_command(SSD1306_PAGEADDR);
+  display->ssd1306_command(page);
+  display->ssd1306_command(page);
+  display->ssd1306_command(SSD1306_COLUMNADDR);
+  display->ssd1306_command(0);
+  display->ssd1306_command(width - 1);
+
+  const uint8_t *data = display->getBuffer() + page * width;
+  Wire.setClock(400000);
+  for (uint8_t offset = 0; offset < width; offset += pageChunk)
+  {
+    Wire.beginTransmission(address);
+    Wire.write((uint8_t)0x40); // Co = 0, D/C = 1: data follows
+    Wire.write(data + offset, pageChunk);
+    Wire.endTransmission();
+  }
+  Wire.setClock(100000);
+}
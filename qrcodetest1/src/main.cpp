@@ -7,23 +7,106 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <WiFiMulti.h>
+#include "BackendClient.h"
+#include "EnrollmentRoster.h"
+#include "NameCache.h"
+#include "ScanJournal.h"
+#include "OpenLogIndex.h"
+#include "ClassSchedule.h"
+#include "ScheduleStream.h"
+#include "ScanPipeline.h"
+#include "Actuator.h"
+#include "StatusDisplay.h"
+#include "QrScanner.h"
+#include "ScanTrace.h"
+#include "QrToken.h"
+#include "RecentScans.h"
+#include "PowerManager.h"
+#include "BootCache.h"
+#include "GatewayLink.h"
+#include "MemoryArena.h"
+#include "HeapMonitor.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <esp_sntp.h>
+#include <esp_random.h>
+#include <sys/time.h>
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 32
 #define OLED_RESET -1
 #define RELAY_PIN 13
 #define BUZZER_PIN 2 // Passive buzzer connected to GPIO12
+// LEDC channel 0 (timer 0) clocks the camera, so the buzzer uses channel 2 (timer 1)
+#define BUZZER_CHANNEL 2
 
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+StatusDisplay statusDisplay; // Owns the OLED once setup() is done with it
 WiFiMulti wifiMulti;
 
+struct KnownAp
+{
+  const char *ssid;
+  const char *password;
+};
+const KnownAp knownAps[] = {
+    {"Oo", "Cyclone1"},
+    {"HUAWEI-2.4G-4uG9", "qZnbt34c"},
+};
+const size_t knownApCount = sizeof(knownAps) / sizeof(knownAps[0]);
+// Reuse the last DHCP lease as a static address on the next boot, saving
+// the DHCP exchange. Only safe where the router reserves the address.
+const bool reuseLastAddress = false;
+const unsigned long wifiRetryInterval = 10000; // ms without a link before WiFiMulti scans again
+unsigned long lastWiFiAttempt = 0;
+bool wifiWasConnected = false;
+
+// Fast boot: no buzzer and relay self-tests (send 's' over serial to have
+// the next boot run them), the camera starts first, and WiFi, the schedule,
+// the roster and the clock come from the last boot's copies (BootCache.h)
+// until the network catches up. Time to first scan is in the trace dump.
+const bool fastBoot = true;
+bool bootSelfTest = false;
+BootCache bootCache;
+struct BootTimes
+{
+  uint32_t ready; // ms after boot: setup() done, scans decided
+  uint32_t wifi;  // first WiFi link
+  uint32_t clock; // first NTP sync
+} bootTimes = {0, 0, 0};
+volatile bool clockSyncPending = false;
+volatile bool clockRestored = false; // running from the time saved in NVS until NTP syncs
+const time_t validClockEpoch = 1700000000;       // earlier than this, the clock was never set
+const unsigned long heldScanRelease = 6 * 3600000UL; // ms of uptime without NTP before held scans go out marked
+const unsigned long clockSaveInterval = 600000;  // ms between saves of the time to NVS
+unsigned long lastClockSave = 0;
+BackendClient backend; // Shared keep-alive HTTPS connection for all Firebase calls
+Actuator actuator;     // Buzzer and relay, timer-driven so feedback never blocks a task
+
 const String scannerIdTimeIn = "room_1_esp32cam_2";  // For time-in scans
 const String scannerIdTimeOut = "room_1_esp32cam_2"; // For time-out scans (or any other value)
 
-const char *apiUrl = "YOUR API URL HERE";
+// The native build points this at tools/mock-firebase.js
+#ifndef BACKEND_URL
+#define BACKEND_URL "YOUR API URL HERE"
+#endif
+const char *apiUrl = BACKEND_URL;
+const char *roomName = "Test Room 1";
+
+// Key for signed QR codes, in hex: the functions config value qrtoken.key.
+// Without it every signed code is refused.
+#ifndef QR_TOKEN_KEY
+#define QR_TOKEN_KEY ""
+#endif
+// Codes holding just the hex user ID, from before signed codes. Anyone can
+// print one; turn this off once every student has a signed code.
+const bool acceptUnsignedCodes = true;
+QrTokenVerifier tokenVerifier;
 
 // Define QR code reader, time offsets, etc.
-ESP32QRCodeReader reader(CAMERA_MODEL_AI_THINKER);
+ESP32QRCodeReader reader(CAMERA_MODEL_AI_THINKER); // camera setup only
+QrScanner qrScanner;                               // motion-gated decode task
+const uint32_t motionHoldOff = 3000;               // ms of decoding after the last motion or decoded code
 const long gmtOffsetSec = 8 * 3600;
 const int daylightOffsetSec = 0;
 
@@ -34,75 +117,364 @@ bool activeClassFound = false;
 volatile bool scanningEnabled = true; // Global flag to control scanning
 String lastActiveClassId = "";
 
+// The active class as the decision task sees it. The Strings above belong to
+// the loop task, which copies them in here under classLock whenever they
+// change; the decision task takes one copy per message (currentClass()).
+struct ClassState
+{
+  bool found;
+  char activeId[32]; // ClassSchedule IDs and names
+  char lastId[32];
+  char name[48];
+};
+ClassState publishedClass = {false, "", "", ""};
+SemaphoreHandle_t classLock = NULL;
+
+// This room's classes compiled from classes.json. Rebuilt only when the
+// classesMeta/version node (bumped by the bumpClassesVersion cloud function)
+// or, failing that, the ETag of classes.json changes.
+RoomClassList roomClasses;
+ClassSchedule schedule;
+bool scheduleLoaded = false;
+String scheduleVersion = "";
+String classesEtag = "";
+
+// classes.json is queried by room so that only this room's classes are sent.
+// Needs ".indexOn": "room" on /classes in the database rules; without it
+// Firebase answers 400 and the firmware falls back to the whole node.
+bool roomQuerySupported = true;
+const size_t classDocCapacity = JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(7) + 128;
+const size_t classesDocCapacity = JSON_OBJECT_SIZE(MAX_ROOM_CLASSES) + MAX_ROOM_CLASSES * classDocCapacity;
+
+// Optional push mode: hold an event stream on the classes node and apply
+// edits as they happen. Polling takes over whenever the stream is down.
+const bool useScheduleStream = true;
+ScheduleStream scheduleStream;
+
+// Roster of the active class, checked locally on every scan. Rebuilt by loop()
+// when the active class changes and every rosterRefreshInterval after that.
+EnrollmentRoster activeRoster;
+SemaphoreHandle_t rosterLock = NULL;
+String rosterClassId = "";
+unsigned long lastRosterFetch = 0;
+volatile bool rosterRefreshRequested = false;
+const unsigned long rosterRefreshInterval = 300000; // 5 minutes
+const size_t rosterDocCapacity = 8192;               // about 120 students with their names
+
+// Display names for the serial log. The roster brings the active class's
+// names along; anyone else is looked up by the network stage after the
+// door has opened and kept for next time.
+NameCache userNames(3600000); // names older than an hour are looked up again
+SemaphoreHandle_t userNamesLock = NULL;
+
+// Scans are journaled to flash and delivered by networkTask, so the
+// scan path never waits on a backend write and no scan is lost offline.
+ScanJournal scanJournal;
+const size_t journalCapacity = 256;      // events kept while offline
+const size_t journalUploadBatch = 8;     // events sent per upload pass
+
+// Logs this scanner opened, so a time-out is a single PATCH of a known log
+// instead of a search through the user's attendance history.
+OpenLogIndex openLogs;
+const uint32_t openLogLifetime = 16 * 3600; // s; older open logs are looked up again
+const unsigned long journalRetryInterval = 5000;
+// Held while journaled events are being delivered, so the gateway link and
+// networkTask never deliver (and ack) the same events at once.
+SemaphoreHandle_t journalUploadLock = NULL;
+
+// Optional on-prem edge gateway (see GatewayLink.h and tools/edge-gateway.js).
+// While its link is up, scans are streamed to it and it pushes schedule and
+// roster changes, all over one WebSocket; Firebase is used directly while it
+// is down. Leave GATEWAY_HOST empty to talk to Firebase only. GATEWAY_KEY
+// is the hex key shared with the gateway (its --key); without it the
+// gateway is not used.
+#ifndef GATEWAY_HOST
+#define GATEWAY_HOST ""
+#endif
+#ifndef GATEWAY_PORT
+#define GATEWAY_PORT 8090
+#endif
+#ifndef GATEWAY_KEY
+#define GATEWAY_KEY ""
+#endif
+const char *gatewayHost = GATEWAY_HOST;
+const uint16_t gatewayPort = GATEWAY_PORT;
+bool useGateway = gatewayHost[0] != '\0';
+GatewayLink gatewayLink;
+const size_t gatewayWindow = 8; // events sent ahead of the gateway's acks
+uint32_t gatewayNextSeq = 0;    // journal sequence number of the next event to send
+
+// Backend requests off the scan path are built in stack buffers of these sizes
+const size_t encodedUserIdSize = sizeof(NetworkJob::userId) * 3;
+const size_t encodedClassIdSize = sizeof(NetworkJob::classId) * 3;
+const size_t backendPathSize = 320; // logins/<user>/enrolledClasses/<class>/attendanceLogs/<key>.json
+const size_t backendBodySize = 512;
+const int openLogSearchDepth = 8; // newest attendance logs searched for an open one
+
+// Large JSON documents and mbedTLS's record buffers borrow preallocated
+// blocks (MemoryArena.h) instead of churning the heap. Two JSON blocks: a
+// schedule event re-reads a class while its own document is alive, and a
+// gateway frame's payload is held while its document is. A block fits the
+// largest document, a full room's classes.json (classesDocCapacity); check
+// peak_bytes and fallbacks in the trace dump before changing the sizes.
+MemoryArena jsonArena("json");
+const size_t jsonArenaBlock = 12288;
+const size_t jsonArenaBlocks = 2;
+// 16 KB in and 4 KB out per connection, for the backend connection and the
+// schedule stream. PSRAM only: in internal RAM the blocks would be held even
+// while no connection needs them.
+MemoryArena tlsArena("tls");
+const size_t tlsArenaBlock = 17408;
+const size_t tlsArenaBlocks = 4;
+const size_t tlsArenaMinimum = 4096; // smaller mbedTLS allocations stay on the heap
+HeapMonitor heapMonitor;
+const uint32_t heapWarnLargestBlock = 24576; // below this a TLS handshake may not fit
+
+// Scan pipeline queues (see ScanPipeline.h)
+QueueHandle_t decisionQueue = NULL;
+QueueHandle_t networkQueue = NULL;
+volatile uint32_t droppedScans = 0;
+// Last time the decode stage saw a given code, to tell a new presentation
+// from the same code still in view.
+volatile uint64_t lastCodeHash = 0;
+volatile unsigned long lastCodeSeen = 0;
+const unsigned long codeRemovalThreshold = 2000; // a code counts again after this long out of view
+const uint32_t doorOpenTime = 2000;              // ms the relay stays open per admitted scan
+// The hall pass holding the door, by the low half of its code hash (one
+// word, so the decode stage never reads it torn), and when the decode
+// stage last saw that code; other codes in view do not keep the door.
+volatile bool hallPassHeld = false;
+volatile uint32_t hallPassCode = 0;
+volatile unsigned long hallPassSeen = 0;
+// A user scanned again within this of their last decision gets that
+// decision again, without another roster lookup or backend round trip.
+const unsigned long userCooldownPeriod = 5000;
+RecentScans recentScans;
+
+// Burst entry: for the first burstEntryLength minutes of a class the door
+// is held open, and an admitted scan gets a short chirp and a journaled
+// time-in instead of a door cycle, so the queue at the start of a period
+// keeps moving. loop() decides when (see updateActiveClass); the decision
+// stage holds and releases the door.
+const bool burstEntryEnabled = true;
+const int burstEntryLength = 10;            // min from class start
+const uint16_t burstChirpFrequency = 2500;  // Hz
+const uint16_t burstChirpDuration = 60;     // ms
+bool burstEntryRequested = false; // loop(): the state last sent to the decision stage
+bool burstEntry = false;          // decision stage: door held for burst entry
+
+// Per-stage timings of the scan path (see ScanTrace.h). Dumped as text by
+// sending 't' over serial or fetching /trace on this port ('r' and
+// /trace/reset clear it).
+ScanTrace scanTrace;
+#ifndef TRACE_HTTP_PORT
+#define TRACE_HTTP_PORT 80
+#endif
+WiFiServer traceServer(TRACE_HTTP_PORT);
+
+// loop() blocks on a task notification instead of polling millis(); timers
+// and the other tasks wake it when there is work: the schedule check, a
+// class boundary, a roster refresh, the end of low-power mode. The stream and trace sockets
+// offer no wake hook, so it still looks at them every loopPollInterval
+// during a class and every idlePollInterval outside one.
+TaskHandle_t loopTask = NULL;
+esp_timer_handle_t scheduleTimer = NULL;
+esp_timer_handle_t powerWakeTimer = NULL;
+esp_timer_handle_t classBoundaryTimer = NULL;
+volatile bool scheduleCheckDue = false;
+volatile bool classBoundaryDue = false;
+volatile bool powerWakeDue = false;
+volatile int64_t powerWakeRequestedAt = 0; // esp_timer us
+const uint64_t scheduleCheckInterval = 60000000; // us
+const uint32_t loopPollInterval = 50;            // ms
+const uint32_t idlePollInterval = 1000;          // ms
+// classBoundaryTimer fires this long into the minute a class starts or
+// ends, so the clock read then is surely past the boundary
+const int64_t classBoundaryMargin = 200000; // us
+
+// Outside class hours the chip drops to low power (see PowerManager.h) and
+// the scanner pulls frames slowly, so hall passes and late time-outs still
+// go through; the power section of the trace dump shows the effect.
+// pauseScannerOutsideClasses stops the camera instead, which also lets the
+// chip light-sleep, for rooms where nobody scans between classes.
+PowerManager power;
+const bool powerSaveOutsideClasses = true;
+const bool pauseScannerOutsideClasses = false;
+const unsigned long powerSaveAfterClass = 30 * 60000UL; // ms after a class (or boot) for late time-outs
+const int powerSaveLead = 10;                           // min before a class to be scanning again
+unsigned long lastClassEndedAt = 0;
+
+enum RosterAnswer
+{
+  ROSTER_MEMBER,
+  ROSTER_NOT_MEMBER,
+  ROSTER_UNAVAILABLE, // no roster loaded for that class
+};
+
+enum OpenLogResult
+{
+  OPEN_LOG_FOUND,
+  OPEN_LOG_NONE,
+  OPEN_LOG_UNKNOWN,  // offline or request failed
+  OPEN_LOG_REJECTED, // the backend refused the query (4xx); asking again will not help
+};
+
+// What became of one journaled event sent to the backend
+enum UploadResult
+{
+  UPLOAD_OK,
+  UPLOAD_RETRY,    // offline, or the backend failed (5xx); send it again later
+  UPLOAD_REJECTED, // the backend refused it (4xx) or it cannot be sent; drop it
+};
+
 // Forward declarations for functions
 void getClassData();
-void processClassData(const String &payload);
+void processClassData(JsonObject classes);
+String classesQueryPath();
+void updateActiveClass();
+void publishClass();
+ClassState currentClass();
+void applyClassJson(const char *classId, JsonObject classInfo);
+bool onScheduleEvent(const String &event, const String &data);
+bool reloadClass(const String &classId);
+bool scheduleEventFailed();
 String getCurrentDay();
-void markAttendance(const String &userId, const String &classId);
-void onQrCodeTask(void *pvParameters);
-bool isUserEnrolledInClass(const String &userId, const String &classId);
-String encodeURIComponent(String str);
-String getFormattedTime();
+UploadResult markAttendance(const ScanEvent &event);
+UploadResult uploadResultFor(int httpCode);
+void decodeTask(void *pvParameters);
+void decisionTask(void *pvParameters);
+void networkTask(void *pvParameters);
+bool isUserEnrolledInClass(const char *userId, const char *classId);
+RosterAnswer rosterLookup(const char *userId, const char *classId);
+void refreshRoster(const String &classId);
+void applyRoster(const String &classId, JsonVariant members);
+bool encodeURIComponent(const char *text, char *out, size_t outSize);
+bool escapeJson(const char *text, char *out, size_t outSize);
+bool pathSafeId(const char *id);
+bool enrollmentUrl(const char *userId, const char *classId, char *out, size_t outSize);
+bool enrollmentKey(const char *userId, const char *classId, char *out, size_t outSize);
+bool formatText(char *out, size_t outSize, const char *format, ...);
 void updateOLED(const String &displayText);
+void updateOLED(const char *activeClass);
+void updateOLEDMessage(const char *message);
 void updateOLEDMessage(const String &message);
-String getUserFullName(const String &userId);
+bool getUserFullName(const char *userId, char *name, size_t nameSize);
 // New forward declarations for timeout functions
-void updateTimeoutForClass(const String &userId, const String &classId);
+UploadResult updateTimeoutForClass(const ScanEvent &event);
+OpenLogResult findOpenLog(const char *userId, const char *classId, char *logKey, size_t logKeySize);
+void formatLogTime(uint32_t timestamp, char *dateStr, size_t dateLen, char *timeStr, size_t timeLen);
+bool recordScan(const char *userId, const char *classId, ScanDirection direction, const char *logKey = "");
+void newLogKey(uint32_t timestamp, char *logKey, size_t logKeySize);
+bool uploadJournalBatch();
+bool postNetworkJob(NetworkJobType type, const char *userId, const char *classId, uint32_t scanId = 0);
 void updateAllTimeouts(const String &userId, const String &currentActiveClassId = "");
-
-// Function to play a tone using LEDC PWM for the passive buzzer
+void serviceTraceRequests();
+void serviceGateway();
+void onGatewayMessage(JsonDocument &message);
+void sendGatewayEvents();
+void startWiFi();
+void serviceWiFi();
+void onWiFiConnected();
+void onTimeSynced(struct timeval *tv);
+bool clockValid();
+void restoreBootState();
+void dumpBootTimes(Print &out);
+void dumpMemory(Print &out);
+void wakeLoop();
+void onScheduleTimer(void *arg);
+void onClassBoundaryTimer(void *arg);
+void armClassBoundary(const struct tm &timeinfo, int burstLeft);
+void setBurstEntry(bool on);
+void onPowerWakeTimer(void *arg);
+void updatePowerMode();
+void leaveLowPower(int64_t requestedAt);
+
+// Queues a tone on the passive buzzer; returns at once
 void playTone(uint32_t frequency, uint32_t duration)
 {
-  const int ledChannel = 0; // LEDC channel 0
-  const int resolution = 8; // 8-bit resolution (0-255)
-
-  // Configure LEDC on the specified channel
-  ledcSetup(ledChannel, frequency, resolution);
-  ledcAttachPin(BUZZER_PIN, ledChannel);
-
-  // Set duty cycle to 50% (128 out of 255) to generate an audible tone
-  ledcWrite(ledChannel, 128);
-  delay(duration);
-
-  // Stop the tone by setting duty cycle to 0 and detach the pin
-  ledcWrite(ledChannel, 0);
-  ledcDetachPin(BUZZER_PIN);
+  if (!actuator.playTone(frequency, duration))
+  {
+    LOG_WARN("Tone queue full, tone skipped");
+  }
 }
-String decodeHex(const String &hexStr)
+static int hexDigit(char c)
 {
-  String decoded;
-  decoded.reserve(hexStr.length() / 2); // Reserve enough space to avoid repeated memory allocations
+  if (c >= '0' && c <= '9')
+  {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f')
+  {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F')
+  {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
 
-  for (int i = 0; i < hexStr.length(); i += 2)
+// Decodes a hex string into out, NUL-terminated. Returns false if it is not
+// whole bytes of hex or does not fit.
+bool decodeHex(const char *hex, char *out, size_t outSize)
+{
+  size_t length = 0;
+  for (; hex[0] != '\0'; hex += 2)
   {
-    // Extract two characters (one byte) at a time
-    String byteString = hexStr.substring(i, i + 2);
-    // Convert that two-char hex string to a number
-    char c = (char)strtol(byteString.c_str(), nullptr, 16);
-    decoded += c;
+    int high = hexDigit(hex[0]);
+    int low = high < 0 ? -1 : hexDigit(hex[1]);
+    if (low < 0 || length + 1 >= outSize)
+    {
+      return false;
+    }
+    out[length++] = (char)(high << 4 | low);
   }
-  return decoded;
+  out[length] = '\0';
+  return true;
 }
 void setup()
 {
-  delay(2000); // Allow time for initialization
   Serial.begin(115200);
-  delay(500);
+  bootCache.begin();
+  bootSelfTest = !fastBoot || bootCache.takeSelfTestRequest();
+
+  // Memory pools before anything parses JSON or opens a TLS connection
+  jsonArena.begin(jsonArenaBlock, jsonArenaBlocks, true);
+  if (serveTlsBuffers(tlsArena, tlsArenaMinimum))
+  {
+    tlsArena.begin(tlsArenaBlock, tlsArenaBlocks, false);
+  }
+  else
+  {
+    LOG_INFO("mbedTLS allocator fixed in this build, TLS buffers stay on the heap");
+  }
+  heapMonitor.begin(heapWarnLargestBlock);
+  if (bootSelfTest)
+  {
+    delay(2000); // Allow time for initialization
+  }
+
+  // Join WiFi in the background while everything else starts
+  startWiFi();
 
-  Serial.println("Starting Passive Buzzer Test...");
-  for (int i = 0; i < 3; i++)
+  actuator.begin(BUZZER_PIN, BUZZER_CHANNEL, RELAY_PIN, LOW);
+  if (bootSelfTest)
   {
-    Serial.println("Playing tone " + String(i + 1));
-    playTone(2000, 500);
-    delay(300);
+    LOG_INFO("Starting Passive Buzzer Test...");
+    for (int i = 0; i < 3; i++)
+    {
+      LOG_DEBUG("Playing tone " + String(i + 1));
+      playTone(2000, 500);
+      actuator.rest(300);
+    }
+    LOG_INFO("Buzzer Test Complete.");
   }
-  Serial.println("Buzzer Test Complete.");
 
   // Initialize OLED
   Wire.begin(14, 15); // SDA -> GPIO14, SCL -> GPIO15
   if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C))
   {
-    Serial.println(F("OLED initialization failed"));
+    LOG_ERROR(F("OLED initialization failed"));
     while (true)
       ;
   }
@@ -111,687 +483,2342 @@ void setup()
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
 
-  // Initialize relay and test it
-  pinMode(RELAY_PIN, OUTPUT);
-  Serial.println("Testing Relay...");
-  digitalWrite(RELAY_PIN, LOW); // Adjust if module is active LOW
-  display.println("Relay ON");
-  display.display();
-  delay(5000);
-  digitalWrite(RELAY_PIN, HIGH);
-  Serial.println("Relay Test Complete.");
-  display.println("Relay OFF");
-  display.display();
-
-  // Connect to WiFi using WiFiMulti
-  wifiMulti.addAP("Oo", "Cyclone1");
-  wifiMulti.addAP("HUAWEI-2.4G-4uG9", "qZnbt34c");
-
-  Serial.print("Connecting to WiFi");
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Offline");
-  display.display();
-  while (wifiMulti.run() != WL_CONNECTED)
-  {
-    delay(500);
-    Serial.print(".");
-  }
-  Serial.println("\nWiFi Connected");
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("WiFi Connected!");
-  display.println("SSID: " + String(WiFi.SSID()));
-  display.display();
-  delay(1000);
-
-  // Configure time for Manila (UTC+8)
-  configTime(gmtOffsetSec, daylightOffsetSec, "pool.ntp.org", "time.nist.gov");
-  Serial.println("Syncing time...");
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Syncing Time...");
-  display.display();
-  struct tm timeinfo;
-  while (!getLocalTime(&timeinfo))
+  if (bootSelfTest)
   {
-    delay(1000);
-    Serial.print(".");
+    // Test the relay (active LOW)
+    LOG_INFO("Testing Relay...");
+    actuator.pulseRelay(5000);
+    display.println("Relay ON");
+    display.display();
+    delay(5000);
+    LOG_INFO("Relay Test Complete.");
+    display.println("Relay OFF");
+    display.display();
   }
-  Serial.println("\nTime Synced");
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Time Synced!");
-  display.display();
-  delay(1000);
 
-  // Initialize QR code reader
+  // Camera and scan pipeline first, so the door answers as soon as it can
   reader.setup();
   reader.cameraConfig.frame_size = FRAMESIZE_QVGA;
   reader.cameraConfig.jpeg_quality = 10;
   reader.cameraConfig.fb_count = 1;
-  reader.beginOnCore(1);
-
-  // Start QR code task
-  xTaskCreate(onQrCodeTask, "onQrCode", 6 * 1024, NULL, 4, NULL);
+  MotionGateConfig motionConfig;
+  motionConfig.holdOff = motionHoldOff;
+  qrScanner.begin(motionConfig, 1);
 
-  // Fetch class data at startup
-  getClassData();
-  updateOLED(activeClassName);
-}
+  rosterLock = xSemaphoreCreateMutex();
+  classLock = xSemaphoreCreateMutex();
+  userNamesLock = xSemaphoreCreateMutex();
+  journalUploadLock = xSemaphoreCreateMutex();
 
-// Returns formatted HH:MM string
-String getFormattedTime()
-{
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo))
+  // Open the scan journal and start draining whatever was left from last boot
+  if (!LittleFS.begin(true))
   {
-    return "Error";
+    LOG_ERROR("LittleFS mount failed, scans will not be journaled");
+  }
+  else
+  {
+    scanJournal.begin(LittleFS, "/scans.jrn", journalCapacity);
+    openLogs.begin(LittleFS, "/openlogs.idx", openLogLifetime);
   }
-  char timeStr[9];
-  snprintf(timeStr, sizeof(timeStr), "%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min);
-  return String(timeStr);
-}
 
-// Update OLED with room name, current time, and active class or custom message
-void updateOLED(const String &activeClass)
-{
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Test Room 1");
-  display.println(getFormattedTime());
-  if (!activeClass.isEmpty())
+  // Start the scan pipeline: decode next to the camera reader on core 1,
+  // the network worker next to the WiFi stack on core 0
+  decisionQueue = xQueueCreate(SCAN_QUEUE_LENGTH, sizeof(DecisionMessage));
+  networkQueue = xQueueCreate(NETWORK_QUEUE_LENGTH, sizeof(NetworkJob));
+  xTaskCreatePinnedToCore(networkTask, "network", 8 * 1024, NULL, 2, NULL, 0);
+  xTaskCreatePinnedToCore(decisionTask, "decision", 6 * 1024, NULL, 3, NULL, 1);
+  xTaskCreatePinnedToCore(decodeTask, "decode", 6 * 1024, NULL, 4, NULL, 1);
+
+  // From here on only the display task touches the OLED
+  statusDisplay.begin(display, 0x3C, roomName, 0);
+
+  backend.begin(apiUrl);
+  if (!tokenVerifier.begin(QR_TOKEN_KEY))
   {
-    display.println(activeClass);
+    LOG_WARN("No QR token key, signed codes will be refused");
   }
-  else
+  traceServer.begin();
+  power.begin();
+  if (useGateway && !gatewayLink.begin(gatewayHost, gatewayPort, GATEWAY_KEY, onGatewayMessage, jsonArena))
   {
-    display.println("No active class");
+    LOG_ERROR("No usable gateway key, talking to Firebase only");
+    useGateway = false;
+  }
+  // The gateway pushes schedule changes, so no stream of our own with it
+  if (!useGateway && useScheduleStream)
+  {
+    scheduleStream.begin(apiUrl, classesQueryPath(), onScheduleEvent);
   }
-  display.display();
-}
 
-// Helper function to display a custom message on the OLED
-void updateOLEDMessage(const String &message)
-{
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Test Room 1");
-  display.println(getFormattedTime());
-  display.println(message);
-  display.display();
-}
+  // Configure time for Manila (UTC+8); SNTP syncs in the background
+  sntp_set_time_sync_notification_cb(onTimeSynced);
+  configTime(gmtOffsetSec, daylightOffsetSec, "pool.ntp.org", "time.nist.gov");
+  restoreBootState();
+  if (!clockValid())
+  {
+    // Nothing saved to go on (first boot): wait for the network and NTP
+    LOG_INFOF("Connecting to WiFi");
+    updateOLEDMessage("Offline");
+    while (wifiMulti.run() != WL_CONNECTED)
+    {
+      delay(500);
+      LOG_INFOF(".");
+    }
+    LOG_INFO("\nWiFi Connected");
+    LOG_INFO("Syncing time...");
+    updateOLEDMessage("Syncing Time...");
+    struct tm timeinfo;
+    while (!getLocalTime(&timeinfo))
+    {
+      delay(1000);
+      LOG_INFOF(".");
+    }
+    LOG_INFO("\nTime Synced");
+  }
 
-unsigned long lastFetchTime = 0;
-const unsigned long fetchInterval = 60000; // 60 seconds
+  // loop() runs on this task; from here on it sleeps until woken
+  loopTask = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t scheduleArgs = {};
+  scheduleArgs.callback = &onScheduleTimer;
+  scheduleArgs.name = "schedule";
+  esp_timer_create_args_t wakeArgs = {};
+  wakeArgs.callback = &onPowerWakeTimer;
+  wakeArgs.name = "power-wake";
+  esp_timer_create_args_t boundaryArgs = {};
+  boundaryArgs.callback = &onClassBoundaryTimer;
+  boundaryArgs.name = "class-boundary";
+  if (esp_timer_create(&scheduleArgs, &scheduleTimer) != ESP_OK ||
+      esp_timer_create(&wakeArgs, &powerWakeTimer) != ESP_OK ||
+      esp_timer_create(&boundaryArgs, &classBoundaryTimer) != ESP_OK)
+  {
+    LOG_ERROR("Failed to create loop timers");
+  }
+  else
+  {
+    esp_timer_start_periodic(scheduleTimer, scheduleCheckInterval);
+  }
 
-void loop()
-{
-  pinMode(RELAY_PIN, OUTPUT);
-  if (millis() - lastFetchTime >= fetchInterval)
+  // A schedule from flash will do; loop() fetches once WiFi is up
+  if (scheduleLoaded)
+  {
+    updateActiveClass();
+  }
+  else
   {
     getClassData();
-    digitalWrite(RELAY_PIN, HIGH);
-    Serial.println("Relay should be OFF now.");
-    updateOLED(activeClassName);
-    lastFetchTime = millis();
   }
+  if (activeClassFound && !activeRoster.isLoadedFor(activeClassId.c_str()))
+  {
+    refreshRoster(activeClassId);
+  }
+  updateOLED(activeClassName);
+
+  bootTimes.ready = millis();
+  LOG_INFOF("Ready to scan %lu ms after boot\n", (unsigned long)bootTimes.ready);
 }
 
-void getClassData()
+// --- startWiFi ---
+// Starts joining WiFi without waiting. With an AP saved by the last boot it
+// goes straight to its BSSID and channel (and, if reuseLastAddress, its
+// address), skipping the scan WiFiMulti makes; serviceWiFi() falls back
+// to WiFiMulti if that does not connect.
+void startWiFi()
 {
-  if (WiFi.status() != WL_CONNECTED)
+  for (const KnownAp &ap : knownAps)
   {
-    Serial.println("WiFi not connected! Retrying...");
-    return;
+    wifiMulti.addAP(ap.ssid, ap.password);
   }
+  WiFi.mode(WIFI_STA);
+  lastWiFiAttempt = millis();
 
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient http;
-  http.begin(client, String(apiUrl) + "classes.json");
-  int httpCode = http.GET();
-
-  if (httpCode == HTTP_CODE_OK)
+  WiFiCache cached;
+  if (!bootCache.loadWiFi(cached) || cached.ap >= knownApCount)
   {
-    String payload = http.getString();
-    processClassData(payload);
+    return;
   }
-  else
+  if (reuseLastAddress && cached.ip != 0)
   {
-    Serial.printf("HTTP Error code: %d. Retrying in next cycle...\n", httpCode);
+    WiFi.config(IPAddress(cached.ip), IPAddress(cached.gateway), IPAddress(cached.subnet), IPAddress(cached.dns));
   }
-  http.end();
+  LOG_INFOF("Joining %s on channel %d\n", knownAps[cached.ap].ssid, (int)cached.channel);
+  WiFi.begin(knownAps[cached.ap].ssid, knownAps[cached.ap].password, cached.channel, cached.bssid);
 }
 
-// --- processClassData ---
-void processClassData(const String &payload)
+// --- serviceWiFi ---
+// Called from loop(). Notices the link coming up, and while it is down
+// retries the known APs every wifiRetryInterval.
+void serviceWiFi()
 {
-  DynamicJsonDocument doc(4096);
-  DeserializationError error = deserializeJson(doc, payload);
-  if (error)
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected && !wifiWasConnected)
   {
-    Serial.println("JSON deserialization failed");
-    return;
+    onWiFiConnected();
   }
-
-  String today = getCurrentDay();
-  activeClassFound = false;
-
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo))
+  wifiWasConnected = connected;
+  if (!connected && millis() - lastWiFiAttempt >= wifiRetryInterval)
   {
-    Serial.println("Failed to obtain time");
-    return;
+    // Scans for every known AP; holds up loop() for a few seconds
+    wifiMulti.run();
+    lastWiFiAttempt = millis();
   }
-  int currentTimeInMinutes = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+}
 
-  JsonObject classes = doc.as<JsonObject>();
-  for (JsonPair keyValue : classes)
+// Saves the AP for the next boot and catches up on whatever changed while
+// the scanner was offline.
+void onWiFiConnected()
+{
+  if (bootTimes.wifi == 0)
   {
-    String classId = keyValue.key().c_str();
-    JsonObject classInfo = keyValue.value().as<JsonObject>();
+    bootTimes.wifi = millis();
+  }
+  LOG_INFOF("WiFi connected to %s\n", WiFi.SSID().c_str());
 
-    // Skip archived classes or those not in the specific room
-    if (classInfo.containsKey("archiveClass") && classInfo["archiveClass"].as<bool>() == true)
-    {
-      continue;
-    }
-    if (!classInfo.containsKey("room") || classInfo["room"].as<String>() != "Test Room 1")
+  WiFiCache cached;
+  memset(&cached, 0, sizeof(cached));
+  cached.ap = knownApCount;
+  for (size_t i = 0; i < knownApCount; i++)
+  {
+    if (WiFi.SSID() == knownAps[i].ssid)
     {
-      continue;
+      cached.ap = (uint8_t)i;
     }
+  }
+  if (cached.ap < knownApCount)
+  {
+    memcpy(cached.bssid, WiFi.BSSID(), sizeof(cached.bssid));
+    cached.channel = WiFi.channel();
+    cached.ip = (uint32_t)WiFi.localIP();
+    cached.gateway = (uint32_t)WiFi.gatewayIP();
+    cached.subnet = (uint32_t)WiFi.subnetMask();
+    cached.dns = (uint32_t)WiFi.dnsIP();
+    bootCache.saveWiFi(cached);
+  }
 
-    JsonArray days = classInfo["days"];
-    String classTime = classInfo["time"].as<String>();
+  scheduleCheckDue = true;
+  rosterRefreshRequested = true;
+}
 
-    int startHour, startMinute, endHour, endMinute;
-    sscanf(classTime.c_str(), "%d:%d - %d:%d", &startHour, &startMinute, &endHour, &endMinute);
-    int classStartTimeInMinutes = startHour * 60 + startMinute;
-    int classEndTimeInMinutes = endHour * 60 + endMinute;
+// SNTP callback, from the lwIP task
+void onTimeSynced(struct timeval *tv)
+{
+  clockSyncPending = true;
+  wakeLoop();
+}
 
-    for (JsonVariant day : days)
-    {
-      if (day.as<String>() == today)
-      {
-        if (currentTimeInMinutes >= classStartTimeInMinutes && currentTimeInMinutes <= classEndTimeInMinutes)
-        {
-          Serial.println("Active Class Found:");
-          Serial.println("Class ID: " + classId);
-          // Save current active class as last active class if different
-          if (activeClassId != "" && activeClassId != classId)
-          {
-            lastActiveClassId = activeClassId;
-            Serial.println("Setting lastActiveClassId to: " + lastActiveClassId);
-          }
-          activeClassId = classId;
-          activeClassName = classInfo["name"].as<String>();
-          activeClassFound = true;
-          updateOLED(activeClassName);
-          return;
-        }
-      }
-    }
-  }
+bool clockValid()
+{
+  return time(nullptr) >= validClockEpoch;
+}
 
-  if (!activeClassFound)
+// --- restoreBootState ---
+// Loads what the last boot knew: the compiled schedule, the active class's
+// roster and, if the clock was lost with the power, the last saved time.
+// Enough to decide scans until the network catches up; a restored clock
+// runs behind by however long the power was off, until NTP corrects it.
+// Door decisions go by it meanwhile, but scans journaled under it are held
+// back and restamped once it syncs.
+void restoreBootState()
+{
+  if (!clockValid())
   {
-    Serial.println("No active class at the moment.");
-    // If there was a previously active class, update lastActiveClassId.
-    if (activeClassId != "")
+    uint32_t saved = bootCache.lastTime();
+    if (saved >= validClockEpoch)
     {
-      lastActiveClassId = activeClassId;
-      Serial.println("Setting lastActiveClassId to: " + lastActiveClassId);
+      struct timeval tv = {(time_t)saved, 0};
+      settimeofday(&tv, nullptr);
+      clockRestored = true;
+      scanJournal.holdForClock();
+      LOG_WARN("Clock lost, running from the last saved time until NTP syncs");
     }
-    activeClassId = "";
-    activeClassName = "";
-    updateOLEDMessage("No active class");
   }
-}
-
-// --- updatePreviousClassTimeout ---
-void updatePreviousClassTimeout(const String &userId)
-{
-  if (lastActiveClassId != "")
+  if (bootCache.loadSchedule(LittleFS, roomClasses, scheduleVersion))
   {
-    Serial.println("Updating timeout for lastActiveClassId: " + lastActiveClassId);
-    updateOLEDMessage("Updating Timeout...");
-    updateTimeoutForClass(userId, lastActiveClassId);
+    roomClasses.compile(schedule);
+    scheduleLoaded = true;
+    LOG_INFOF("Schedule restored: %d class(es)\n", schedule.size());
   }
-  else
+  if (!scheduleLoaded || !clockValid())
+  {
+    return;
+  }
+  updateActiveClass();
+  EnrollmentRoster saved;
+  if (activeClassFound && bootCache.loadRoster(LittleFS, saved) && saved.isLoadedFor(activeClassId.c_str()))
   {
-    Serial.println("No lastActiveClassId to update.");
+    LOG_INFOF("Roster for class %s restored: %u students\n", activeClassId.c_str(), (unsigned)saved.size());
+    xSemaphoreTake(rosterLock, portMAX_DELAY);
+    activeRoster.swap(saved);
+    xSemaphoreGive(rosterLock);
+    rosterClassId = activeClassId;
+    lastRosterFetch = millis();
   }
 }
 
-bool isUserEnrolledInClass(const String &userId, const String &classId)
+// Writes boot timings as plain text, after the power section of the trace.
+void dumpBootTimes(Print &out)
 {
-  if (WiFi.status() == WL_CONNECTED)
+  out.println("# boot: ready_ms wifi_ms clock_ms self_test");
+  out.printf("%lu %lu %lu %d\n", (unsigned long)bootTimes.ready, (unsigned long)bootTimes.wifi,
+             (unsigned long)bootTimes.clock, bootSelfTest ? 1 : 0);
+}
+
+// Writes heap watermarks and arena use as plain text, after the boot times.
+void dumpMemory(Print &out)
+{
+  heapMonitor.dump(out);
+  out.println("# arenas: name location block_bytes blocks in_use most_in_use peak_bytes fallbacks");
+  jsonArena.dump(out);
+  tlsArena.dump(out);
+}
+
+// Update OLED with the active class; room and clock are kept by the display task
+void updateOLED(const String &activeClass)
+{
+  updateOLED(activeClass.c_str());
+}
+
+void updateOLED(const char *activeClass)
+{
+  updateOLEDMessage(activeClass[0] == '\0' ? "No active class" : activeClass);
+}
+
+// Helper function to display a custom message on the OLED
+void updateOLEDMessage(const char *message)
+{
+  if (!statusDisplay.setLine(DISPLAY_LINE_STATUS, message))
   {
-    WiFiClientSecure client;
-    client.setInsecure();
-    HTTPClient http;
-    String encodedUserId = encodeURIComponent(userId);
-    String url = String(apiUrl) + "logins/" + encodedUserId + "/enrolledClasses/" + classId + ".json";
-    Serial.println("Request URL: " + url);
-    http.begin(client, url);
-    int httpCode = http.GET();
+    LOG_WARNF("Display busy, message skipped: %s\n", message);
+  }
+}
 
-    if (httpCode > 0)
+void updateOLEDMessage(const String &message)
+{
+  updateOLEDMessage(message.c_str());
+}
+
+// --- serviceTraceRequests ---
+// Dumps or clears the scan trace on request: 't' or 'r' over serial, or
+// GET /trace or /trace/reset (dumps, then clears) on traceServer. 's' over
+// serial has the next boot run the self-tests.
+void serviceTraceRequests()
+{
+  while (Serial.available() > 0)
+  {
+    int command = Serial.read();
+    if (command == 't')
     {
-      if (httpCode == HTTP_CODE_OK)
-      {
-        String payload = http.getString();
-        Serial.println("Response: " + payload);
-        if (payload != "null")
-        {
-          Serial.println("User " + userId + " is enrolled in class: " + classId);
-          http.end();
-          return true;
-        }
-        else
-        {
-          Serial.println("User " + userId + " is not enrolled in class: " + classId);
-        }
-      }
-      else
-      {
-        Serial.printf("HTTP Error code: %d\n", httpCode);
-      }
+      scanTrace.dump(Serial);
+      power.dump(Serial);
+      dumpBootTimes(Serial);
+      dumpMemory(Serial);
     }
-    else
+    else if (command == 'r')
+    {
+      scanTrace.reset();
+      Serial.println("Scan trace cleared");
+    }
+    else if (command == 's')
     {
-      Serial.printf("Connection failed: %s\n", http.errorToString(httpCode).c_str());
+      bootCache.requestSelfTest();
+      Serial.println("Self-test on next boot");
     }
-    http.end();
+  }
+
+  WiFiClient client = traceServer.available();
+  if (!client)
+  {
+    return;
+  }
+  client.setTimeout(1000);
+  String requestLine = client.readStringUntil('\n');
+  // Read past the headers so closing the socket does not reset it
+  while (client.connected() && client.readStringUntil('\n').length() > 1)
+  {
+  }
+  bool reset = requestLine.startsWith("GET /trace/reset ");
+  if (!reset && !requestLine.startsWith("GET /trace "))
+  {
+    client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
   }
   else
   {
-    Serial.println("WiFi not connected!");
+    client.print("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    scanTrace.dump(client);
+    power.dump(client);
+    dumpBootTimes(client);
+    dumpMemory(client);
+    if (reset)
+    {
+      scanTrace.reset();
+    }
   }
-  return false;
+  client.stop();
 }
 
-void waitForQRCodeRemoval()
+// --- serviceGateway ---
+// Called from loop() when a gateway is configured. Says hello on every new
+// session, which has the gateway push this room's schedule, and streams
+// the journal to it.
+void serviceGateway()
 {
-  const unsigned long removalThreshold = 2000;
-  unsigned long absenceStart = millis();
-  struct QRCodeData tempData;
-  while (true)
+  gatewayLink.loop();
+  if (gatewayLink.takeConnected())
   {
-    if (reader.receiveQrCode(&tempData, 100) && tempData.valid)
-    {
-      absenceStart = millis();
-    }
-    else
-    {
-      if (millis() - absenceStart >= removalThreshold)
-      {
-        break;
-      }
-    }
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    StaticJsonDocument<192> hello;
+    hello["t"] = (int)GW_HELLO;
+    hello["r"] = roomName;
+    hello["i"] = scannerIdTimeIn.c_str();
+    hello["o"] = scannerIdTimeOut.c_str();
+    hello["z"] = gmtOffsetSec + daylightOffsetSec;
+    gatewayLink.send(hello);
+    // Whatever the last session left unacked goes again
+    gatewayNextSeq = scanJournal.firstPending();
+    rosterRefreshRequested = true;
+  }
+  if (gatewayLink.connected())
+  {
+    sendGatewayEvents();
   }
 }
 
-// --- onQrCodeTask ---
-void onQrCodeTask(void *pvParameters)
+// --- sendGatewayEvents ---
+// Sends journaled scans to the gateway, up to gatewayWindow ahead of its
+// acks. Events stay in the journal until acked, i.e. until the gateway has
+// written them to Firebase, and a resent event is recognised there as
+// already delivered, as markAttendance() does.
+void sendGatewayEvents()
 {
-  const unsigned long scanCooldown = 2000;
-  struct QRCodeData qrCodeData;
-  pinMode(RELAY_PIN, OUTPUT);
-  digitalWrite(RELAY_PIN, HIGH);
-
-  static String lastScannedUser = "";
-  static unsigned long lastScanTime = 0;
-  const unsigned long userCooldownPeriod = 5000;
-
-  while (true)
+  if (xSemaphoreTake(journalUploadLock, 0) != pdTRUE)
   {
-    if (!scanningEnabled)
+    return; // networkTask is finishing a batch; next pass
+  }
+  uint32_t first = scanJournal.firstPending();
+  if ((int32_t)(gatewayNextSeq - first) < 0)
+  {
+    gatewayNextSeq = first; // events dropped from a full journal
+  }
+  size_t inFlight = gatewayNextSeq - first;
+  ScanEvent events[gatewayWindow];
+  uint32_t seqs[gatewayWindow];
+  size_t count = 0;
+  if (inFlight < gatewayWindow)
+  {
+    count = scanJournal.peekFrom(gatewayNextSeq, events, seqs, gatewayWindow - inFlight);
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    const ScanEvent &event = events[i];
+    StaticJsonDocument<256> message;
+    message["t"] = (int)GW_EVENT;
+    message["q"] = seqs[i];
+    message["u"] = event.userId;
+    message["c"] = event.classId;
+    message["s"] = event.timestamp;
+    message["d"] = event.direction;
+    if (event.logKey[0] != '\0')
     {
-      vTaskDelay(100 / portTICK_PERIOD_MS);
-      continue;
+      message["k"] = event.logKey;
     }
-
-    if (reader.receiveQrCode(&qrCodeData, 100))
+    if (event.clockUnverified)
     {
-      if (qrCodeData.valid)
-      {
-        // 1) Grab the hex string from the QR payload
-        String userIdHex = (const char *)qrCodeData.payload;
-        Serial.println("QR Code scanned (hex): " + userIdHex);
-
-        // 2) Decode the hex into the real userId
-        String userId = decodeHex(userIdHex);
-        Serial.println("Decoded user ID: " + userId);
-        Serial.println("QR Code scanned: " + userId);
-
-        // Special handling for hall pass...
-        if (userId.equals("hallpasstest"))
-        {
-          scanningEnabled = false;
-          Serial.println("Hall pass QR code detected, activating relay...");
-          playTone(1500, 300);
-          digitalWrite(RELAY_PIN, LOW);
-          updateOLEDMessage("Hall Pass Detected!");
-          waitForQRCodeRemoval();
-          vTaskDelay(2000 / portTICK_PERIOD_MS);
-          digitalWrite(RELAY_PIN, HIGH);
-          Serial.println("Relay OFF after hall pass.");
-          updateOLED(activeClassName);
-          scanningEnabled = true;
-          lastScannedUser = "";
-          continue;
-        }
-
-        if (userId == lastScannedUser && (millis() - lastScanTime < userCooldownPeriod))
-        {
-          Serial.println("Duplicate scan detected for user " + userId + ", ignoring.");
-          updateOLEDMessage("Duplicate scan");
-          waitForQRCodeRemoval();
-          lastScannedUser = "";
-          vTaskDelay(scanCooldown / portTICK_PERIOD_MS);
-          continue;
-        }
-
-        lastScannedUser = userId;
-        lastScanTime = millis();
-
-        // Always attempt to update timeout for the previous (last active) class for this user
-        updatePreviousClassTimeout(userId);
-
-        // Process attendance for the current active class if present
-        if (activeClassFound && !activeClassId.isEmpty())
-        {
-          if (isUserEnrolledInClass(userId, activeClassId))
-          {
-            // --- Successful QR scan buzzer ---
-            // This tone indicates that a valid QR scan for an enrolled user is detected.
-            playTone(2000, 300);
-
-            String userFullName = getUserFullName(userId);
-            Serial.println("Valid user (" + userFullName + ") detected, processing attendance...");
-            updateOLEDMessage("Processing Attendance");
-            scanningEnabled = false;
-            digitalWrite(RELAY_PIN, LOW);
-            Serial.println("Relay ON");
-
-            markAttendance(userId, activeClassId);
-
-            vTaskDelay(2000 / portTICK_PERIOD_MS);
-            digitalWrite(RELAY_PIN, HIGH);
-            Serial.println("Relay OFF after processing attendance.");
-            scanningEnabled = true;
-          }
-          else
-          {
-            // --- Unenrolled buzzer ---
-            // This tone indicates the user is not enrolled in the current active class.
-            playTone(2000, 1000);
-            Serial.println("User not enrolled in the active class: " + userId);
-            updateOLEDMessage("Not Enrolled");
-          }
-        }
-        else
-        {
-          Serial.println("No active class to mark attendance.");
-          updateOLEDMessage("No active class");
-        }
-
-        waitForQRCodeRemoval();
-        lastScannedUser = "";
-        vTaskDelay(scanCooldown / portTICK_PERIOD_MS);
-      }
-      else
-      {
-        Serial.println("QR Code detected but invalid.");
-      }
+      message["v"] = 1;
+    }
+    if (!gatewayLink.send(message))
+    {
+      break;
     }
-    vTaskDelay(100 / portTICK_PERIOD_MS);
+    gatewayNextSeq = seqs[i] + 1;
   }
+  xSemaphoreGive(journalUploadLock);
 }
 
-String encodeURIComponent(String str)
+// --- onGatewayMessage ---
+// Handles a message from the gateway, on the loop task.
+void onGatewayMessage(JsonDocument &message)
 {
-  String encoded = "";
-  char c;
-  for (int i = 0; i < str.length(); i++)
+  switch (message["t"] | 0)
   {
-    c = str[i];
-    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
-    {
-      encoded += c;
-    }
-    else
+  case GW_ACK:
+    xSemaphoreTake(journalUploadLock, portMAX_DELAY);
+    scanJournal.ackThrough(message["q"].as<uint32_t>());
+    xSemaphoreGive(journalUploadLock);
+    break;
+  case GW_SCHEDULE:
+    processClassData(message["c"].as<JsonObject>());
+    scheduleVersion = message["v"] | "";
+    bootCache.saveSchedule(LittleFS, roomClasses, scheduleVersion);
+    updateActiveClass();
+    updateOLED(activeClassName);
+    updatePowerMode();
+    break;
+  case GW_ROSTER:
+  {
+    // Rosters of a class that is no longer active are stale
+    const char *classId = message["c"] | "";
+    if (activeClassFound && activeClassId == classId)
     {
-      encoded += "%" + String(c, HEX);
+      applyRoster(activeClassId, message["m"]);
     }
+    break;
+  }
+  default:
+    break;
   }
-  return encoded;
 }
 
-String getCurrentDay()
+// --- wakeLoop ---
+// Has loop() run now instead of at its next poll. Safe from any task and
+// from esp_timer callbacks.
+void wakeLoop()
 {
-  struct tm timeinfo;
-  if (!getLocalTime(&timeinfo))
+  if (loopTask != NULL)
   {
-    Serial.println("Failed to obtain time");
-    return "";
+    xTaskNotifyGive(loopTask);
   }
-  const char *daysOfWeek[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
-  return String(daysOfWeek[timeinfo.tm_wday]);
 }
 
-void markAttendance(const String &userId, const String &classId)
+void onScheduleTimer(void *arg)
 {
-  if (WiFi.status() == WL_CONNECTED)
-  {
-    WiFiClientSecure client;
-    client.setInsecure();
-    HTTPClient http;
-    String attendanceUrl = String(apiUrl) + "logins/" + userId + "/enrolledClasses/" + classId + "/attendance.json";
-    http.begin(client, attendanceUrl);
-    int httpCode = http.GET();
+  scheduleCheckDue = true;
+  wakeLoop();
+}
 
-    if (httpCode == HTTP_CODE_OK)
+void onClassBoundaryTimer(void *arg)
+{
+  classBoundaryDue = true;
+  wakeLoop();
+}
+
+void onPowerWakeTimer(void *arg)
+{
+  powerWakeRequestedAt = esp_timer_get_time();
+  powerWakeDue = true;
+  wakeLoop();
+}
+
+void loop()
+{
+  // Sleep until a timer or another task has work, or the sockets are due a look
+  ulTaskNotifyTake(pdTRUE, (activeClassFound ? loopPollInterval : idlePollInterval) / portTICK_PERIOD_MS);
+  power.countLoopWake();
+
+  serviceTraceRequests();
+  serviceWiFi();
+  if (useGateway)
+  {
+    serviceGateway();
+  }
+  else if (useScheduleStream)
+  {
+    scheduleStream.loop();
+  }
+  if (clockSyncPending)
+  {
+    clockSyncPending = false;
+    clockRestored = false;
+    if (bootTimes.clock == 0)
+    {
+      bootTimes.clock = millis();
+    }
+    LOG_INFO("Clock synced");
+    scanJournal.restamp((uint32_t)time(nullptr), millis());
+    if (scanJournal.pending() > 0 && !gatewayLink.connected())
+    {
+      postNetworkJob(NET_FLUSH_JOURNAL, "", "");
+    }
+    bootCache.saveTime((uint32_t)time(nullptr));
+    lastClockSave = millis();
+    updateActiveClass(); // a restored clock may have been behind
+  }
+  if (powerWakeDue)
+  {
+    powerWakeDue = false;
+    leaveLowPower(powerWakeRequestedAt);
+  }
+  if (classBoundaryDue)
+  {
+    // A class starts or ends this minute; the cached schedule says which
+    classBoundaryDue = false;
+    updateActiveClass();
+    updatePowerMode();
+  }
+  if (scheduleCheckDue)
+  {
+    scheduleCheckDue = false;
+    // While streaming, edits arrive as events; only the clock needs checking
+    if (scheduleStream.connected() || gatewayLink.connected())
+    {
+      updateActiveClass();
+    }
+    else
+    {
+      getClassData();
+    }
+    updateOLED(activeClassName);
+    LOG_INFOF("Frames: %u seen, %u decoded\n", (unsigned)qrScanner.framesSeen(), (unsigned)qrScanner.framesDecoded());
+    // A largest block far below the free total means the heap is fragmenting
+    LOG_INFOF("Heap: %u free, %u lowest, %u largest block\n", (unsigned)ESP.getFreeHeap(),
+              (unsigned)ESP.getMinFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+    updatePowerMode();
+    if (clockValid() && millis() - lastClockSave >= clockSaveInterval)
+    {
+      bootCache.saveTime((uint32_t)time(nullptr));
+      lastClockSave = millis();
+    }
+    if (clockRestored && millis() >= heldScanRelease && scanJournal.releaseHeld() && !gatewayLink.connected())
+    {
+      postNetworkJob(NET_FLUSH_JOURNAL, "", "");
+    }
+  }
+
+  // Keep the active class roster current so scans never wait on the network
+  if (activeClassFound && (rosterRefreshRequested || activeClassId != rosterClassId ||
+                           millis() - lastRosterFetch >= rosterRefreshInterval))
+  {
+    rosterRefreshRequested = false;
+    refreshRoster(activeClassId);
+  }
+  heapMonitor.sample();
+}
+
+// --- updatePowerMode ---
+// Drops to low power once no class is on, the last one ended at least
+// powerSaveAfterClass ago and the next starts more than powerSaveLead
+// away; powerWakeTimer brings the scanner back powerSaveLead before that
+// class. Called on every schedule check, so the timer follows edits.
+void updatePowerMode()
+{
+  if (!powerSaveOutsideClasses)
+  {
+    return;
+  }
+  if (activeClassFound)
+  {
+    leaveLowPower(esp_timer_get_time());
+    return;
+  }
+  struct tm timeinfo;
+  if (!scheduleLoaded || millis() - lastClassEndedAt < powerSaveAfterClass || !getLocalTime(&timeinfo))
+  {
+    return;
+  }
+  int untilStart = schedule.minutesUntilStart(timeinfo.tm_wday, timeinfo.tm_hour * 60 + timeinfo.tm_min);
+  if (untilStart >= 0 && untilStart <= powerSaveLead)
+  {
+    leaveLowPower(esp_timer_get_time());
+    return;
+  }
+
+  esp_timer_stop(powerWakeTimer);
+  if (untilStart >= 0)
+  {
+    int64_t wakeIn = ((int64_t)(untilStart - powerSaveLead) * 60 - timeinfo.tm_sec) * 1000000LL;
+    esp_timer_start_once(powerWakeTimer, (uint64_t)wakeIn);
+  }
+  if (!power.lowPower())
+  {
+    if (pauseScannerOutsideClasses)
+    {
+      qrScanner.pause();
+    }
+    else
+    {
+      qrScanner.setSlow(true);
+    }
+    power.enterLowPower(pauseScannerOutsideClasses);
+    if (untilStart >= 0)
+    {
+      LOG_INFOF("Next class in %d min, scanner %s\n", untilStart, pauseScannerOutsideClasses ? "paused" : "slowed");
+    }
+  }
+}
+
+// --- leaveLowPower ---
+// requestedAt: esp_timer time the wake was asked for.
+void leaveLowPower(int64_t requestedAt)
+{
+  if (!power.lowPower())
+  {
+    return;
+  }
+  esp_timer_stop(powerWakeTimer);
+  power.exitLowPower(requestedAt);
+  qrScanner.setSlow(false);
+  qrScanner.resume();
+}
+
+// The fields of a class the schedule uses, for response filters.
+void addClassFields(JsonObject fields)
+{
+  fields["name"] = true;
+  fields["room"] = true;
+  fields["days"] = true;
+  fields["time"] = true;
+  fields["archiveClass"] = true;
+}
+
+void getClassData()
+{
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    LOG_WARN("WiFi not connected! Retrying...");
+    updateActiveClass();
+    return;
+  }
+
+  // A few bytes tell whether classes.json needs downloading at all
+  StaticJsonDocument<32> versionDoc;
+  int versionCode = backend.getJson("classesMeta/version.json", versionDoc);
+  String version;
+  serializeJson(versionDoc, version);
+  if (versionCode == HTTP_CODE_OK && version != "null" && scheduleLoaded && version == scheduleVersion)
+  {
+    updateActiveClass();
+    return;
+  }
+
+  // Parse straight from the response, keeping only what the schedule uses
+  StaticJsonDocument<192> filter;
+  addClassFields(filter["*"].to<JsonObject>());
+
+  PooledJsonDocument doc(jsonArena, classesDocCapacity);
+  DeserializationError error;
+  String path = roomQuerySupported ? classesQueryPath() : String("classes.json");
+  int httpCode = backend.getJsonIfChanged(path, classesEtag, doc, &filter, &error);
+  if (httpCode == HTTP_CODE_BAD_REQUEST && roomQuerySupported)
+  {
+    LOG_WARN("Room query rejected (is classes/room indexed?), fetching all classes");
+    roomQuerySupported = false;
+    classesEtag = "";
+    httpCode = backend.getJsonIfChanged("classes.json", classesEtag, doc, &filter, &error);
+  }
+
+  if (httpCode == HTTP_CODE_OK)
+  {
+    if (error)
+    {
+      // Keep the previous table; the next cycle tries again
+      LOG_WARNF("JSON deserialization failed: %s\n", error.c_str());
+      classesEtag = "";
+    }
+    else
+    {
+      processClassData(doc.as<JsonObject>());
+      scheduleVersion = (versionCode == HTTP_CODE_OK) ? version : "";
+      bootCache.saveSchedule(LittleFS, roomClasses, scheduleVersion);
+    }
+  }
+  else if (httpCode != HTTP_CODE_NOT_MODIFIED)
+  {
+    LOG_WARNF("HTTP Error code: %d. Retrying in next cycle...\n", httpCode);
+  }
+  updateActiveClass();
+}
+
+// Indexed query for this room's classes only.
+String classesQueryPath()
+{
+  char quoted[64];
+  char encoded[sizeof(quoted) * 3];
+  if (!formatText(quoted, sizeof(quoted), "\"%s\"", roomName) ||
+      !encodeURIComponent(quoted, encoded, sizeof(encoded)))
+  {
+    return "classes.json";
+  }
+  return String("classes.json?orderBy=%22room%22&equalTo=") + encoded;
+}
+
+// --- processClassData ---
+// Compiles this room's non-archived classes into the schedule table.
+void processClassData(JsonObject classes)
+{
+  roomClasses.clear();
+  for (JsonPair keyValue : classes)
+  {
+    applyClassJson(keyValue.key().c_str(), keyValue.value().as<JsonObject>());
+  }
+  roomClasses.compile(schedule);
+  scheduleLoaded = true;
+  LOG_INFOF("Schedule compiled: %d class(es) in %s\n", schedule.size(), roomName);
+}
+
+// --- applyClassJson ---
+// Updates the record of one class from its JSON. Classes that are archived,
+// in another room or deleted (null) are dropped from this room's list.
+void applyClassJson(const char *classId, JsonObject classInfo)
+{
+  // Skip archived classes or those not in the specific room
+  const char *room = classInfo["room"];
+  if (classInfo.isNull() || (classInfo["archiveClass"] | false) || room == nullptr || strcmp(room, roomName) != 0)
+  {
+    roomClasses.remove(classId);
+    return;
+  }
+
+  if (!RoomClassList::fits(classId))
+  {
+    LOG_WARN("Skipping class with too long ID: " + String(classId));
+    return;
+  }
+
+  uint16_t start, end;
+  if (!ClassSchedule::parseTimeRange(classInfo["time"], start, end))
+  {
+    LOG_WARN("Skipping class with unreadable time: " + String(classId));
+    roomClasses.remove(classId);
+    return;
+  }
+
+  ClassRecord *record = roomClasses.upsert(classId);
+  if (record == nullptr)
+  {
+    LOG_WARN("Schedule table full, ignoring class " + String(classId));
+    return;
+  }
+  strncpy(record->name, classInfo["name"] | "", sizeof(record->name) - 1);
+  record->name[sizeof(record->name) - 1] = '\0';
+  record->start = start;
+  record->end = end;
+  record->days = 0;
+  for (JsonVariant day : classInfo["days"].as<JsonArray>())
+  {
+    int weekday = ClassSchedule::weekdayFromName(day | "");
+    if (weekday >= 0)
+    {
+      record->days |= 1 << weekday;
+    }
+  }
+}
+
+// --- onScheduleEvent ---
+// Applies a put/patch event from the classes stream. Events carrying whole
+// classes are applied directly; an edit to a single field re-reads just
+// that class, since its room or archive state may not be in the event.
+// Returns false if the event could not be applied; the stream then drops
+// and the next poll downloads the whole schedule.
+bool onScheduleEvent(const String &event, const String &data)
+{
+  if (event != "put" && event != "patch")
+  {
+    return true;
+  }
+
+  PooledJsonDocument doc(jsonArena, data.length() * 2 + 1024);
+  if (deserializeJson(doc, data))
+  {
+    LOG_WARN("Failed to parse schedule event");
+    return scheduleEventFailed();
+  }
+  String path = doc["path"] | "/";
+  JsonVariant value = doc["data"];
+
+  if (path == "/")
+  {
+    // A put here is the full tree (sent on every connect); a patch
+    // replaces each listed class.
+    if (event == "put")
+    {
+      roomClasses.clear();
+    }
+    for (JsonPair keyValue : value.as<JsonObject>())
+    {
+      String key = keyValue.key().c_str();
+      int slash = key.indexOf('/');
+      if (slash < 0)
+      {
+        applyClassJson(key.c_str(), keyValue.value().as<JsonObject>());
+      }
+      else if (!reloadClass(key.substring(0, slash)))
+      {
+        return scheduleEventFailed();
+      }
+    }
+  }
+  else
+  {
+    String classId = path.substring(1);
+    int slash = classId.indexOf('/');
+    if (slash >= 0)
+    {
+      classId = classId.substring(0, slash);
+    }
+
+    if (event == "put" && slash < 0)
+    {
+      applyClassJson(classId.c_str(), value.as<JsonObject>());
+    }
+    else if (!reloadClass(classId))
+    {
+      return scheduleEventFailed();
+    }
+  }
+
+  roomClasses.compile(schedule);
+  scheduleLoaded = true;
+  bootCache.saveSchedule(LittleFS, roomClasses, scheduleVersion);
+  LOG_INFOF("Schedule updated from stream: %d class(es) in %s\n", schedule.size(), roomName);
+  updateActiveClass();
+  updatePowerMode();
+  return true;
+}
+
+// The stream missed an edit: forget the version and ETag the schedule was
+// loaded at, so the poll that takes over downloads it whole, and poll now.
+bool scheduleEventFailed()
+{
+  scheduleVersion = "";
+  classesEtag = "";
+  scheduleCheckDue = true;
+  return false;
+}
+
+// --- reloadClass ---
+// Re-reads one class after a partial edit.
+bool reloadClass(const String &classId)
+{
+  StaticJsonDocument<128> filter;
+  addClassFields(filter.to<JsonObject>());
+  PooledJsonDocument classDoc(jsonArena, classDocCapacity);
+  DeserializationError error;
+  if (backend.getJson("classes/" + classId + ".json", classDoc, &filter, &error) != HTTP_CODE_OK || error)
+  {
+    LOG_WARN("Failed to re-read class " + classId);
+    return false;
+  }
+  applyClassJson(classId.c_str(), classDoc.as<JsonObject>());
+  return true;
+}
+
+// --- updateActiveClass ---
+// Looks the current minute up in the compiled schedule and handles the
+// active/last class transitions.
+void updateActiveClass()
+{
+  if (!scheduleLoaded)
+  {
+    return;
+  }
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo))
+  {
+    LOG_WARN("Failed to obtain time");
+    return;
+  }
+  int currentTimeInMinutes = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+  uint16_t classStart = 0;
+  int index = schedule.findActive(timeinfo.tm_wday, currentTimeInMinutes, &classStart);
+  int burstLeft = (index >= 0 && burstEntryEnabled) ? classStart + burstEntryLength - currentTimeInMinutes : 0;
+  armClassBoundary(timeinfo, burstLeft);
+  setBurstEntry(burstLeft > 0);
+
+  if (index >= 0)
+  {
+    String classId = schedule.classId(index);
+    if (activeClassId != classId)
+    {
+      LOG_DEBUG("Active Class Found:");
+      LOG_DEBUG("Class ID: " + classId);
+    }
+    // Save current active class as last active class if different
+    if (activeClassId != "" && activeClassId != classId)
+    {
+      lastActiveClassId = activeClassId;
+      LOG_DEBUG("Setting lastActiveClassId to: " + lastActiveClassId);
+    }
+    activeClassId = classId;
+    activeClassName = schedule.className(index);
+    activeClassFound = true;
+    publishClass();
+    updateOLED(activeClassName);
+    return;
+  }
+
+  LOG_INFO("No active class at the moment.");
+  if (activeClassFound)
+  {
+    lastClassEndedAt = millis();
+  }
+  activeClassFound = false;
+  // If there was a previously active class, update lastActiveClassId.
+  if (activeClassId != "")
+  {
+    lastActiveClassId = activeClassId;
+    LOG_DEBUG("Setting lastActiveClassId to: " + lastActiveClassId);
+  }
+  activeClassId = "";
+  activeClassName = "";
+  publishClass();
+  updateOLEDMessage("No active class");
+}
+
+// Copies the active and last class for the decision task. Loop task only.
+void publishClass()
+{
+  ClassState state;
+  state.found = activeClassFound;
+  snprintf(state.activeId, sizeof(state.activeId), "%s", activeClassId.c_str());
+  snprintf(state.lastId, sizeof(state.lastId), "%s", lastActiveClassId.c_str());
+  snprintf(state.name, sizeof(state.name), "%s", activeClassName.c_str());
+  xSemaphoreTake(classLock, portMAX_DELAY);
+  publishedClass = state;
+  xSemaphoreGive(classLock);
+}
+
+ClassState currentClass()
+{
+  xSemaphoreTake(classLock, portMAX_DELAY);
+  ClassState state = publishedClass;
+  xSemaphoreGive(classLock);
+  return state;
+}
+
+// --- armClassBoundary ---
+// Sets classBoundaryTimer for the next minute a class starts or ends, or
+// burst entry ends (burstLeft minutes from now, if positive), so the state
+// switches on time instead of at the next schedule check.
+void armClassBoundary(const struct tm &timeinfo, int burstLeft)
+{
+  if (classBoundaryTimer == NULL)
+  {
+    return;
+  }
+  esp_timer_stop(classBoundaryTimer);
+  int minutes = schedule.minutesUntilChange(timeinfo.tm_wday, timeinfo.tm_hour * 60 + timeinfo.tm_min);
+  if (burstLeft > 0 && (minutes < 0 || burstLeft < minutes))
+  {
+    minutes = burstLeft;
+  }
+  if (minutes < 0)
+  {
+    return;
+  }
+  int64_t fireIn = ((int64_t)minutes * 60 - timeinfo.tm_sec) * 1000000LL + classBoundaryMargin;
+  esp_timer_start_once(classBoundaryTimer, (uint64_t)fireIn);
+}
+
+// --- setBurstEntry ---
+// Has the decision stage start or end burst entry, if that changes it.
+// Called from loop(); a send that finds the queue full is retried on the
+// next schedule check.
+void setBurstEntry(bool on)
+{
+  if (on == burstEntryRequested || decisionQueue == NULL)
+  {
+    return;
+  }
+  DecisionMessage message;
+  memset(&message, 0, sizeof(message));
+  message.type = MSG_BURST_ENTRY;
+  message.verdict = on ? VERDICT_YES : VERDICT_NO;
+  if (xQueueSend(decisionQueue, &message, 100 / portTICK_PERIOD_MS) == pdTRUE)
+  {
+    burstEntryRequested = on;
+  }
+}
+
+// Only asks whether the enrollment exists: shallow=true has Firebase send
+// "true" in place of the enrollment and its attendance logs.
+bool isUserEnrolledInClass(const char *userId, const char *classId)
+{
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    char enrollment[backendPathSize];
+    char path[backendPathSize];
+    if (!enrollmentUrl(userId, classId, enrollment, sizeof(enrollment)) ||
+        !formatText(path, sizeof(path), "%s.json?shallow=true", enrollment))
+    {
+      return false;
+    }
+    LOG_DEBUGF("Request path: %s\n", path);
+    static StaticJsonDocument<256> doc;
+    int httpCode = backend.getJson(path, doc);
+
+    if (httpCode > 0)
+    {
+      if (httpCode == HTTP_CODE_OK)
+      {
+        if (!doc.isNull())
+        {
+          LOG_INFOF("User %s is enrolled in class: %s\n", userId, classId);
+          return true;
+        }
+        else
+        {
+          LOG_INFOF("User %s is not enrolled in class: %s\n", userId, classId);
+        }
+      }
+      else
+      {
+        LOG_WARNF("HTTP Error code: %d\n", httpCode);
+      }
+    }
+    else
+    {
+      LOG_WARNF("Connection failed: %s\n", HTTPClient::errorToString(httpCode).c_str());
+    }
+  }
+  else
+  {
+    LOG_WARN("WiFi not connected!");
+  }
+  return false;
+}
+
+// --- refreshRoster ---
+// Downloads classRosters/<classId> (maintained by the class roster cloud
+// functions in index.js) and swaps it in as the active roster.
+void refreshRoster(const String &classId)
+{
+  rosterClassId = classId;
+  lastRosterFetch = millis();
+  if (gatewayLink.connected())
+  {
+    // The gateway answers with the roster, and again whenever it changes
+    StaticJsonDocument<96> watch;
+    watch["t"] = (int)GW_WATCH;
+    watch["c"] = classId.c_str();
+    gatewayLink.send(watch);
+    return;
+  }
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    LOG_WARN("WiFi not connected! Keeping current roster.");
+    return;
+  }
+
+  PooledJsonDocument doc(jsonArena, rosterDocCapacity);
+  DeserializationError error;
+  int httpCode = backend.getJson("classRosters/" + classId + ".json", doc, nullptr, &error);
+  if (httpCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Failed to fetch roster. HTTP error code: %d\n", httpCode);
+    return;
+  }
+  if (error)
+  {
+    LOG_WARNF("Failed to parse roster JSON: %s\n", error.c_str());
+    return;
+  }
+  applyRoster(classId, doc.as<JsonVariant>());
+}
+
+// --- applyRoster ---
+// Swaps in a classRosters entry, from Firebase or the gateway, as the
+// active roster. A null entry leaves the class without a roster.
+void applyRoster(const String &classId, JsonVariant entry)
+{
+  EnrollmentRoster fresh;
+  if (!entry.isNull())
+  {
+    JsonObject members = entry.as<JsonObject>();
+    if (!fresh.reset(classId.c_str(), members.size()))
+    {
+      LOG_ERROR("Not enough memory for roster");
+      return;
+    }
+    xSemaphoreTake(userNamesLock, portMAX_DELAY);
+    for (JsonPair kv : members)
+    {
+      fresh.add(kv.key().c_str());
+      // Each member maps to the user's name
+      const char *name = kv.value().as<const char *>();
+      if (name != nullptr)
+      {
+        userNames.put(kv.key().c_str(), name, millis());
+      }
+    }
+    xSemaphoreGive(userNamesLock);
+    LOG_INFOF("Roster for class %s loaded: %u students\n", classId.c_str(), (unsigned)fresh.size());
+  }
+  else
+  {
+    // No roster published for this class; scans fall back to live lookups.
+    LOG_INFO("No roster published for class " + classId);
+  }
+
+  xSemaphoreTake(rosterLock, portMAX_DELAY);
+  activeRoster.swap(fresh);
+  xSemaphoreGive(rosterLock);
+  // Only this task swaps the roster, so it can be read without the lock
+  bootCache.saveRoster(LittleFS, activeRoster);
+}
+
+// --- rosterLookup ---
+// Answers from the cached roster only; never touches the network.
+RosterAnswer rosterLookup(const char *userId, const char *classId)
+{
+  RosterAnswer answer = ROSTER_UNAVAILABLE;
+  xSemaphoreTake(rosterLock, portMAX_DELAY);
+  if (activeRoster.isLoadedFor(classId))
+  {
+    answer = activeRoster.contains(userId) ? ROSTER_MEMBER : ROSTER_NOT_MEMBER;
+  }
+  xSemaphoreGive(rosterLock);
+  return answer;
+}
+
+// Queues a job for the network stage without blocking the caller.
+bool postNetworkJob(NetworkJobType type, const char *userId, const char *classId, uint32_t scanId)
+{
+  NetworkJob job;
+  memset(&job, 0, sizeof(job));
+  if (strlen(userId) >= sizeof(job.userId) || strlen(classId) >= sizeof(job.classId))
+  {
+    LOG_WARNF("Network job for %s dropped, ID too long\n", userId);
+    return false;
+  }
+  job.type = type;
+  job.scanId = scanId;
+  strcpy(job.userId, userId);
+  strcpy(job.classId, classId);
+  if (networkQueue == NULL || xQueueSend(networkQueue, &job, 0) != pdTRUE)
+  {
+    LOG_WARN("Network queue full, job dropped");
+    return false;
+  }
+  return true;
+}
+
+// Hands an answer from the network stage back to the decision stage.
+void postVerdict(DecisionMessageType type, Verdict verdict, const NetworkJob &job)
+{
+  DecisionMessage message;
+  memset(&message, 0, sizeof(message));
+  message.type = type;
+  message.verdict = verdict;
+  message.scanId = job.scanId;
+  strncpy(message.userId, job.userId, sizeof(message.userId) - 1);
+  strncpy(message.classId, job.classId, sizeof(message.classId) - 1);
+  message.capturedAt = millis();
+  if (xQueueSend(decisionQueue, &message, 1000 / portTICK_PERIOD_MS) != pdTRUE)
+  {
+    LOG_WARN("Decision queue full, verdict dropped");
+  }
+}
+
+// --- decodeTask ---
+// First stage, next to the QR scanner. Decodes QR codes into user IDs and
+// queues them for the decision stage without waiting on it. A code is passed
+// on once per presentation: it has to leave the view for codeRemovalThreshold
+// before it counts again. When the queue is full the scan is dropped and
+// taken again from the next frame the code is still in view. Like the
+// decision stage, it makes no heap allocation per scan.
+void decodeTask(void *pvParameters)
+{
+  struct QRCodeData qrCodeData;
+  QrScanTiming timing;
+
+  while (true)
+  {
+    if (!scanningEnabled)
+    {
+      vTaskDelay(100 / portTICK_PERIOD_MS);
+      continue;
+    }
+
+    if (!qrScanner.receiveQrCode(&qrCodeData, 100, &timing))
+    {
+      continue;
+    }
+    if (!qrCodeData.valid)
+    {
+      LOG_INFO("QR Code detected but invalid.");
+      continue;
+    }
+
+    uint64_t codeHash = EnrollmentRoster::hashId((const char *)qrCodeData.payload);
+    unsigned long now = millis();
+    bool samePresentation = codeHash == lastCodeHash && now - lastCodeSeen < codeRemovalThreshold;
+    lastCodeHash = codeHash;
+    lastCodeSeen = now;
+    if (hallPassHeld && (uint32_t)codeHash == hallPassCode)
+    {
+      hallPassSeen = now;
+    }
+    if (samePresentation)
+    {
+      continue;
+    }
+    uint32_t scanId = scanTrace.beginScan(timing.capturedAt);
+    scanTrace.record(TRACE_DECODE, scanId, timing.decodeStart, timing.decodeEnd);
+
+    const char *payload = (const char *)qrCodeData.payload;
+    LOG_DEBUGF("QR Code scanned: %s\n", payload);
+    DecisionMessage message;
+    memset(&message, 0, sizeof(message));
+    if (QrTokenVerifier::isToken(payload))
+    {
+      // Signed code: checked here, so the decision needs no lookup. A
+      // restored clock runs behind, so it would take expired tokens for
+      // valid ones; until NTP syncs the token only names the user.
+      int64_t verifyStart = esp_timer_get_time();
+      uint32_t tokenClock = clockRestored ? 0 : (uint32_t)time(nullptr);
+      QrTokenStatus status = tokenVerifier.verify(payload, tokenClock, message.userId,
+                                                  sizeof(message.userId), message.classes,
+                                                  sizeof(message.classes));
+      scanTrace.record(TRACE_TOKEN_VERIFY, scanId, verifyStart);
+      message.credential = status == TOKEN_VALID     ? CREDENTIAL_TOKEN
+                           : status == TOKEN_NO_CLOCK ? CREDENTIAL_TOKEN_ID
+                                                      : CREDENTIAL_BAD_TOKEN;
+      if (message.credential == CREDENTIAL_BAD_TOKEN)
+      {
+        LOG_WARNF("Signed QR code refused: %s\n", QrTokenVerifier::statusName(status));
+      }
+    }
+    else
+    {
+      // The payload is the user ID in hex; decode it straight into the message
+      int64_t hexStart = esp_timer_get_time();
+      bool decoded = decodeHex(payload, message.userId, sizeof(message.userId));
+      scanTrace.record(TRACE_DECODE_HEX, scanId, hexStart);
+      if (!decoded)
+      {
+        LOG_WARN("QR Code is not a user ID, ignored.");
+        continue;
+      }
+      message.credential = CREDENTIAL_USER_ID;
+    }
+    LOG_DEBUGF("Decoded user ID: %s\n", message.userId);
+
+    message.type = MSG_SCAN;
+    message.capturedAt = now;
+    message.scanId = scanId;
+    message.codeHash = codeHash;
+    if (xQueueSend(decisionQueue, &message, 0) != pdTRUE)
+    {
+      droppedScans++;
+      lastCodeHash = 0;
+      LOG_WARNF("Scan queue full, scan dropped (%u so far)\n", (unsigned)droppedScans);
+    }
+  }
+}
+
+// Remembers how a scan came out, for repeat scans inside the cooldown.
+void settleScan(const char *userId, RecentOutcome outcome, const char *message)
+{
+  recentScans.settle(userId, outcome, message, millis(), userCooldownPeriod);
+}
+
+// Logs who was let in. The name is only for the log, so a cache miss is
+// left to the network stage and quiet builds skip it altogether.
+void logUserName(const char *userId, const char *classId, uint32_t scanId)
+{
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  char name[NAME_CACHE_NAME_SIZE];
+  xSemaphoreTake(userNamesLock, portMAX_DELAY);
+  bool cached = userNames.get(userId, millis(), name, sizeof(name));
+  xSemaphoreGive(userNamesLock);
+  if (cached)
+  {
+    LOG_INFOF("Valid user (%s) detected, processing attendance...\n", name);
+  }
+  else
+  {
+    postNetworkJob(NET_LOG_USER_NAME, userId, classId, scanId);
+  }
+#endif
+}
+
+// Keeps the open log index in step with what markAttendance will make of
+// a time-in: with a log of the day still open the scan closes it,
+// otherwise it opens logKey.
+void trackTimeIn(const char *userId, const char *classId, const char *logKey)
+{
+  uint32_t now = (uint32_t)time(nullptr);
+  char today[11];
+  char timeStr[9];
+  formatLogTime(now, today, sizeof(today), timeStr, sizeof(timeStr));
+  char openKey[sizeof(ScanEvent::logKey)];
+  if (openLogs.find(userId, classId, now, openKey, sizeof(openKey)) && strncmp(openKey, today, strlen(today)) == 0)
+  {
+    openLogs.closed(userId, classId);
+  }
+  else
+  {
+    openLogs.opened(userId, classId, logKey, now);
+  }
+}
+
+// Opens the door for an enrolled student and journals the time-in.
+void admitUser(const char *userId, const char *classId, uint32_t scanId)
+{
+  if (burstEntry)
+  {
+    // The door is held open; a chirp tells the student the scan counted.
+    // In the trace it stands in for the relay.
+    playTone(burstChirpFrequency, burstChirpDuration);
+  }
+  else
+  {
+    // --- Successful QR scan buzzer ---
+    // This tone indicates that a valid QR scan for an enrolled user is detected.
+    playTone(2000, 300);
+    updateOLEDMessage("Processing Attendance");
+    actuator.pulseRelay(doorOpenTime);
+    LOG_INFO("Relay ON");
+  }
+  scanTrace.recordSinceCapture(TRACE_RELAY, scanId);
+  logUserName(userId, classId, scanId);
+
+  char logKey[sizeof(ScanEvent::logKey)];
+  newLogKey((uint32_t)time(nullptr), logKey, sizeof(logKey));
+  if (recordScan(userId, classId, SCAN_TIME_IN, logKey))
+  {
+    trackTimeIn(userId, classId, logKey);
+    updateOLEDMessage("Attendance Recorded");
+    if (!burstEntry)
+    {
+      actuator.rest(150);
+      playTone(2000, 300);
+    }
+  }
+  settleScan(userId, RECENT_OPENED, "Attendance Recorded");
+}
+
+void rejectUser(const char *userId)
+{
+  // --- Unenrolled buzzer ---
+  // This tone indicates the user is not enrolled in the current active class.
+  playTone(2000, 1000);
+  LOG_INFOF("User not enrolled in the active class: %s\n", userId);
+  updateOLEDMessage("Not Enrolled");
+  settleScan(userId, RECENT_REFUSED, "Not Enrolled");
+}
+
+// Refuses a code that proves nothing: a token that failed its check, or an
+// unsigned code once those are turned off.
+void rejectCode(const char *reason)
+{
+  playTone(2000, 1000);
+  LOG_INFOF("QR code refused: %s\n", reason);
+  updateOLEDMessage(reason);
+}
+
+// Answers a repeat scan with the user's last decision: an open door opens
+// again, a refusal is refused again, and no attendance is written twice.
+void replayDecision(const DecisionMessage &message, const RecentDecision &decision)
+{
+  LOG_INFOF("Repeat scan of %s, answered from the last decision\n", message.userId);
+  switch (decision.outcome)
+  {
+  case RECENT_OPENED:
+    actuator.pulseRelay(doorOpenTime);
+    scanTrace.recordSinceCapture(TRACE_RELAY, message.scanId);
+    if (burstEntry)
+    {
+      playTone(burstChirpFrequency, burstChirpDuration);
+    }
+    else
+    {
+      playTone(2000, 300);
+    }
+    break;
+  case RECENT_REFUSED:
+    playTone(2000, 1000);
+    break;
+  case RECENT_PENDING:
+    updateOLEDMessage("Still checking...");
+    return;
+  case RECENT_NOTED:
+    break;
+  }
+  updateOLEDMessage(decision.message);
+}
+
+// --- handleScan ---
+// Door decision for a freshly decoded code. A signed code that names the
+// class opens the door at once; everything else that needs the backend is
+// handed to the network stage and finished by a verdict.
+void handleScan(const DecisionMessage &message)
+{
+  const char *userId = message.userId;
+  ClassState current = currentClass();
+  const char *activeClass = current.activeId;
+  const char *lastActiveClass = current.lastId;
+  bool signedForClass = message.credential == CREDENTIAL_TOKEN;
+  LOG_DEBUGF("QR Code scanned: %s\n", userId);
+
+  if (message.credential == CREDENTIAL_BAD_TOKEN)
+  {
+    rejectCode("Invalid code");
+    return;
+  }
+  if (message.credential == CREDENTIAL_USER_ID && !acceptUnsignedCodes)
+  {
+    rejectCode("Unsigned code");
+    return;
+  }
+
+  // Special handling for hall pass: hold the door while it stays in view
+  if (strcmp(userId, "hallpasstest") == 0)
+  {
+    LOG_INFO("Hall pass QR code detected, activating relay...");
+    playTone(1500, 300);
+    actuator.holdRelay();
+    scanTrace.recordSinceCapture(TRACE_RELAY, message.scanId);
+    updateOLEDMessage("Hall Pass Detected!");
+    // decisionTask releases it once this pass is out of view
+    hallPassCode = (uint32_t)message.codeHash;
+    hallPassSeen = millis();
+    hallPassHeld = true;
+    return;
+  }
+
+  // A decision made for the same class stands until the cooldown runs out
+  const char *scanClass = current.found ? activeClass : "";
+  RecentDecision recent;
+  if (recentScans.find(userId, scanClass, millis(), recent))
+  {
+    replayDecision(message, recent);
+    return;
+  }
+  recentScans.begin(userId, scanClass, millis(), userCooldownPeriod);
+
+  // Always attempt to update timeout for the previous (last active) class for this user.
+  // The door only opens for a student with an open log: one this scanner
+  // opened is known locally, any other takes a read.
+  char openLogKey[sizeof(ScanEvent::logKey)] = "";
+  bool logIndexed = lastActiveClass[0] != '\0' &&
+                    openLogs.find(userId, lastActiveClass, (uint32_t)time(nullptr), openLogKey, sizeof(openLogKey));
+  if (logIndexed ||
+      (lastActiveClass[0] != '\0' && signedForClass && QrTokenVerifier::allowsClass(message.classes, lastActiveClass)))
+  {
+    // Let them out now; with no known log the uploader looks it up
+    actuator.pulseRelay(doorOpenTime);
+    scanTrace.recordSinceCapture(TRACE_RELAY, message.scanId);
+    if (recordScan(userId, lastActiveClass, SCAN_TIME_OUT, openLogKey))
+    {
+      openLogs.closed(userId, lastActiveClass);
+    }
+    LOG_INFOF("Time-out for user: %s in class %s\n", userId, lastActiveClass);
+    updateOLEDMessage("Timeout Saved");
+    playTone(2000, 300);
+    settleScan(userId, RECENT_OPENED, "Timeout Saved");
+  }
+  else if (lastActiveClass[0] != '\0')
+  {
+    LOG_DEBUGF("Updating timeout for lastActiveClassId: %s\n", lastActiveClass);
+    updateOLEDMessage("Updating Timeout...");
+    if (!postNetworkJob(NET_FIND_OPEN_LOG, userId, lastActiveClass, message.scanId))
+    {
+      // Keep the time-out; the uploader looks for the open log later.
+      recordScan(userId, lastActiveClass, SCAN_TIME_OUT);
+      updateOLEDMessage("Timeout Saved");
+      settleScan(userId, RECENT_NOTED, "Timeout Saved");
+    }
+  }
+  else
+  {
+    LOG_DEBUG("No lastActiveClassId to update.");
+  }
+
+  // Process attendance for the current active class if present
+  if (current.found && activeClass[0] != '\0' && signedForClass &&
+      QrTokenVerifier::allowsClass(message.classes, activeClass))
+  {
+    LOG_DEBUGF("Signed code of %s admits to class: %s\n", userId, activeClass);
+    admitUser(userId, activeClass, message.scanId);
+  }
+  // A signed code without the class may predate the enrollment; check as usual
+  else if (current.found && activeClass[0] != '\0')
+  {
+    int64_t lookupStart = esp_timer_get_time();
+    RosterAnswer answer = rosterLookup(userId, activeClass);
+    scanTrace.record(TRACE_ENROLLMENT, message.scanId, lookupStart);
+    if (answer == ROSTER_MEMBER)
+    {
+      LOG_DEBUGF("User %s found in roster of class: %s\n", userId, activeClass);
+      admitUser(userId, activeClass, message.scanId);
+    }
+    // Not in the cached roster (or none loaded): a student enrolled since the
+    // last refresh is not in it yet, so let the backend decide.
+    else if (postNetworkJob(NET_VERIFY_ENROLLMENT, userId, activeClass, message.scanId))
+    {
+      updateOLEDMessage("Checking Enrollment");
+    }
+    else
+    {
+      rejectUser(userId);
+    }
+  }
+  else
+  {
+    LOG_INFO("No active class to mark attendance.");
+    updateOLEDMessage("No active class");
+    settleScan(userId, RECENT_NOTED, "No active class");
+  }
+}
+
+void handleEnrollmentVerdict(const DecisionMessage &message)
+{
+  const char *userId = message.userId;
+  const char *classId = message.classId;
+  if (strcmp(classId, currentClass().activeId) != 0)
+  {
+    LOG_WARNF("Class %s ended before enrollment of %s was confirmed\n", classId, userId);
+    return;
+  }
+  if (message.verdict == VERDICT_YES)
+  {
+    // The roster is behind the backend; fetch it again
+    rosterRefreshRequested = true;
+    wakeLoop();
+    admitUser(userId, classId, message.scanId);
+  }
+  else
+  {
+    rejectUser(userId);
+  }
+}
+
+void handleTimeoutVerdict(const DecisionMessage &message)
+{
+  const char *userId = message.userId;
+  const char *classId = message.classId;
+  if (message.verdict == VERDICT_YES)
+  {
+    actuator.pulseRelay(doorOpenTime);
+    scanTrace.recordSinceCapture(TRACE_RELAY, message.scanId);
+    LOG_INFOF("Attendance timeout recorded for user: %s in class %s\n", userId, classId);
+    updateOLEDMessage("Timeout Updated");
+    playTone(2000, 300);
+    settleScan(userId, RECENT_OPENED, "Timeout Updated");
+  }
+  else if (message.verdict == VERDICT_UNKNOWN)
+  {
+    updateOLEDMessage("Timeout Saved");
+    settleScan(userId, RECENT_NOTED, "Timeout Saved");
+  }
+  else
+  {
+    LOG_INFOF("No open attendance log found for class %s for user %s\n", classId, userId);
+    updateOLEDMessage("No open log");
+    settleScan(userId, RECENT_NOTED, "No open log");
+  }
+}
+
+// Holds the door for burst entry, or lets it close again once it is over.
+void handleBurstEntry(const DecisionMessage &message)
+{
+  burstEntry = message.verdict == VERDICT_YES;
+  if (burstEntry)
+  {
+    actuator.holdRelay();
+    LOG_INFOF("Burst entry: door held open for %d min\n", burstEntryLength);
+    updateOLEDMessage("Door open, scan in");
+  }
+  else
+  {
+    // A hall pass still in view keeps the door until it is taken away
+    if (!hallPassHeld)
     {
-      String payload = http.getString();
-      http.end();
+      actuator.releaseRelay(doorOpenTime);
+    }
+    LOG_INFO("Burst entry over");
+    updateOLED(currentClass().name);
+  }
+}
+
+// --- decisionTask ---
+// Second stage: the only task that drives the relay, buzzer and display
+// for scans. Takes fresh scans, network verdicts and burst entry changes
+// from one queue, in order.
+// Feedback goes through the actuator, so no message waits on a tone or a
+// door pulse; while a hall pass is held the task also wakes every 100 ms to
+// see whether it has been taken away.
+void decisionTask(void *pvParameters)
+{
+  DecisionMessage message;
 
-      struct tm timeinfo;
-      if (!getLocalTime(&timeinfo))
+  while (true)
+  {
+    TickType_t wait = hallPassHeld ? 100 / portTICK_PERIOD_MS : portMAX_DELAY;
+    bool received = xQueueReceive(decisionQueue, &message, wait) == pdTRUE;
+
+    if (hallPassHeld && millis() - hallPassSeen >= codeRemovalThreshold)
+    {
+      hallPassHeld = false;
+      if (!burstEntry)
       {
-        Serial.println("Failed to obtain time");
-        return;
+        actuator.releaseRelay(doorOpenTime);
       }
-      char dateStr[11];
-      snprintf(dateStr, sizeof(dateStr), "%04d-%02d-%02d",
-               timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+      LOG_INFO("Hall pass removed, relay closing.");
+      updateOLED(currentClass().name);
+    }
+    if (!received)
+    {
+      continue;
+    }
+    switch (message.type)
+    {
+    case MSG_SCAN:
+      handleScan(message);
+      break;
+    case MSG_ENROLLMENT_VERDICT:
+      handleEnrollmentVerdict(message);
+      break;
+    case MSG_TIMEOUT_VERDICT:
+      handleTimeoutVerdict(message);
+      break;
+    case MSG_BURST_ENTRY:
+      handleBurstEntry(message);
+      break;
+    }
+  }
+}
 
-      char timeStr[9];
-      int hour = timeinfo.tm_hour;
-      String period = (hour >= 12) ? "PM" : "AM";
-      hour = (hour > 12) ? (hour - 12) : (hour == 0 ? 12 : hour);
-      snprintf(timeStr, sizeof(timeStr), "%02d:%02d %s", hour, timeinfo.tm_min, period.c_str());
+// Percent-encodes text into out. Returns false if it does not fit.
+bool encodeURIComponent(const char *text, char *out, size_t outSize)
+{
+  static const char digits[] = "0123456789ABCDEF";
+  size_t length = 0;
+  for (; *text != '\0'; text++)
+  {
+    unsigned char c = (unsigned char)*text;
+    bool plain = isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~';
+    if (length + (plain ? 1 : 3) >= outSize)
+    {
+      return false;
+    }
+    if (plain)
+    {
+      out[length++] = (char)c;
+    }
+    else
+    {
+      out[length++] = '%';
+      out[length++] = digits[c >> 4];
+      out[length++] = digits[c & 0x0F];
+    }
+  }
+  out[length] = '\0';
+  return true;
+}
 
-      if (payload == "false")
-      {
-        http.begin(client, attendanceUrl);
-        http.addHeader("Content-Type", "application/json");
-        int putCode = http.PUT("true");
-        http.end();
+// snprintf() into out. Returns false, and logs, if the result was cut short.
+bool formatText(char *out, size_t outSize, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(out, outSize, format, args);
+  va_end(args);
+  if (length < 0 || (size_t)length >= outSize)
+  {
+    LOG_WARNF("Text too long for its buffer (%d bytes): %s\n", length, format);
+    return false;
+  }
+  return true;
+}
 
-        if (putCode == HTTP_CODE_OK)
-        {
-          Serial.println("Attendance marked for user: " + userId);
-
-          String logUrl = String(apiUrl) + "logins/" + userId + "/enrolledClasses/" + classId + "/attendanceLogs.json";
-          http.begin(client, logUrl);
-          http.addHeader("Content-Type", "application/json");
-          String logPayload = "{\"date\":\"" + String(dateStr) +
-                              "\",\"time_in\":\"" + String(timeStr) +
-                              "\",\"scanner_in\":\"" + scannerIdTimeIn + "\"}";
-          int postCode = http.POST(logPayload);
-          http.end();
-
-          if (postCode == HTTP_CODE_OK)
-          {
-            Serial.println("Attendance log (time-in) added for user: " + userId);
-            updateOLEDMessage("Attendance Recorded");
-            delay(1500); // Let the user read the message
-            playTone(2000, 300);
-          }
-          else
-          {
-            Serial.printf("Failed to add attendance log (time in). HTTP error code: %d\n", postCode);
-          }
-        }
-        else
-        {
-          Serial.printf("Failed to mark attendance. HTTP error code: %d\n", putCode);
-        }
-      }
-      else
+// Copies text into out with the characters a JSON string cannot hold as
+// they are escaped. Returns false if it does not fit.
+bool escapeJson(const char *text, char *out, size_t outSize)
+{
+  size_t length = 0;
+  for (; *text != '\0'; text++)
+  {
+    unsigned char c = (unsigned char)*text;
+    char escaped[7];
+    if (c == '"' || c == '\\')
+    {
+      snprintf(escaped, sizeof(escaped), "\\%c", c);
+    }
+    else if (c < 0x20)
+    {
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+    }
+    else
+    {
+      escaped[0] = (char)c;
+      escaped[1] = '\0';
+    }
+    size_t escapedLength = strlen(escaped);
+    if (length + escapedLength >= outSize)
+    {
+      return false;
+    }
+    memcpy(out + length, escaped, escapedLength);
+    length += escapedLength;
+  }
+  out[length] = '\0';
+  return true;
+}
+
+// Whether id names exactly one node when put in a database path. A '/'
+// would make it several, so one user's ID could address another user's
+// data, escaped or not. Other characters keys may not hold are left for
+// the backend to refuse.
+bool pathSafeId(const char *id)
+{
+  for (; *id != '\0'; id++)
+  {
+    if (*id == '/' || (unsigned char)*id < 0x20 || *id == 0x7F)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// logins/<user>/enrolledClasses/<class> for a request URL, both IDs
+// percent-encoded. Returns false for an ID that is not path-safe or a
+// path that does not fit.
+bool enrollmentUrl(const char *userId, const char *classId, char *out, size_t outSize)
+{
+  char encodedUserId[encodedUserIdSize];
+  char encodedClassId[encodedClassIdSize];
+  return pathSafeId(userId) && pathSafeId(classId) &&
+         encodeURIComponent(userId, encodedUserId, sizeof(encodedUserId)) &&
+         encodeURIComponent(classId, encodedClassId, sizeof(encodedClassId)) &&
+         formatText(out, outSize, "logins/%s/enrolledClasses/%s", encodedUserId, encodedClassId);
+}
+
+// The same path as a key of a multi-path PATCH body, JSON-escaped.
+bool enrollmentKey(const char *userId, const char *classId, char *out, size_t outSize)
+{
+  char escapedUserId[encodedUserIdSize];
+  char escapedClassId[encodedClassIdSize];
+  return pathSafeId(userId) && pathSafeId(classId) && escapeJson(userId, escapedUserId, sizeof(escapedUserId)) &&
+         escapeJson(classId, escapedClassId, sizeof(escapedClassId)) &&
+         formatText(out, outSize, "logins/%s/enrolledClasses/%s", escapedUserId, escapedClassId);
+}
+
+String getCurrentDay()
+{
+  struct tm timeinfo;
+  if (!getLocalTime(&timeinfo))
+  {
+    LOG_WARN("Failed to obtain time");
+    return "";
+  }
+  const char *daysOfWeek[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
+  return String(daysOfWeek[timeinfo.tm_wday]);
+}
+
+// Key of the attendance log a time-in at timestamp opens: the date, which
+// keeps a student's logs in time order, and a random event ID.
+void newLogKey(uint32_t timestamp, char *logKey, size_t logKeySize)
+{
+  char dateStr[11];
+  char timeStr[9];
+  formatLogTime(timestamp, dateStr, sizeof(dateStr), timeStr, sizeof(timeStr));
+  snprintf(logKey, logKeySize, "%s_%08x", dateStr, (unsigned)esp_random());
+}
+
+// --- recordScan ---
+// Journals a scan for delivery by networkTask. Returns once the event is in
+// flash; never touches the network. An ID too long for the event is refused,
+// never cut short: the shortened one would name another user or class. A
+// time-in without a log key gets a new one.
+bool recordScan(const char *userId, const char *classId, ScanDirection direction, const char *logKey)
+{
+  ScanEvent event;
+  memset(&event, 0, sizeof(event));
+  if (strlen(userId) >= sizeof(event.userId) || strlen(classId) >= sizeof(event.classId) ||
+      strlen(logKey) >= sizeof(event.logKey))
+  {
+    LOG_ERRORF("Scan not journaled, ID too long: %s in %s\n", userId, classId);
+    return false;
+  }
+  strcpy(event.userId, userId);
+  strcpy(event.classId, classId);
+  strcpy(event.logKey, logKey);
+  event.timestamp = (uint32_t)time(nullptr);
+  if (direction == SCAN_TIME_IN && event.logKey[0] == '\0')
+  {
+    newLogKey(event.timestamp, event.logKey, sizeof(event.logKey));
+  }
+  const String &scannerId = (direction == SCAN_TIME_IN) ? scannerIdTimeIn : scannerIdTimeOut;
+  strncpy(event.scannerId, scannerId.c_str(), sizeof(event.scannerId) - 1);
+  event.direction = direction;
+
+  if (!scanJournal.append(event))
+  {
+    LOG_ERRORF("Failed to journal scan for user: %s\n", userId);
+    return false;
+  }
+  if (gatewayLink.connected())
+  {
+    wakeLoop(); // loop() streams it to the gateway
+  }
+  else
+  {
+    postNetworkJob(NET_FLUSH_JOURNAL, "", "");
+  }
+  return true;
+}
+
+// Runs one job for the decision stage and posts back any verdict.
+void runNetworkJob(const NetworkJob &job)
+{
+  const char *userId = job.userId;
+  const char *classId = job.classId;
+  switch (job.type)
+  {
+  case NET_VERIFY_ENROLLMENT:
+  {
+    Verdict verdict = VERDICT_UNKNOWN;
+    if (WiFi.status() == WL_CONNECTED)
+    {
+      int64_t start = esp_timer_get_time();
+      verdict = isUserEnrolledInClass(userId, classId) ? VERDICT_YES : VERDICT_NO;
+      scanTrace.record(TRACE_ENROLLMENT, job.scanId, start);
+    }
+    postVerdict(MSG_ENROLLMENT_VERDICT, verdict, job);
+    break;
+  }
+  case NET_FIND_OPEN_LOG:
+  {
+    // The write itself goes through the journal either way
+    char logKey[sizeof(ScanEvent::logKey)];
+    int64_t start = esp_timer_get_time();
+    OpenLogResult result = findOpenLog(userId, classId, logKey, sizeof(logKey));
+    scanTrace.record(TRACE_TIMEOUT_UPDATE, job.scanId, start);
+    Verdict verdict = VERDICT_NO;
+    if (result == OPEN_LOG_FOUND)
+    {
+      recordScan(userId, classId, SCAN_TIME_OUT, logKey);
+      verdict = VERDICT_YES;
+    }
+    else if (result == OPEN_LOG_UNKNOWN)
+    {
+      recordScan(userId, classId, SCAN_TIME_OUT);
+      verdict = VERDICT_UNKNOWN;
+    }
+    // A refused query means an ID the backend will never take: nothing to journal
+    postVerdict(MSG_TIMEOUT_VERDICT, verdict, job);
+    break;
+  }
+  case NET_LOG_USER_NAME:
+  {
+    int64_t start = esp_timer_get_time();
+    char userFullName[NAME_CACHE_NAME_SIZE];
+    if (getUserFullName(userId, userFullName, sizeof(userFullName)))
+    {
+      xSemaphoreTake(userNamesLock, portMAX_DELAY);
+      userNames.put(userId, userFullName, millis());
+      xSemaphoreGive(userNamesLock);
+    }
+    scanTrace.record(TRACE_NAME_FETCH, job.scanId, start);
+    LOG_INFOF("Valid user (%s) detected, processing attendance...\n", userFullName);
+    break;
+  }
+  case NET_FLUSH_JOURNAL:
+    break; // the journal is drained below once the queue is empty
+  }
+}
+
+// --- networkTask ---
+// Third stage: every backend round trip of the scan path. Jobs a door
+// decision is waiting on go first; the scan journal is drained one batch at
+// a time whenever the job queue is empty, and retried after a failure.
+// While the gateway link is up, loop() streams the journal there instead.
+void networkTask(void *pvParameters)
+{
+  NetworkJob job;
+  unsigned long lastUploadFailure = 0;
+  bool uploadFailed = false;
+
+  while (true)
+  {
+    if (xQueueReceive(networkQueue, &job, 1000 / portTICK_PERIOD_MS) == pdTRUE)
+    {
+      runNetworkJob(job);
+      heapMonitor.sample(); // the backend connection's TLS buffers are still held
+    }
+
+    if (uxQueueMessagesWaiting(networkQueue) == 0 && WiFi.status() == WL_CONNECTED && !gatewayLink.connected() &&
+        scanJournal.pending() > 0 && (!uploadFailed || millis() - lastUploadFailure >= journalRetryInterval))
+    {
+      uploadFailed = !uploadJournalBatch();
+      if (uploadFailed)
       {
-        Serial.println("Attendance already marked for user: " + userId + " in class " + classId);
-        updateTimeoutForClass(userId, classId);
+        lastUploadFailure = millis();
       }
     }
+  }
+}
+
+// Delivers the oldest batch of journaled scans in order. An event is acked
+// once the backend has it, or once the backend has refused it for good, so
+// one bad event cannot hold back the ones behind it. Acks go by sequence
+// number: events the ring dropped meanwhile are not counted as delivered.
+// Returns false if the batch stopped early.
+bool uploadJournalBatch()
+{
+  xSemaphoreTake(journalUploadLock, portMAX_DELAY);
+  ScanEvent batch[journalUploadBatch];
+  uint32_t seqs[journalUploadBatch];
+  size_t count = scanJournal.peekFrom(scanJournal.firstPending(), batch, seqs, journalUploadBatch);
+  size_t delivered = 0;
+  for (; delivered < count; delivered++)
+  {
+    const ScanEvent &event = batch[delivered];
+    int64_t start = esp_timer_get_time();
+    UploadResult result;
+    if (event.direction == SCAN_TIME_IN)
+    {
+      result = markAttendance(event);
+      scanTrace.record(TRACE_ATTENDANCE_WRITE, 0, start);
+    }
     else
     {
-      Serial.printf("Failed to fetch attendance status. HTTP error code: %d\n", httpCode);
-      http.end();
+      result = updateTimeoutForClass(event);
+      scanTrace.record(TRACE_TIMEOUT_UPDATE, 0, start);
+    }
+    if (result == UPLOAD_RETRY)
+    {
+      break;
+    }
+    if (result == UPLOAD_REJECTED)
+    {
+      LOG_ERRORF("Backend refused the scan of %s in %s, dropped\n", event.userId, event.classId);
     }
   }
-  else
+  if (delivered > 0)
+  {
+    scanJournal.ackThrough(seqs[delivered - 1]);
+  }
+  xSemaphoreGive(journalUploadLock);
+  if (delivered < count)
   {
-    Serial.println("WiFi not connected!");
+    LOG_WARNF("Journal upload stopped, %u event(s) pending\n", (unsigned)scanJournal.pending());
+    return false;
   }
+  return true;
 }
 
-void updateTimeoutForClass(const String &userId, const String &classId)
+// A response that says whether sending again could help: transport errors
+// and server errors may pass, a request the backend refused will not.
+UploadResult uploadResultFor(int httpCode)
 {
-  if (WiFi.status() != WL_CONNECTED)
+  if (httpCode == HTTP_CODE_OK)
   {
-    Serial.println("WiFi not connected!");
-    return;
+    return UPLOAD_OK;
   }
+  return httpCode >= 400 && httpCode < 500 ? UPLOAD_REJECTED : UPLOAD_RETRY;
+}
 
-  // Do not immediately activate the relay.
-  bool updateSuccess = false;
-  bool openLogFound = false;
+// Formats an epoch timestamp as the date and 12-hour time used in attendance logs.
+void formatLogTime(uint32_t timestamp, char *dateStr, size_t dateLen, char *timeStr, size_t timeLen)
+{
+  time_t t = (time_t)timestamp;
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  snprintf(dateStr, dateLen, "%04d-%02d-%02d",
+           timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday);
+
+  int hour = timeinfo.tm_hour;
+  const char *period = (hour >= 12) ? "PM" : "AM";
+  hour = (hour > 12) ? (hour - 12) : (hour == 0 ? 12 : hour);
+  snprintf(timeStr, timeLen, "%02d:%02d %s", hour, timeinfo.tm_min, period);
+}
 
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient http;
-  String logUrl = String(apiUrl) + "logins/" + userId + "/enrolledClasses/" + classId + "/attendanceLogs.json";
-  http.begin(client, logUrl);
-  int logCode = http.GET();
+// --- markAttendance ---
+// Delivers a journaled time-in. Each time-in opens a log of its own under
+// the key it was journaled with, so a retry finds its own earlier write and
+// a second visit in a day gets a second log. While another log of the day
+// is still open the time-in closes that one instead, and leaves its key in
+// closed_by for a retry to find. A new log is one root-level multi-path
+// PATCH (attendance flag plus log) that either applies completely or not
+// at all, and only goes under an enrollment that still exists: a PATCH
+// under a deleted one would bring it back and put the student on the class
+// roster again.
+UploadResult markAttendance(const ScanEvent &event)
+{
+  const char *userId = event.userId;
+  const char *classId = event.classId;
 
-  if (logCode == HTTP_CODE_OK)
+  char dateStr[11];
+  char timeStr[9];
+  formatLogTime(event.timestamp, dateStr, sizeof(dateStr), timeStr, sizeof(timeStr));
+  // Time-ins journaled before they carried keys wrote the log under the date
+  const char *logKey = event.logKey[0] != '\0' ? event.logKey : dateStr;
+
+  // The URL carries the IDs percent-encoded, the PATCH body JSON-escaped
+  char enrollmentPath[backendPathSize];
+  char enrollmentField[backendPathSize];
+  char escapedScannerId[sizeof(event.scannerId) * 2];
+  char escapedLogKey[sizeof(event.logKey) * 2];
+  char path[backendPathSize];
+  if (!enrollmentUrl(userId, classId, enrollmentPath, sizeof(enrollmentPath)) ||
+      !enrollmentKey(userId, classId, enrollmentField, sizeof(enrollmentField)) || !pathSafeId(logKey) ||
+      !escapeJson(event.scannerId, escapedScannerId, sizeof(escapedScannerId)) ||
+      !escapeJson(logKey, escapedLogKey, sizeof(escapedLogKey)) ||
+      !formatText(path, sizeof(path),
+                  "%s/attendanceLogs.json?orderBy=%%22%%24key%%22&startAt=%%22%s%%22&endAt=%%22%s~%%22"
+                  "&limitToLast=%d",
+                  enrollmentPath, dateStr, dateStr, openLogSearchDepth))
   {
-    String logPayload = http.getString();
-    http.end();
+    LOG_ERRORF("Cannot address the attendance of %s in %s\n", userId, classId);
+    return UPLOAD_REJECTED; // can never be sent
+  }
 
-    DynamicJsonDocument doc(2048);
-    DeserializationError error = deserializeJson(doc, logPayload);
-    if (error)
+  // The day's logs: keys start with the date, so the server picks them out
+  static StaticJsonDocument<96> filter;
+  if (filter.isNull())
+  {
+    filter["*"]["time_in"] = true;
+    filter["*"]["time_out"] = true;
+    filter["*"]["closed_by"] = true;
+  }
+  static StaticJsonDocument<1024> doc;
+  DeserializationError error;
+  int httpCode = backend.getJson(path, doc, &filter, &error);
+  if (httpCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Failed to fetch attendance status. HTTP error code: %d\n", httpCode);
+    return uploadResultFor(httpCode);
+  }
+  if (error)
+  {
+    LOG_WARN("Failed to parse attendance logs JSON");
+    return UPLOAD_RETRY;
+  }
+
+  const char *openKey = nullptr;
+  for (JsonPair kv : doc.as<JsonObject>())
+  {
+    JsonObject log = kv.value().as<JsonObject>();
+    if (strcmp(kv.key().c_str(), logKey) == 0 || log["closed_by"] == logKey)
     {
-      Serial.println("Failed to parse attendance logs JSON");
-      digitalWrite(RELAY_PIN, HIGH); // Ensure relay remains off
-      return;
+      // Our own earlier write whose response was lost
+      LOG_INFOF("Attendance already recorded for this scan, user: %s\n", userId);
+      return UPLOAD_OK;
+    }
+    // The REST API does not keep key order; the newest open log is the one to close
+    if (log.containsKey("time_in") && !log.containsKey("time_out") &&
+        (openKey == nullptr || strcmp(kv.key().c_str(), openKey) > 0))
+    {
+      openKey = kv.key().c_str();
     }
+  }
 
-    // Iterate over the attendance logs looking for an open log (has "time_in" but no "time_out")
-    for (JsonPair kv : doc.as<JsonObject>())
+  char body[backendBodySize];
+  if (openKey != nullptr)
+  {
+    LOG_INFOF("Attendance already marked for user: %s in class %s\n", userId, classId);
+    char encodedOpenKey[sizeof(event.logKey) * 3];
+    if (!pathSafeId(openKey) || !encodeURIComponent(openKey, encodedOpenKey, sizeof(encodedOpenKey)) ||
+        !formatText(path, sizeof(path), "%s/attendanceLogs/%s.json", enrollmentPath, encodedOpenKey) ||
+        !formatText(body, sizeof(body), "{\"time_out\":\"%s\",\"scanner_out\":\"%s\",\"closed_by\":\"%s\"%s}",
+                    timeStr, escapedScannerId, escapedLogKey,
+                    event.clockUnverified ? ",\"time_out_unverified\":true" : ""))
     {
-      JsonObject logEntry = kv.value().as<JsonObject>();
-      if (logEntry.containsKey("time_in") && !logEntry.containsKey("time_out"))
-      {
-        openLogFound = true;
-        // Only now activate the relay since an open log exists.
-        digitalWrite(RELAY_PIN, LOW);
+      LOG_ERRORF("Cannot address the open attendance log of %s in %s\n", userId, classId);
+      return UPLOAD_REJECTED;
+    }
+    int closeCode = backend.patch(path, body);
+    if (closeCode != HTTP_CODE_OK)
+    {
+      LOG_WARNF("Failed to update attendance log with timeout. HTTP error code: %d\n", closeCode);
+      return uploadResultFor(closeCode);
+    }
+    LOG_INFOF("Attendance timeout updated for user: %s in class %s\n", userId, classId);
+    return UPLOAD_OK;
+  }
 
-        struct tm timeinfo;
-        if (!getLocalTime(&timeinfo))
-        {
-          Serial.println("Failed to obtain time");
-          digitalWrite(RELAY_PIN, HIGH);
-          return;
-        }
-        char timeOutStr[9];
-        int hour = timeinfo.tm_hour;
-        String period = (hour >= 12) ? "PM" : "AM";
-        hour = (hour > 12) ? (hour - 12) : (hour == 0 ? 12 : hour);
-        snprintf(timeOutStr, sizeof(timeOutStr), "%02d:%02d %s", hour, timeinfo.tm_min, period.c_str());
-
-        String updateUrl = String(apiUrl) + "logins/" + userId + "/enrolledClasses/" + classId + "/attendanceLogs/" + kv.key().c_str() + ".json";
-        http.begin(client, updateUrl);
-        http.addHeader("Content-Type", "application/json");
-        String patchPayload = "{\"time_out\":\"" + String(timeOutStr) +
-                              "\",\"scanner_out\":\"" + scannerIdTimeOut + "\"}";
-        int patchCode = http.sendRequest("PATCH", patchPayload);
-        http.end();
-
-        if (patchCode == HTTP_CODE_OK)
-        {
-          Serial.println("Attendance timeout updated for user: " + userId + " in class " + classId);
-          updateOLEDMessage("Timeout Updated");
-          playTone(2000, 300);
-          updateSuccess = true;
-          break;
-        }
-        else
-        {
-          Serial.printf("Failed to update attendance log with timeout. HTTP error code: %d\n", patchCode);
-        }
-      }
+  // No log today says nothing about the enrollment itself
+  if (doc.size() == 0)
+  {
+    if (!formatText(path, sizeof(path), "%s.json?shallow=true", enrollmentPath))
+    {
+      return UPLOAD_REJECTED;
+    }
+    int enrolledCode = backend.getJson(path, doc);
+    if (enrolledCode != HTTP_CODE_OK)
+    {
+      LOG_WARNF("Failed to fetch enrollment. HTTP error code: %d\n", enrolledCode);
+      return uploadResultFor(enrolledCode);
     }
+    if (doc.isNull())
+    {
+      LOG_WARNF("User %s is no longer enrolled in class %s, time-in dropped\n", userId, classId);
+      return UPLOAD_OK;
+    }
+  }
+
+  if (!formatText(body, sizeof(body),
+                  "{\"%s/attendance\":true,\"%s/attendanceLogs/%s\":"
+                  "{\"date\":\"%s\",\"time_in\":\"%s\",\"scanner_in\":\"%s\"%s}}",
+                  enrollmentField, enrollmentField, escapedLogKey, dateStr, timeStr, escapedScannerId,
+                  event.clockUnverified ? ",\"time_in_unverified\":true" : ""))
+  {
+    return UPLOAD_REJECTED;
+  }
+  int patchCode = backend.patch(".json", body);
+  if (patchCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Failed to mark attendance. HTTP error code: %d\n", patchCode);
+    return uploadResultFor(patchCode);
+  }
+  LOG_INFOF("Attendance and time-in log recorded for user: %s\n", userId);
+  return UPLOAD_OK;
+}
+
+// --- findOpenLog ---
+// Looks for an attendance log with a time_in but no time_out among the
+// most recent openLogSearchDepth logs, the newest open one if several are.
+OpenLogResult findOpenLog(const char *userId, const char *classId, char *logKey, size_t logKeySize)
+{
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    LOG_WARN("WiFi not connected!");
+    return OPEN_LOG_UNKNOWN;
+  }
+
+  // A path cut short or split by a '/' in an ID would ask about some other
+  // node; no answer is better
+  char enrollmentPath[backendPathSize];
+  char path[backendPathSize];
+  if (!enrollmentUrl(userId, classId, enrollmentPath, sizeof(enrollmentPath)))
+  {
+    return OPEN_LOG_REJECTED;
+  }
+
+  // Only the fields the search looks at; the parse stays within a fixed document
+  static StaticJsonDocument<64> filter;
+  if (filter.isNull())
+  {
+    filter["*"]["time_in"] = true;
+    filter["*"]["time_out"] = true;
+  }
+  // Keys sort by time (dates and push keys alike), so the server can cut the
+  // history down to its newest entries however long it has grown
+  static StaticJsonDocument<2048> doc;
+  if (!formatText(path, sizeof(path), "%s/attendanceLogs.json?orderBy=%%22%%24key%%22&limitToLast=%d",
+                  enrollmentPath, openLogSearchDepth))
+  {
+    return OPEN_LOG_UNKNOWN;
+  }
+  DeserializationError error;
+  int logCode = backend.getJson(path, doc, &filter, &error);
+  if (logCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Failed to fetch attendance logs. HTTP error code: %d\n", logCode);
+    return uploadResultFor(logCode) == UPLOAD_REJECTED ? OPEN_LOG_REJECTED : OPEN_LOG_UNKNOWN;
+  }
+  if (error)
+  {
+    LOG_WARN("Failed to parse attendance logs JSON");
+    return OPEN_LOG_UNKNOWN;
+  }
 
-    if (!openLogFound)
+  // The REST API does not keep key order, so the newest is picked by key
+  const char *openKey = nullptr;
+  for (JsonPair kv : doc.as<JsonObject>())
+  {
+    JsonObject logEntry = kv.value().as<JsonObject>();
+    if (logEntry.containsKey("time_in") && !logEntry.containsKey("time_out") &&
+        (openKey == nullptr || strcmp(kv.key().c_str(), openKey) > 0))
     {
-      Serial.println("No open attendance log found for class " + classId + " for user " + userId);
-      updateOLEDMessage("No open log");
+      openKey = kv.key().c_str();
     }
   }
-  else
+  if (openKey == nullptr)
+  {
+    return OPEN_LOG_NONE;
+  }
+  strncpy(logKey, openKey, logKeySize - 1);
+  logKey[logKeySize - 1] = '\0';
+  return OPEN_LOG_FOUND;
+}
+
+// --- updateTimeoutForClass ---
+// Delivers a journaled time-out. An event with no open log to close is done
+// with; one the backend refuses is dropped. The log is read back before it
+// is closed, since a PATCH to a log deleted with its enrollment would
+// recreate the enrollment.
+UploadResult updateTimeoutForClass(const ScanEvent &event)
+{
+  const char *userId = event.userId;
+  const char *classId = event.classId;
+  char logKey[sizeof(event.logKey)];
+  strcpy(logKey, event.logKey);
+
+  if (logKey[0] == '\0')
   {
-    Serial.printf("Failed to fetch attendance logs. HTTP error code: %d\n", logCode);
-    http.end();
+    OpenLogResult result = findOpenLog(userId, classId, logKey, sizeof(logKey));
+    if (result == OPEN_LOG_UNKNOWN)
+    {
+      return UPLOAD_RETRY;
+    }
+    if (result == OPEN_LOG_REJECTED)
+    {
+      return UPLOAD_REJECTED;
+    }
+    if (result == OPEN_LOG_NONE)
+    {
+      LOG_INFOF("No open attendance log found for class %s for user %s\n", classId, userId);
+      return UPLOAD_OK;
+    }
   }
 
-  // Only if an update occurred (relay activated earlier) do we delay and then turn it off.
-  if (updateSuccess)
+  char dateStr[11];
+  char timeOutStr[9];
+  formatLogTime(event.timestamp, dateStr, sizeof(dateStr), timeOutStr, sizeof(timeOutStr));
+
+  // The log key may have come from the backend, so it is encoded like the IDs
+  char enrollmentPath[backendPathSize];
+  char encodedLogKey[sizeof(logKey) * 3];
+  char escapedScannerId[sizeof(event.scannerId) * 2];
+  char updatePath[backendPathSize];
+  char patchPayload[backendBodySize];
+  if (!enrollmentUrl(userId, classId, enrollmentPath, sizeof(enrollmentPath)) || !pathSafeId(logKey) ||
+      !encodeURIComponent(logKey, encodedLogKey, sizeof(encodedLogKey)) ||
+      !escapeJson(event.scannerId, escapedScannerId, sizeof(escapedScannerId)) ||
+      !formatText(updatePath, sizeof(updatePath), "%s/attendanceLogs/%s.json", enrollmentPath, encodedLogKey) ||
+      !formatText(patchPayload, sizeof(patchPayload), "{\"time_out\":\"%s\",\"scanner_out\":\"%s\"%s}", timeOutStr,
+                  escapedScannerId, event.clockUnverified ? ",\"time_out_unverified\":true" : ""))
+  {
+    LOG_ERRORF("Cannot address the attendance of %s in %s\n", userId, classId);
+    return UPLOAD_REJECTED; // can never be sent
+  }
+  static StaticJsonDocument<256> entry;
+  int logCode = backend.getJson(updatePath, entry);
+  if (logCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("Failed to fetch attendance log. HTTP error code: %d\n", logCode);
+    return uploadResultFor(logCode);
+  }
+  if (entry.isNull() || entry.containsKey("time_out"))
+  {
+    LOG_INFOF("No open attendance log found for class %s for user %s\n", classId, userId);
+    return UPLOAD_OK;
+  }
+  int patchCode = backend.patch(updatePath, patchPayload);
+  if (patchCode != HTTP_CODE_OK)
   {
-    delay(2000); // Wait for 2 seconds
+    LOG_WARNF("Failed to update attendance log with timeout. HTTP error code: %d\n", patchCode);
+    return uploadResultFor(patchCode);
   }
-  // Ensure relay is always set HIGH (closed) at the end.
-  digitalWrite(RELAY_PIN, HIGH);
+  LOG_INFOF("Attendance timeout updated for user: %s in class %s\n", userId, classId);
+  return UPLOAD_OK;
 }
 
 void updateAllTimeouts(const String &userId, const String &currentActiveClassId)
 {
   if (WiFi.status() != WL_CONNECTED)
   {
-    Serial.println("WiFi not connected!");
+    LOG_WARN("WiFi not connected!");
+    return;
+  }
+  // Only the class IDs: shallow=true leaves the attendance histories behind
+  char encodedUserId[encodedUserIdSize];
+  char classesPath[backendPathSize];
+  if (!pathSafeId(userId.c_str()) || !encodeURIComponent(userId.c_str(), encodedUserId, sizeof(encodedUserId)) ||
+      !formatText(classesPath, sizeof(classesPath), "logins/%s/enrolledClasses.json?shallow=true", encodedUserId))
+  {
     return;
   }
-  WiFiClientSecure client;
-  client.setInsecure();
-  HTTPClient http;
-  String classesUrl = String(apiUrl) + "logins/" + userId + "/enrolledClasses.json";
-  http.begin(client, classesUrl);
-  int httpCode = http.GET();
+  PooledJsonDocument doc(jsonArena, 1024);
+  DeserializationError error;
+  int httpCode = backend.getJson(classesPath, doc, nullptr, &error);
   if (httpCode == HTTP_CODE_OK)
   {
-    String payload = http.getString();
-    http.end();
-    DynamicJsonDocument doc(4096);
-    DeserializationError error = deserializeJson(doc, payload);
     if (error)
     {
-      Serial.println("Failed to parse enrolled classes JSON");
+      LOG_WARN("Failed to parse enrolled classes JSON");
       return;
     }
 
@@ -802,56 +2829,52 @@ void updateAllTimeouts(const String &userId, const String &currentActiveClassId)
       {
         continue;
       }
-      updateTimeoutForClass(userId, classId);
+      recordScan(userId.c_str(), classId.c_str(), SCAN_TIME_OUT);
     }
   }
   else
   {
-    Serial.printf("Failed to fetch enrolled classes. HTTP error code: %d\n", httpCode);
-    http.end();
+    LOG_WARNF("Failed to fetch enrolled classes. HTTP error code: %d\n", httpCode);
   }
 }
 
-String getUserFullName(const String &userId)
+// Copies the user's display name into name, or the user ID when there is
+// none. Only the name field is fetched, not the whole login record.
+bool getUserFullName(const char *userId, char *name, size_t nameSize)
 {
-  if (WiFi.status() == WL_CONNECTED)
+  strncpy(name, userId, nameSize - 1);
+  name[nameSize - 1] = '\0';
+  if (WiFi.status() != WL_CONNECTED)
   {
-    WiFiClientSecure client;
-    client.setInsecure();
-    HTTPClient http;
-    String encodedUserId = encodeURIComponent(userId);
-    String url = String(apiUrl) + "logins/" + encodedUserId + ".json";
-    Serial.println("Fetching user full name from: " + url);
-    http.begin(client, url);
-    int httpCode = http.GET();
-    String fullName = userId;
-    if (httpCode == HTTP_CODE_OK)
-    {
-      String payload = http.getString();
-      DynamicJsonDocument doc(1024);
-      DeserializationError error = deserializeJson(doc, payload);
-      if (!error)
-      {
-        if (doc.containsKey("name"))
-        {
-          fullName = doc["name"].as<String>();
-        }
-      }
-      else
-      {
-        Serial.println("Failed to deserialize user JSON");
-      }
-    }
-    else
-    {
-      Serial.printf("HTTP error fetching user info: %d\n", httpCode);
-    }
-    http.end();
-    return fullName;
+    LOG_WARN("WiFi not connected!");
+    return false;
   }
-  else
+  char encodedUserId[encodedUserIdSize];
+  char path[backendPathSize];
+  if (!encodeURIComponent(userId, encodedUserId, sizeof(encodedUserId)) ||
+      !formatText(path, sizeof(path), "logins/%s/name.json", encodedUserId))
   {
-    Serial.println("WiFi not connected!");
-    return userId;
+    return false;
   }
-}
+  LOG_DEBUGF("Fetching user full name from: %s\n", path);
+  static StaticJsonDocument<128> doc;
+  DeserializationError error;
+  int httpCode = backend.getJson(path, doc, nullptr, &error);
+  if (httpCode != HTTP_CODE_OK)
+  {
+    LOG_WARNF("HTTP error fetching user info: %d\n", httpCode);
+    return false;
+  }
+  if (error)
+  {
+    LOG_WARN("Failed to deserialize user JSON");
+    return false;
+  }
+  const char *fullName = doc.as<const char *>();
+  if (fullName == nullptr)
+  {
+    return false;
+  }
+  strncpy(name, fullName, nameSize - 1);
+  return true;
+}
\ No newline at end of file
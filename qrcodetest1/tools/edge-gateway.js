@@ -0,0 +1,523 @@
+// Local stand-in for the on-prem edge gateway that scanners can stream to
+// instead of calling Firebase themselves (see include/GatewayLink.h for the
+// protocol). No dependencies: run with
+//
+//   node tools/edge-gateway.js --key <hex> [--port 8090] [--firebase http://127.0.0.1:8080/] [--poll 5]
+//
+// and build the firmware with GATEWAY_HOST set to this machine and the same
+// key, e.g. build_flags = -D GATEWAY_HOST=\"192.168.1.20\" -D GATEWAY_KEY=\"<hex>\".
+// The key (also read from $GATEWAY_KEY) authenticates both ends: the
+// gateway proves it in the upgrade and every message carries a MAC, so a
+// peer without it can neither feed the gateway scans nor push schedules,
+// rosters or acks to a scanner.
+//
+// Scanners connect over a WebSocket at /scanner and exchange MessagePack
+// messages. Scan events are written to Firebase the way the firmware's
+// markAttendance() and updateTimeoutForClass() would, one scanner's events
+// in order, and acked once written; a write that fails is retried until it
+// goes through, unless Firebase refused it (4xx), when it is logged and
+// acked so the events behind it keep moving. Every --poll seconds the gateway checks classesMeta/version
+// and the rosters scanners follow, once for the whole building, and pushes
+// whatever changed. --firebase can point at tools/mock-firebase.js or a
+// real database root.
+
+const http = require("http");
+const crypto = require("crypto");
+
+const args = process.argv.slice(2);
+const option = (name, fallback) => {
+  const i = args.indexOf(`--${name}`);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : fallback;
+};
+
+const port = parseInt(option("port", "8090"), 10);
+let firebaseRoot = option("firebase", "http://127.0.0.1:8080/");
+if (!firebaseRoot.endsWith("/")) firebaseRoot += "/";
+const pollInterval = parseFloat(option("poll", "5")) * 1000;
+const retryInterval = 5000;
+const keyHex = option("key", process.env.GATEWAY_KEY || "");
+if (!/^([0-9a-fA-F]{2})+$/.test(keyHex)) {
+  console.error("An even-length hex --key (or $GATEWAY_KEY), the scanners' GATEWAY_KEY, is required");
+  process.exit(1);
+}
+const key = Buffer.from(keyHex, "hex");
+const MAC_BYTES = 16; // GATEWAY_MAC_BYTES
+
+// Message types, as in GatewayLink.h
+const GW_HELLO = 1;
+const GW_EVENT = 2;
+const GW_ACK = 3;
+const GW_SCHEDULE = 4;
+const GW_WATCH = 5;
+const GW_ROSTER = 6;
+
+const SCAN_TIME_IN = 0;
+
+// ---------- MessagePack ----------
+function encode(value, out = []) {
+  if (value === null || value === undefined) {
+    out.push(0xc0);
+  } else if (typeof value === "boolean") {
+    out.push(value ? 0xc3 : 0xc2);
+  } else if (typeof value === "number" && Number.isInteger(value) && Math.abs(value) <= 0xffffffff) {
+    if (value >= 0 && value < 0x80) out.push(value);
+    else if (value < 0 && value >= -32) out.push(value & 0xff);
+    else if (value >= 0 && value <= 0xff) out.push(0xcc, value);
+    else if (value >= 0 && value <= 0xffff) out.push(0xcd, value >> 8, value & 0xff);
+    else if (value >= 0) out.push(0xce, ...bytes(4, (b) => b.writeUInt32BE(value)));
+    else out.push(0xd2, ...bytes(4, (b) => b.writeInt32BE(value)));
+  } else if (typeof value === "number") {
+    out.push(0xcb, ...bytes(8, (b) => b.writeDoubleBE(value)));
+  } else if (typeof value === "string") {
+    const text = Buffer.from(value, "utf8");
+    if (text.length < 32) out.push(0xa0 | text.length);
+    else if (text.length <= 0xff) out.push(0xd9, text.length);
+    else if (text.length <= 0xffff) out.push(0xda, text.length >> 8, text.length & 0xff);
+    else out.push(0xdb, ...bytes(4, (b) => b.writeUInt32BE(text.length)));
+    out.push(...text);
+  } else if (Array.isArray(value)) {
+    header(out, value.length, 0x90, 0xdc);
+    for (const item of value) encode(item, out);
+  } else {
+    const entries = Object.entries(value);
+    header(out, entries.length, 0x80, 0xde);
+    for (const [key, item] of entries) {
+      encode(key, out);
+      encode(item, out);
+    }
+  }
+  return out;
+}
+
+function bytes(size, write) {
+  const buffer = Buffer.alloc(size);
+  write(buffer);
+  return buffer;
+}
+
+// Array and map headers: fix form up to 15 entries, else 16 or 32 bits
+function header(out, length, fix, wide) {
+  if (length < 16) out.push(fix | length);
+  else if (length <= 0xffff) out.push(wide, length >> 8, length & 0xff);
+  else out.push(wide + 1, ...bytes(4, (b) => b.writeUInt32BE(length)));
+}
+
+function decode(buffer) {
+  let offset = 0;
+  const read = () => {
+    const type = buffer[offset++];
+    if (type === undefined) throw new Error("truncated message");
+    if (type < 0x80) return type;
+    if (type >= 0xe0) return type - 0x100;
+    if ((type & 0xe0) === 0xa0) return text(type & 0x1f);
+    if ((type & 0xf0) === 0x90) return array(type & 0x0f);
+    if ((type & 0xf0) === 0x80) return map(type & 0x0f);
+    const take = (size, get) => {
+      const value = get(offset);
+      offset += size;
+      return value;
+    };
+    switch (type) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xcc: return take(1, (o) => buffer.readUInt8(o));
+      case 0xcd: return take(2, (o) => buffer.readUInt16BE(o));
+      case 0xce: return take(4, (o) => buffer.readUInt32BE(o));
+      case 0xcf: return Number(take(8, (o) => buffer.readBigUInt64BE(o)));
+      case 0xd0: return take(1, (o) => buffer.readInt8(o));
+      case 0xd1: return take(2, (o) => buffer.readInt16BE(o));
+      case 0xd2: return take(4, (o) => buffer.readInt32BE(o));
+      case 0xd3: return Number(take(8, (o) => buffer.readBigInt64BE(o)));
+      case 0xca: return take(4, (o) => buffer.readFloatBE(o));
+      case 0xcb: return take(8, (o) => buffer.readDoubleBE(o));
+      case 0xd9: return text(take(1, (o) => buffer.readUInt8(o)));
+      case 0xda: return text(take(2, (o) => buffer.readUInt16BE(o)));
+      case 0xdb: return text(take(4, (o) => buffer.readUInt32BE(o)));
+      case 0xdc: return array(take(2, (o) => buffer.readUInt16BE(o)));
+      case 0xdd: return array(take(4, (o) => buffer.readUInt32BE(o)));
+      case 0xde: return map(take(2, (o) => buffer.readUInt16BE(o)));
+      case 0xdf: return map(take(4, (o) => buffer.readUInt32BE(o)));
+      default: throw new Error(`unsupported MessagePack type 0x${type.toString(16)}`);
+    }
+  };
+  const text = (length) => {
+    const value = buffer.toString("utf8", offset, offset + length);
+    offset += length;
+    return value;
+  };
+  const array = (length) => Array.from({ length }, read);
+  const map = (length) => {
+    const value = {};
+    for (let i = 0; i < length; i++) {
+      const key = read();
+      value[key] = read();
+    }
+    return value;
+  };
+  return read();
+}
+
+// ---------- Authentication ----------
+// MAC of the count'th message from sender ("s" scanner, "g" gateway) in a
+// session, as GatewayLink::sign() computes it
+function mac(session, sender, count, message) {
+  const counter = Buffer.alloc(8);
+  counter.writeBigUInt64BE(BigInt(count));
+  return crypto
+    .createHmac("sha256", key)
+    .update(sender)
+    .update(session.wsKey)
+    .update(session.nonce)
+    .update(counter)
+    .update(message)
+    .digest()
+    .subarray(0, MAC_BYTES);
+}
+
+// ---------- Firebase ----------
+async function firebase(method, path, body) {
+  const response = await fetch(firebaseRoot + path, {
+    method,
+    headers: body === undefined ? {} : { "Content-Type": "application/json" },
+    body: body === undefined ? undefined : JSON.stringify(body),
+  });
+  if (!response.ok) {
+    const error = new Error(`${method} ${path}: HTTP ${response.status}`);
+    error.status = response.status;
+    throw error;
+  }
+  return response.json();
+}
+
+const classesPath = (room) =>
+  `classes.json?orderBy=${encodeURIComponent('"room"')}&equalTo=${encodeURIComponent(JSON.stringify(room))}`;
+
+// Date and 12-hour time of an attendance log, in the scanner's time zone,
+// as the firmware's formatLogTime() writes them
+function logTime(epochSeconds, utcOffset) {
+  const local = new Date((epochSeconds + utcOffset) * 1000);
+  const pad = (n) => String(n).padStart(2, "0");
+  const date = `${local.getUTCFullYear()}-${pad(local.getUTCMonth() + 1)}-${pad(local.getUTCDate())}`;
+  const hour = local.getUTCHours();
+  const hour12 = hour > 12 ? hour - 12 : hour === 0 ? 12 : hour;
+  const time = `${pad(hour12)}:${pad(local.getUTCMinutes())} ${hour >= 12 ? "PM" : "AM"}`;
+  return { date, time };
+}
+
+// Key of the newest open log (a time_in but no time_out) among the last
+// eight, as the firmware's findOpenLog() searches
+async function findOpenLog(enrollment) {
+  const recent = await firebase(
+    "GET",
+    `${enrollment}/attendanceLogs.json?orderBy=${encodeURIComponent('"$key"')}&limitToLast=8`,
+  );
+  let open = null;
+  for (const [key, log] of Object.entries(recent || {})) {
+    if (log && log.time_in !== undefined && log.time_out === undefined && (open === null || key > open)) open = key;
+  }
+  return open;
+}
+
+// Only closes a log that is there and still open: a PATCH to a log deleted
+// with its enrollment would bring the enrollment back
+async function closeLog(enrollment, key, fields) {
+  const path = `${enrollment}/attendanceLogs/${encodeURIComponent(key)}.json`;
+  const log = await firebase("GET", path);
+  if (log === null || log.time_out !== undefined) return;
+  await firebase("PATCH", path, fields);
+}
+
+// One scan event, written like markAttendance() (time-in: a log under the
+// event's own key, or a time-out of the day's open log, with closed_by set
+// so a retry can tell) or updateTimeoutForClass(). Safe to repeat. IDs
+// with a '/' would address another node and are refused like Firebase
+// refuses other bad keys.
+async function deliver(session, event) {
+  const { date, time } = logTime(event.s, session.utcOffset);
+  const key = event.k || (event.d === SCAN_TIME_IN ? date : undefined);
+  if ([event.u, event.c, key || ""].some((id) => /[\/\x00-\x1f\x7f]/.test(id))) {
+    const error = new Error(`event for ${event.u} in ${event.c}: ID not allowed in a path`);
+    error.status = 400;
+    throw error;
+  }
+  // Stamped by a clock NTP never confirmed, as the firmware marks it
+  const unverified = (side) => (event.v ? { [`time_${side}_unverified`]: true } : {});
+  const enrollment = `logins/${encodeURIComponent(event.u)}/enrolledClasses/${encodeURIComponent(event.c)}`;
+  if (event.d === SCAN_TIME_IN) {
+    const scanner = session.scannerIn;
+    const today = await firebase(
+      "GET",
+      `${enrollment}/attendanceLogs.json?orderBy=${encodeURIComponent('"$key"')}` +
+        `&startAt=${encodeURIComponent(JSON.stringify(date))}&endAt=${encodeURIComponent(JSON.stringify(date + "~"))}`,
+    );
+    const logs = Object.entries(today || {});
+    if (logs.some(([logKey, log]) => logKey === key || (log && log.closed_by === key))) return;
+    const open = logs
+      .filter(([, log]) => log && log.time_in !== undefined && log.time_out === undefined)
+      .map(([logKey]) => logKey)
+      .sort()
+      .pop();
+    if (open !== undefined) {
+      const fields = { time_out: time, scanner_out: scanner, closed_by: key, ...unverified("out") };
+      await closeLog(enrollment, open, fields);
+      return;
+    }
+    if (logs.length === 0 && (await firebase("GET", `${enrollment}.json?shallow=true`)) === null) {
+      console.error(`${session.name}: ${event.u} is no longer enrolled in ${event.c}, time-in dropped`);
+      return;
+    }
+    // Multi-path keys are raw paths, not URLs
+    const field = `logins/${event.u}/enrolledClasses/${event.c}`;
+    await firebase("PATCH", ".json", {
+      [`${field}/attendance`]: true,
+      [`${field}/attendanceLogs/${key}`]: { date, time_in: time, scanner_in: scanner, ...unverified("in") },
+    });
+    return;
+  }
+  const open = key || (await findOpenLog(enrollment));
+  if (open) {
+    await closeLog(enrollment, open, { time_out: time, scanner_out: session.scannerOut, ...unverified("out") });
+  }
+}
+
+// ---------- Scanner sessions ----------
+const sessions = new Set();
+const schedules = new Map(); // room -> { version, json } last pushed
+const rosters = new Map(); // classId -> JSON of the last fetch
+let classesVersion;
+
+function sendMessage(session, message) {
+  const body = Buffer.from(encode(message));
+  const payload = Buffer.concat([body, mac(session, "g", session.sent++, body)]);
+  let head;
+  if (payload.length < 126) head = Buffer.from([0x82, payload.length]);
+  else if (payload.length <= 0xffff) head = Buffer.from([0x82, 126, payload.length >> 8, payload.length & 0xff]);
+  else head = Buffer.concat([Buffer.from([0x82, 127]), bytes(8, (b) => b.writeBigUInt64BE(BigInt(payload.length)))]);
+  session.socket.write(Buffer.concat([head, payload]));
+  session.bytesOut += head.length + payload.length;
+}
+
+// v is the version node as JSON text, the way the firmware keeps it
+async function pushSchedule(session) {
+  const version = await firebase("GET", "classesMeta/version.json");
+  const json = JSON.stringify(await firebase("GET", classesPath(session.room)));
+  session.scheduleSent = json;
+  sendMessage(session, { t: GW_SCHEDULE, v: JSON.stringify(version), c: JSON.parse(json) });
+}
+
+async function pushRoster(session, classId, json) {
+  if (json === undefined) {
+    json = JSON.stringify(await firebase("GET", `classRosters/${encodeURIComponent(classId)}.json`));
+    rosters.set(classId, json);
+  }
+  if (session.rosterSent === json && session.watching === classId) return;
+  session.watching = classId;
+  session.rosterSent = json;
+  sendMessage(session, { t: GW_ROSTER, c: classId, m: JSON.parse(json) });
+}
+
+// Events are written in the order the scanner sent them; each is acked
+// once it is in Firebase, and a failed write holds the rest back. One that
+// Firebase refused never goes through, so it is dropped and acked.
+function queueEvent(session, event) {
+  session.queue = session.queue.then(async () => {
+    while (!session.closed) {
+      try {
+        await deliver(session, event);
+        session.delivered++;
+        if (!session.closed) sendMessage(session, { t: GW_ACK, q: event.q });
+        return;
+      } catch (error) {
+        if (error.status >= 400 && error.status < 500) {
+          console.error(`${session.name}: event ${event.q} refused, dropped: ${error.message}`);
+          if (!session.closed) sendMessage(session, { t: GW_ACK, q: event.q });
+          return;
+        }
+        console.error(`${session.name}: event ${event.q} not written, retrying: ${error.message}`);
+        await new Promise((resolve) => setTimeout(resolve, retryInterval));
+      }
+    }
+  });
+}
+
+function handleMessage(session, message) {
+  switch (message.t) {
+    case GW_HELLO:
+      session.room = message.r;
+      session.scannerIn = message.i;
+      session.scannerOut = message.o;
+      session.utcOffset = message.z || 0;
+      session.name = `${message.i} (${message.r})`;
+      console.log(`${session.name} connected`);
+      session.queue = session.queue.then(() =>
+        pushSchedule(session).catch((error) => console.error(`${session.name}: schedule: ${error.message}`)),
+      );
+      break;
+    case GW_EVENT:
+      queueEvent(session, message);
+      break;
+    case GW_WATCH:
+      session.queue = session.queue.then(() =>
+        pushRoster(session, message.c).catch((error) => console.error(`${session.name}: roster: ${error.message}`)),
+      );
+      break;
+    default:
+      console.error(`${session.name}: unknown message type ${message.t}`);
+  }
+}
+
+// Splits whole frames off the front of session.input. Scanners mask every
+// frame, as WebSocket clients must.
+function readFrames(session) {
+  while (session.input.length >= 2) {
+    const input = session.input;
+    const opcode = input[0] & 0x0f;
+    let length = input[1] & 0x7f;
+    let offset = 2;
+    if (length === 126) {
+      if (input.length < 4) return;
+      length = input.readUInt16BE(2);
+      offset = 4;
+    } else if (length === 127) {
+      if (input.length < 10) return;
+      length = Number(input.readBigUInt64BE(2));
+      offset = 10;
+    }
+    const masked = (input[1] & 0x80) !== 0;
+    const mask = masked ? input.subarray(offset, offset + 4) : null;
+    if (masked) offset += 4;
+    if (input.length < offset + length) return;
+    const payload = Buffer.from(input.subarray(offset, offset + length));
+    if (mask) for (let i = 0; i < payload.length; i++) payload[i] ^= mask[i & 3];
+    session.input = input.subarray(offset + length);
+    session.bytesIn += offset + length;
+    session.lastHeard = Date.now();
+
+    if (opcode === 0x2) {
+      const body = payload.subarray(0, Math.max(payload.length - MAC_BYTES, 0));
+      const tag = payload.subarray(body.length);
+      if (tag.length !== MAC_BYTES || !crypto.timingSafeEqual(tag, mac(session, "s", session.heard, body))) {
+        console.error(`${session.name}: message failed authentication, dropping the link`);
+        session.socket.destroy();
+        return;
+      }
+      session.heard++;
+      try {
+        handleMessage(session, decode(body));
+      } catch (error) {
+        console.error(`${session.name}: unreadable message: ${error.message}`);
+      }
+    } else if (opcode === 0x9) {
+      session.socket.write(Buffer.concat([Buffer.from([0x8a, payload.length]), payload]));
+    } else if (opcode === 0x8) {
+      session.socket.end(Buffer.from([0x88, 0]));
+    }
+  }
+}
+
+// Pushes schedule and roster changes: one look at Firebase for the whole
+// building, however many scanners are connected
+async function poll() {
+  if (sessions.size === 0) return;
+  const version = await firebase("GET", "classesMeta/version.json");
+  const versionChanged = version !== classesVersion;
+  classesVersion = version;
+  const rooms = new Set([...sessions].filter((s) => s.room !== undefined).map((s) => s.room));
+  for (const room of rooms) {
+    // Without a version node, compare the classes themselves
+    if (!versionChanged && version !== null) continue;
+    const json = JSON.stringify(await firebase("GET", classesPath(room)));
+    for (const session of sessions) {
+      if (session.room === room && session.scheduleSent !== json) {
+        session.scheduleSent = json;
+        sendMessage(session, { t: GW_SCHEDULE, v: JSON.stringify(version), c: JSON.parse(json) });
+        console.log(`${session.name}: schedule pushed`);
+      }
+    }
+  }
+  const watched = new Set([...sessions].map((s) => s.watching).filter((c) => c !== undefined));
+  for (const classId of watched) {
+    const json = JSON.stringify(await firebase("GET", `classRosters/${encodeURIComponent(classId)}.json`));
+    rosters.set(classId, json);
+    for (const session of sessions) {
+      if (session.watching === classId && session.rosterSent !== json) {
+        await pushRoster(session, classId, json);
+        console.log(`${session.name}: roster of ${classId} pushed`);
+      }
+    }
+  }
+}
+
+function schedulePoll() {
+  setTimeout(() => {
+    poll()
+      .catch((error) => console.error(`Poll failed: ${error.message}`))
+      .finally(schedulePoll);
+  }, pollInterval);
+}
+
+const server = http.createServer((req, res) => {
+  res.writeHead(426, { "Content-Type": "text/plain", Upgrade: "websocket" });
+  res.end("Scanners connect with a WebSocket at /scanner\n");
+});
+
+server.on("upgrade", (req, socket) => {
+  const wsKey = req.headers["sec-websocket-key"];
+  if (new URL(req.url, "http://localhost").pathname !== "/scanner" || !wsKey) {
+    socket.end("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n");
+    return;
+  }
+  const accept = crypto
+    .createHash("sha1")
+    .update(wsKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11")
+    .digest("base64");
+  const nonce = crypto.randomBytes(16).toString("base64");
+  const proof = crypto.createHmac("sha256", key).update(`gateway ${wsKey} ${nonce}`).digest("hex");
+  socket.write(
+    "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n" +
+      `Sec-WebSocket-Accept: ${accept}\r\nX-Gateway-Nonce: ${nonce}\r\nX-Gateway-Proof: ${proof}\r\n\r\n`,
+  );
+  socket.setNoDelay(true);
+
+  const session = {
+    socket,
+    name: socket.remoteAddress,
+    wsKey,
+    nonce,
+    sent: 0, // messages sent, for their MACs
+    heard: 0, // and received
+    input: Buffer.alloc(0),
+    queue: Promise.resolve(),
+    closed: false,
+    delivered: 0,
+    bytesIn: 0,
+    bytesOut: 0,
+    lastHeard: Date.now(),
+  };
+  sessions.add(session);
+  // Scanners ping every 20 s when quiet; drop those that stop
+  const watchdog = setInterval(() => {
+    if (Date.now() - session.lastHeard > 60000) socket.destroy();
+  }, 10000);
+  socket.on("data", (chunk) => {
+    session.input = Buffer.concat([session.input, chunk]);
+    readFrames(session);
+  });
+  socket.on("end", () => socket.end());
+  socket.on("error", () => {});
+  socket.on("close", () => {
+    clearInterval(watchdog);
+    session.closed = true;
+    sessions.delete(session);
+    console.log(
+      `${session.name} disconnected: ${session.delivered} event(s) written, ` +
+        `${session.bytesIn} bytes in, ${session.bytesOut} bytes out`,
+    );
+  });
+});
+
+server.listen(port, () => {
+  console.log(`Edge gateway listening on ws://0.0.0.0:${port}/scanner, syncing to ${firebaseRoot}`);
+  schedulePoll();
+});
@@ -0,0 +1,45 @@
+// Mints a signed QR token like the issueQrToken cloud function does, for
+// bench scripts and for testing a scanner without the web app:
+//
+//   node tools/mint-qr-token.js --key <hex> --user <userId>
+//       [--classes id1,id2 | --classes "*"] [--from <unix s>] [--days 7]
+//
+// Prints the token; put it in a QR code as plain text.
+
+const crypto = require("crypto");
+
+const args = process.argv.slice(2);
+const option = (name, fallback) => {
+  const i = args.indexOf(`--${name}`);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : fallback;
+};
+
+// IA1.<userId>.<notBefore>.<notAfter>.<classes>.<mac>, mac being the first
+// 16 bytes of HMAC-SHA256 over the rest, base64url without padding.
+function signQrToken(keyHex, userId, classIds, notBefore, notAfter) {
+  const body = `IA1.${userId}.${notBefore}.${notAfter}.${classIds.join(",")}`;
+  const mac = crypto
+    .createHmac("sha256", Buffer.from(keyHex, "hex"))
+    .update(body)
+    .digest()
+    .subarray(0, 16)
+    .toString("base64url");
+  return `${body}.${mac}`;
+}
+
+const key = option("key", null);
+const user = option("user", null);
+if (!key || !user) {
+  console.error("usage: mint-qr-token.js --key <hex> --user <userId> [--classes ids] [--from s] [--days n]");
+  process.exit(2);
+}
+const classes = option("classes", "*").split(",");
+const from = parseInt(option("from", String(Math.floor(Date.now() / 1000))), 10);
+const days = parseFloat(option("days", "7"));
+const until = Math.floor(from + days * 86400);
+if (until > 0xffffffff) {
+  // The scanner reads the window as 32-bit seconds
+  console.error("mint-qr-token.js: token would expire after 2106");
+  process.exit(2);
+}
+console.log(signQrToken(key, user, classes, from, until));
@@ -0,0 +1,291 @@
+// Local stand-in for the Firebase Realtime Database REST API, for testing
+// the firmware without a real project. No dependencies: run with
+//
+//   node tools/mock-firebase.js [--port 8080] [--data seed.json] [--latency 0]
+//
+// and point apiUrl at "http://<this machine>:8080/".
+//
+// Supports GET/PUT/PATCH/POST/DELETE on "<path>.json", root-level
+// multi-path PATCH, orderBy="<child>"&equalTo=<value> queries,
+// orderBy="$key" with startAt/endAt and limitToFirst/limitToLast,
+// shallow=true, X-Firebase-ETag, and event streams (Accept:
+// text/event-stream) with put/patch/keep-alive events. Like the
+// bumpClassesVersion cloud function, any write under classes/ bumps
+// classesMeta/version. Like the real database it answers 400 to a path or
+// key containing . # $ [ or ].
+//
+// --latency <ms> holds every request that long before answering it, to
+// stand in for the round trip to the real database.
+
+const http = require("http");
+const fs = require("fs");
+const crypto = require("crypto");
+
+const args = process.argv.slice(2);
+const option = (name, fallback) => {
+  const i = args.indexOf(`--${name}`);
+  return i >= 0 && args[i + 1] !== undefined ? args[i + 1] : fallback;
+};
+
+const port = parseInt(option("port", "8080"), 10);
+const dataFile = option("data", null);
+const latency = parseInt(option("latency", "0"), 10);
+let root = dataFile ? JSON.parse(fs.readFileSync(dataFile, "utf8")) : {};
+
+const streams = new Set();
+
+// ---------- Tree helpers ----------
+const splitPath = (path) => path.split("/").filter((part) => part.length > 0);
+
+function getNode(parts) {
+  let node = root;
+  for (const part of parts) {
+    if (node === null || typeof node !== "object" || !(part in node)) {
+      return null;
+    }
+    node = node[part];
+  }
+  return node === undefined ? null : node;
+}
+
+// Empty objects do not exist in Firebase; prune them after every write.
+function prune(node) {
+  if (node === null || typeof node !== "object") return node;
+  for (const key of Object.keys(node)) {
+    node[key] = prune(node[key]);
+    if (node[key] === null) delete node[key];
+  }
+  return Object.keys(node).length === 0 ? null : node;
+}
+
+function setNode(parts, value) {
+  if (parts.length === 0) {
+    root = prune(value === null ? null : JSON.parse(JSON.stringify(value))) || {};
+    return;
+  }
+  let node = root;
+  for (const part of parts.slice(0, -1)) {
+    if (node[part] === null || typeof node[part] !== "object") node[part] = {};
+    node = node[part];
+  }
+  const last = parts[parts.length - 1];
+  if (value === null) {
+    delete node[last];
+  } else {
+    node[last] = JSON.parse(JSON.stringify(value));
+  }
+  root = prune(root) || {};
+}
+
+// orderBy="<child>" with equalTo keeps the children whose <child> matches.
+// orderBy="$key" keeps the children whose keys lie within startAt/endAt,
+// then limitToFirst/limitToLast keeps that many from either end in key
+// order. shallow=true replaces each child object
+// with true.
+function applyQuery(node, params) {
+  if (params.get("shallow") === "true") {
+    if (node === null || typeof node !== "object") return node;
+    const result = {};
+    for (const [key, value] of Object.entries(node)) {
+      result[key] = value !== null && typeof value === "object" ? true : value;
+    }
+    return result;
+  }
+  const orderBy = params.get("orderBy");
+  if (orderBy === '"$key"') {
+    if (node === null || typeof node !== "object") return node;
+    let keys = Object.keys(node).sort();
+    if (params.has("startAt")) keys = keys.filter((key) => key >= JSON.parse(params.get("startAt")));
+    if (params.has("endAt")) keys = keys.filter((key) => key <= JSON.parse(params.get("endAt")));
+    if (params.has("limitToFirst")) keys = keys.slice(0, parseInt(params.get("limitToFirst"), 10));
+    if (params.has("limitToLast")) keys = keys.slice(-parseInt(params.get("limitToLast"), 10));
+    const result = {};
+    for (const key of keys) result[key] = node[key];
+    return result;
+  }
+  if (!orderBy || !params.has("equalTo")) return node;
+  const child = JSON.parse(orderBy);
+  const wanted = JSON.parse(params.get("equalTo"));
+  if (node === null || typeof node !== "object") return null;
+  const result = {};
+  for (const [key, value] of Object.entries(node)) {
+    if (value !== null && typeof value === "object" && value[child] === wanted) {
+      result[key] = value;
+    }
+  }
+  return result;
+}
+
+const etagOf = (value) =>
+  crypto.createHash("sha1").update(JSON.stringify(value)).digest("base64");
+
+// ---------- Change notification ----------
+function notify(event, changedParts, value) {
+  for (const stream of streams) {
+    const listen = stream.parts;
+    const common = Math.min(listen.length, changedParts.length);
+    if (listen.slice(0, common).join("/") !== changedParts.slice(0, common).join("/")) {
+      continue;
+    }
+    if (changedParts.length >= listen.length) {
+      // Change at or below the listened node: forward it with a relative path
+      const relative = "/" + changedParts.slice(listen.length).join("/");
+      send(stream.res, event, { path: relative, data: value });
+    } else {
+      // Change above the listened node: resend the node itself
+      send(stream.res, "put", { path: "/", data: getNode(listen) });
+    }
+  }
+}
+
+// A patch is forwarded as one patch event to streams at or above the patched
+// node, and as a put per touched child to streams below it.
+function notifyPatch(parts, value) {
+  for (const stream of streams) {
+    const listen = stream.parts;
+    if (listen.length <= parts.length && listen.join("/") === parts.slice(0, listen.length).join("/")) {
+      const relative = "/" + parts.slice(listen.length).join("/");
+      send(stream.res, "patch", { path: relative, data: value });
+    }
+  }
+  for (const [key, child] of Object.entries(value)) {
+    const childParts = parts.concat(splitPath(key));
+    for (const stream of streams) {
+      const listen = stream.parts;
+      if (listen.length > parts.length && listen.slice(0, childParts.length).join("/") === childParts.slice(0, listen.length).join("/")) {
+        if (childParts.length >= listen.length) {
+          send(stream.res, "put", { path: "/" + childParts.slice(listen.length).join("/"), data: child });
+        } else {
+          send(stream.res, "put", { path: "/", data: getNode(listen) });
+        }
+      }
+    }
+  }
+}
+
+function send(res, event, data) {
+  res.write(`event: ${event}\ndata: ${JSON.stringify(data)}\n\n`);
+}
+
+function afterWrite(parts) {
+  if (parts[0] === "classes") {
+    const version = Date.now();
+    setNode(["classesMeta", "version"], version);
+    notify("put", ["classesMeta", "version"], version);
+  }
+}
+
+// Firebase keys may not contain these
+const validKey = (key) => !/[.#$\[\]]/.test(key);
+
+// ---------- Request handling ----------
+function readBody(req) {
+  return new Promise((resolve) => {
+    let body = "";
+    req.on("data", (chunk) => (body += chunk));
+    req.on("end", () => resolve(body));
+  });
+}
+
+function reply(res, status, value, headers = {}) {
+  const body = JSON.stringify(value === undefined ? null : value);
+  res.writeHead(status, {
+    "Content-Type": "application/json",
+    "Content-Length": Buffer.byteLength(body),
+    ...headers,
+  });
+  res.end(body);
+}
+
+async function handle(req, res) {
+  const url = new URL(req.url, "http://localhost");
+  if (!url.pathname.endsWith(".json")) {
+    return reply(res, 404, { error: "Paths must end in .json" });
+  }
+  const parts = splitPath(decodeURIComponent(url.pathname.slice(0, -5)));
+  if (!parts.every(validKey)) {
+    return reply(res, 400, { error: "Invalid path" });
+  }
+  const body = await readBody(req);
+  let value;
+  try {
+    value = body.length > 0 ? JSON.parse(body) : null;
+  } catch (error) {
+    return reply(res, 400, { error: "Invalid data; couldn't parse JSON object." });
+  }
+
+  switch (req.method) {
+    case "GET": {
+      if ((req.headers.accept || "").includes("text/event-stream")) {
+        res.writeHead(200, {
+          "Content-Type": "text/event-stream",
+          "Cache-Control": "no-cache",
+          Connection: "close",
+        });
+        const stream = { res, parts };
+        streams.add(stream);
+        send(res, "put", { path: "/", data: applyQuery(getNode(parts), url.searchParams) });
+        const keepAlive = setInterval(() => res.write("event: keep-alive\ndata: null\n\n"), 30000);
+        req.on("close", () => {
+          clearInterval(keepAlive);
+          streams.delete(stream);
+        });
+        return;
+      }
+      const node = applyQuery(getNode(parts), url.searchParams);
+      const headers = {};
+      if (req.headers["x-firebase-etag"] === "true") {
+        headers.ETag = etagOf(node);
+        if (req.headers["if-none-match"] === headers.ETag) {
+          res.writeHead(304, headers);
+          return res.end();
+        }
+      }
+      return reply(res, 200, node, headers);
+    }
+    case "PUT":
+      setNode(parts, value);
+      notify("put", parts, value);
+      afterWrite(parts);
+      return reply(res, 200, value);
+    case "PATCH":
+      if (value === null || typeof value !== "object") {
+        return reply(res, 400, { error: "PATCH data must be an object" });
+      }
+      if (!Object.keys(value).every((key) => splitPath(key).every(validKey))) {
+        return reply(res, 400, { error: "Invalid key in PATCH data" });
+      }
+      for (const [key, child] of Object.entries(value)) {
+        setNode(parts.concat(splitPath(key)), child);
+      }
+      notifyPatch(parts, value);
+      for (const key of Object.keys(value)) afterWrite(parts.concat(splitPath(key)));
+      return reply(res, 200, value);
+    case "POST": {
+      const name = "-" + Date.now().toString(36) + crypto.randomBytes(6).toString("hex");
+      setNode(parts.concat(name), value);
+      notify("put", parts.concat(name), value);
+      afterWrite(parts);
+      return reply(res, 200, { name });
+    }
+    case "DELETE":
+      setNode(parts, null);
+      notify("put", parts, null);
+      afterWrite(parts);
+      return reply(res, 200, null);
+    default:
+      return reply(res, 405, { error: "Method not allowed" });
+  }
+}
+
+http
+  .createServer((req, res) => {
+    const run = () =>
+      handle(req, res).catch((error) => {
+        console.error("Mock request failed:", error);
+        reply(res, 500, { error: error.message });
+      });
+    if (latency > 0) setTimeout(run, latency);
+    else run();
+  })
+  .listen(port, () => console.log(`Mock Firebase listening on http://0.0.0.0:${port}/`));
@@ -0,0 +1,185 @@
+// Replays a recorded frame sequence through MotionGate on the host and
+// reports how many full decodes the gate saves and how many frames with a
+// code in view it would have skipped.
+//
+//   g++ -std=c++11 -O2 -I include -o motion-gate-eval tools/motion-gate-eval.cpp
+//   ./motion-gate-eval frames.txt [--interval 100] [--cell 8] [--threshold 12]
+//                                 [--min-cells 6] [--hold 3000]
+//
+// frames.txt lists one frame per line in capture order: the path of an
+// 8-bit binary PGM (P5) grayscale frame, then 1 if a code is in view in that
+// frame and 0 if not. Paths are relative to the list file.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../include/MotionGate.h"
+
+static bool readPgm(const std::string &path, std::vector<uint8_t> &pixels, int &width, int &height)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  std::string magic;
+  int maxValue = 0;
+  in >> magic;
+  if (magic != "P5")
+  {
+    return false;
+  }
+  // Header fields may be separated by comments
+  int *fields[] = {&width, &height, &maxValue};
+  for (int i = 0; i < 3; i++)
+  {
+    in >> std::ws;
+    while (in.peek() == '#')
+    {
+      std::string comment;
+      std::getline(in, comment);
+      in >> std::ws;
+    }
+    in >> *fields[i];
+  }
+  in.get();
+  if (!in || maxValue != 255 || width <= 0 || height <= 0)
+  {
+    return false;
+  }
+  pixels.resize((size_t)width * height);
+  in.read((char *)pixels.data(), pixels.size());
+  return (size_t)in.gcount() == pixels.size();
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s frames.txt [--interval ms] [--cell px] [--threshold luma] [--min-cells n] [--hold ms]\n", argv[0]);
+    return 2;
+  }
+
+  MotionGateConfig config;
+  uint32_t interval = 100;
+  for (int i = 2; i + 1 < argc; i += 2)
+  {
+    long value = strtol(argv[i + 1], nullptr, 10);
+    if (!strcmp(argv[i], "--interval"))
+      interval = value;
+    else if (!strcmp(argv[i], "--cell"))
+      config.cellSize = value;
+    else if (!strcmp(argv[i], "--threshold"))
+      config.cellThreshold = value;
+    else if (!strcmp(argv[i], "--min-cells"))
+      config.minChangedCells = value;
+    else if (!strcmp(argv[i], "--hold"))
+      config.holdOff = value;
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  std::string listPath = argv[1];
+  std::string baseDir;
+  size_t slash = listPath.find_last_of('/');
+  if (slash != std::string::npos)
+  {
+    baseDir = listPath.substr(0, slash + 1);
+  }
+  std::ifstream list(listPath.c_str());
+  if (!list)
+  {
+    fprintf(stderr, "cannot open %s\n", listPath.c_str());
+    return 1;
+  }
+
+  static MotionGate gate;
+  gate.configure(config);
+
+  unsigned frames = 0, decoded = 0, positives = 0, positivesDecoded = 0;
+  unsigned runs = 0, runsMissed = 0, latencyTotal = 0;
+  bool inRun = false, runHit = false;
+  unsigned runFrames = 0;
+  std::vector<uint8_t> pixels;
+  std::string line;
+  uint32_t now = 0;
+
+  while (std::getline(list, line))
+  {
+    std::istringstream fields(line);
+    std::string path;
+    int label = 0;
+    if (!(fields >> path) || path[0] == '#')
+    {
+      continue;
+    }
+    fields >> label;
+
+    int width = 0, height = 0;
+    if (!readPgm(baseDir + path, pixels, width, height))
+    {
+      fprintf(stderr, "cannot read %s as an 8-bit P5 PGM\n", path.c_str());
+      return 1;
+    }
+
+    bool open = gate.update(pixels.data(), width, height, now);
+    // Stand in for a successful decode: the firmware keeps the gate open
+    // while it is still reading a code
+    if (open && label)
+    {
+      gate.notifyDecoded(now);
+    }
+    frames++;
+    decoded += open;
+
+    if (label)
+    {
+      positives++;
+      positivesDecoded += open;
+      if (!inRun)
+      {
+        inRun = true;
+        runHit = false;
+        runFrames = 0;
+        runs++;
+      }
+      if (open && !runHit)
+      {
+        runHit = true;
+        latencyTotal += runFrames;
+      }
+      runFrames++;
+    }
+    else if (inRun)
+    {
+      inRun = false;
+      runsMissed += !runHit;
+    }
+    now += interval;
+  }
+  if (inRun)
+  {
+    runsMissed += !runHit;
+  }
+
+  if (frames == 0)
+  {
+    fprintf(stderr, "no frames listed\n");
+    return 1;
+  }
+  printf("frames            %u\n", frames);
+  printf("decoded           %u (%.1f%%, %.1f%% saved)\n", decoded, 100.0 * decoded / frames, 100.0 - 100.0 * decoded / frames);
+  if (positives > 0)
+  {
+    printf("code frames       %u, %u decoded (recall %.1f%%)\n", positives, positivesDecoded, 100.0 * positivesDecoded / positives);
+    printf("presentations     %u, %u never decoded\n", runs, runsMissed);
+    if (runs > runsMissed)
+    {
+      printf("first decode      %.1f frames after the code appears (mean)\n", (double)latencyTotal / (runs - runsMissed));
+    }
+  }
+  return 0;
+}